@@ -0,0 +1,65 @@
+// Copyright (c) 2009-2015 The Bitcoin Core developers
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addressindex.h>
+
+#include <coins.h>
+#include <hash.h>
+#include <primitives/block.h>
+#include <script/keva.h>
+#include <undo.h>
+
+#include <algorithm>
+
+#include <assert.h>
+
+uint160 GetAddressIndexHash(const CScript& scriptPubKey)
+{
+    const Span<const unsigned char> script = CKevaScriptView(scriptPubKey).getAddressBytes();
+    return Hash160(script.begin(), script.end());
+}
+
+void BuildAddressIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fConnect, CAddressIndexUpdate& update)
+{
+    assert(blockundo.vtxundo.size() + 1 == block.vtx.size());
+
+    update.fErase = !fConnect;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            assert(txundo.vprevout.size() == tx.vin.size());
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const Coin& coin = txundo.vprevout[j];
+                const uint160 hashScript = GetAddressIndexHash(coin.out.scriptPubKey);
+                update.history.emplace_back(CAddressIndexKey(hashScript, nHeight, txid, j, true), -coin.out.nValue);
+                update.unspent.emplace_back(CAddressUnspentKey(hashScript, prevout),
+                                            fConnect ? CAddressUnspentValue() : CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight));
+                update.spent.emplace_back(prevout, fConnect ? CSpentIndexValue(txid, j, nHeight) : CSpentIndexValue());
+            }
+        }
+
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            if (out.scriptPubKey.IsUnspendable())
+                continue;
+            const uint160 hashScript = GetAddressIndexHash(out.scriptPubKey);
+            update.history.emplace_back(CAddressIndexKey(hashScript, nHeight, txid, j, false), out.nValue);
+            update.unspent.emplace_back(CAddressUnspentKey(hashScript, COutPoint(txid, j)),
+                                        fConnect ? CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight) : CAddressUnspentValue());
+        }
+    }
+
+    // When disconnecting, an output created and spent within the block is
+    // first restored by the spending input and then erased for good, so the
+    // changes have to be applied in the reverse order.
+    if (!fConnect) {
+        std::reverse(update.unspent.begin(), update.unspent.end());
+        std::reverse(update.spent.begin(), update.spent.end());
+    }
+}
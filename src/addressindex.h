@@ -0,0 +1,157 @@
+// Copyright (c) 2009-2015 The Bitcoin Core developers
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include <amount.h>
+#include <crypto/common.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+//! -addressindex default
+static const bool DEFAULT_ADDRESSINDEX = false;
+
+/**
+ * Return the hash under which outputs paying to a script are indexed.  Keva
+ * outputs are indexed under the address embedded in the keva script, so that
+ * they are found together with the plain payments to that address.
+ */
+uint160 GetAddressIndexHash(const CScript& scriptPubKey);
+
+/**
+ * Key of an address history entry: an output paying to the address
+ * (fSpending = false, nIndex is the output) or an input spending such an
+ * output (fSpending = true, nIndex is the input).  The height is stored big
+ * endian, so that the entries of an address are ordered by height.
+ */
+struct CAddressIndexKey
+{
+    uint160 hashScript;
+    int nHeight;
+    uint256 txid;
+    uint32_t nIndex;
+    bool fSpending;
+
+    CAddressIndexKey() : nHeight(0), nIndex(0), fSpending(false) {}
+    CAddressIndexKey(const uint160& hashScriptIn, int nHeightIn, const uint256& txidIn, uint32_t nIndexIn, bool fSpendingIn) :
+        hashScript(hashScriptIn), nHeight(nHeightIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        unsigned char height[4];
+        WriteBE32(height, nHeight);
+        s << hashScript;
+        s.write((const char*)height, sizeof(height));
+        s << txid << nIndex << fSpending;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        unsigned char height[4];
+        s >> hashScript;
+        s.read((char*)height, sizeof(height));
+        nHeight = ReadBE32(height);
+        s >> txid >> nIndex >> fSpending;
+    }
+};
+
+/** Key of an unspent output paying to an address */
+struct CAddressUnspentKey
+{
+    uint160 hashScript;
+    COutPoint outpoint;
+
+    CAddressUnspentKey() {}
+    CAddressUnspentKey(const uint160& hashScriptIn, const COutPoint& outpointIn) :
+        hashScript(hashScriptIn), outpoint(outpointIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashScript);
+        READWRITE(outpoint);
+    }
+};
+
+/** An unspent output paying to an address.  A null value erases the entry. */
+struct CAddressUnspentValue
+{
+    CAmount nValue;
+    CScript scriptPubKey;
+    int nHeight;
+
+    CAddressUnspentValue() : nValue(-1), nHeight(0) {}
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptPubKeyIn, int nHeightIn) :
+        nValue(nValueIn), scriptPubKey(scriptPubKeyIn), nHeight(nHeightIn) {}
+
+    bool IsNull() const { return nValue == -1; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nValue);
+        READWRITE(scriptPubKey);
+        READWRITE(nHeight);
+    }
+};
+
+/** The input spending an output.  A null value erases the entry. */
+struct CSpentIndexValue
+{
+    uint256 txid;
+    uint32_t nInput;
+    int nHeight;
+
+    CSpentIndexValue() : nInput(0), nHeight(-1) {}
+    CSpentIndexValue(const uint256& txidIn, uint32_t nInputIn, int nHeightIn) :
+        txid(txidIn), nInput(nInputIn), nHeight(nHeightIn) {}
+
+    bool IsNull() const { return nHeight == -1; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(nInput);
+        READWRITE(nHeight);
+    }
+};
+
+/**
+ * The changes to the address and spent indexes for connecting or
+ * disconnecting a block.  They have to be applied in order, since an output
+ * can be created and spent in the same block.
+ */
+struct CAddressIndexUpdate
+{
+    //! History entries to write, or to erase if fErase is set.
+    std::vector<std::pair<CAddressIndexKey, CAmount> > history;
+    bool fErase;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > spent;
+
+    CAddressIndexUpdate() : fErase(false) {}
+};
+
+/**
+ * Compute the index changes for connecting (or disconnecting, if fConnect is
+ * false) a block at the given height.  The undo data provides the outputs the
+ * block spends.
+ */
+void BuildAddressIndexUpdate(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fConnect, CAddressIndexUpdate& update);
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -15,6 +15,13 @@
 #include <crypto/sha256.h>
 #include <crypto/sha512.h>
 
+#include <array>
+
+extern "C" void keccakf(uint64_t st[25], int rounds);
+extern "C" void keccakf_x4(uint64_t st[4][25], int rounds);
+extern "C" void cn_fast_hash(const void *data, size_t length, char *hash);
+extern "C" void tree_hash(const char (*hashes)[32], size_t count, char *root_hash);
+
 /* Number of bytes to hash per iteration */
 static const uint64_t BUFFER_SIZE = 1000*1000;
 
@@ -52,6 +59,14 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -60,6 +75,35 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+static void KeccakF1600(benchmark::State& state)
+{
+    uint64_t st[25] = {0};
+    while (state.KeepRunning())
+        keccakf(st, 24);
+}
+
+static void KeccakF1600_x4(benchmark::State& state)
+{
+    uint64_t st[4][25] = {{0}};
+    while (state.KeepRunning())
+        keccakf_x4(st, 24);
+}
+
+static void CNFastHash_64b(benchmark::State& state)
+{
+    char hash[64] = {0};
+    while (state.KeepRunning())
+        cn_fast_hash(hash, 64, hash);
+}
+
+static void TreeHash_1024(benchmark::State& state)
+{
+    std::vector<std::array<char, 32>> hashes(1024);
+    char root[32];
+    while (state.KeepRunning())
+        tree_hash((const char (*)[32])hashes.data(), hashes.size(), root);
+}
+
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
@@ -93,6 +137,11 @@ BENCHMARK(SHA256, 340);
 BENCHMARK(SHA512, 330);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
+BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(KeccakF1600, 2000 * 1000);
+BENCHMARK(KeccakF1600_x4, 1000 * 1000);
+BENCHMARK(CNFastHash_64b, 2000 * 1000);
+BENCHMARK(TreeHash_1024, 2000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
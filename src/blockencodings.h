@@ -7,6 +7,7 @@
 
 #include <primitives/block.h>
 
+#include <deque>
 #include <memory>
 
 class CTxMemPool;
@@ -148,7 +149,12 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /**
+     * Build a compact block.  The coinbase is always prefilled, prefill
+     * lists further transactions to send in full (by ascending index in the
+     * block), e.g. those that the receiver is unlikely to have.
+     */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const std::vector<size_t>& prefill = std::vector<size_t>());
 
     uint64_t GetShortID(const uint256& txhash) const;
 
@@ -201,9 +207,14 @@ public:
     explicit PartiallyDownloadedBlock(CTxMemPool* poolIn) : pool(poolIn) {}
 
     // extra_txn is a list of extra transactions to look at, in <witness hash, reference> form
-    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::deque<std::pair<uint256, CTransactionRef>>& extra_txn);
     bool IsTxAvailable(size_t index) const;
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
+
+    // Where the transactions found by InitData came from
+    size_t GetPrefilledCount() const { return prefilled_count; }
+    size_t GetMempoolCount() const { return mempool_count - extra_count; }
+    size_t GetExtraCount() const { return extra_count; }
 };
 
 #endif
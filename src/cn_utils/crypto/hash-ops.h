@@ -79,6 +79,8 @@ enum {
 };
 
 void cn_fast_hash(const void *data, size_t length, char *hash);
+// hash four messages of equal length stored back to back into four digests
+void cn_fast_hash_x4(const void *data, size_t length, char *hash);
 void cn_slow_hash(const void *data, size_t length, char *hash, int variant, int prehashed, uint64_t height);
 
 void hash_extra_blake(const void *data, size_t length, char *hash);
@@ -95,3 +97,6 @@ uint64_t rx_seedheight(const uint64_t height);
 void rx_seedheights(const uint64_t height, uint64_t *seed_height, uint64_t *next_height);
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length, char *hash, int miners, int is_alt);
 void rx_reorg(const uint64_t split_height);
+void rx_stop_mining(void);
+// Free the RandomX caches and dataset; no VM may be in use anymore.
+void rx_release_caches(void);
@@ -0,0 +1,186 @@
+// Copyright (c) 2018 The Kevacoin Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Four independent Keccak-f[1600] permutations interleaved in AVX2 registers:
+// lane i of each of the four states lives in one 256-bit vector.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "keccak.h"
+
+extern const uint64_t keccakf_rndc[24];
+
+#define XOR256(a, b) _mm256_xor_si256((a), (b))
+#define ANDN256(a, b) _mm256_andnot_si256((a), (b))
+#define ROL256(x, n) _mm256_or_si256(_mm256_slli_epi64((x), (n)), _mm256_srli_epi64((x), 64 - (n)))
+
+#define KECCAK_ROUND_X4(A, E, rc) \
+    Ca = XOR256(XOR256(XOR256(A##ba, A##ga), XOR256(A##ka, A##ma)), A##sa); \
+    Ce = XOR256(XOR256(XOR256(A##be, A##ge), XOR256(A##ke, A##me)), A##se); \
+    Ci = XOR256(XOR256(XOR256(A##bi, A##gi), XOR256(A##ki, A##mi)), A##si); \
+    Co = XOR256(XOR256(XOR256(A##bo, A##go), XOR256(A##ko, A##mo)), A##so); \
+    Cu = XOR256(XOR256(XOR256(A##bu, A##gu), XOR256(A##ku, A##mu)), A##su); \
+    Da = XOR256(Cu, ROL256(Ce, 1)); \
+    De = XOR256(Ca, ROL256(Ci, 1)); \
+    Di = XOR256(Ce, ROL256(Co, 1)); \
+    Do = XOR256(Ci, ROL256(Cu, 1)); \
+    Du = XOR256(Co, ROL256(Ca, 1)); \
+    Ba = XOR256(A##ba, Da); \
+    Be = ROL256(XOR256(A##ge, De), 44); \
+    Bi = ROL256(XOR256(A##ki, Di), 43); \
+    Bo = ROL256(XOR256(A##mo, Do), 21); \
+    Bu = ROL256(XOR256(A##su, Du), 14); \
+    E##ba = XOR256(Ba, ANDN256(Be, Bi)); \
+    E##be = XOR256(Be, ANDN256(Bi, Bo)); \
+    E##bi = XOR256(Bi, ANDN256(Bo, Bu)); \
+    E##bo = XOR256(Bo, ANDN256(Bu, Ba)); \
+    E##bu = XOR256(Bu, ANDN256(Ba, Be)); \
+    Ba = ROL256(XOR256(A##bo, Do), 28); \
+    Be = ROL256(XOR256(A##gu, Du), 20); \
+    Bi = ROL256(XOR256(A##ka, Da), 3); \
+    Bo = ROL256(XOR256(A##me, De), 45); \
+    Bu = ROL256(XOR256(A##si, Di), 61); \
+    E##ga = XOR256(Ba, ANDN256(Be, Bi)); \
+    E##ge = XOR256(Be, ANDN256(Bi, Bo)); \
+    E##gi = XOR256(Bi, ANDN256(Bo, Bu)); \
+    E##go = XOR256(Bo, ANDN256(Bu, Ba)); \
+    E##gu = XOR256(Bu, ANDN256(Ba, Be)); \
+    Ba = ROL256(XOR256(A##be, De), 1); \
+    Be = ROL256(XOR256(A##gi, Di), 6); \
+    Bi = ROL256(XOR256(A##ko, Do), 25); \
+    Bo = ROL256(XOR256(A##mu, Du), 8); \
+    Bu = ROL256(XOR256(A##sa, Da), 18); \
+    E##ka = XOR256(Ba, ANDN256(Be, Bi)); \
+    E##ke = XOR256(Be, ANDN256(Bi, Bo)); \
+    E##ki = XOR256(Bi, ANDN256(Bo, Bu)); \
+    E##ko = XOR256(Bo, ANDN256(Bu, Ba)); \
+    E##ku = XOR256(Bu, ANDN256(Ba, Be)); \
+    Ba = ROL256(XOR256(A##bu, Du), 27); \
+    Be = ROL256(XOR256(A##ga, Da), 36); \
+    Bi = ROL256(XOR256(A##ke, De), 10); \
+    Bo = ROL256(XOR256(A##mi, Di), 15); \
+    Bu = ROL256(XOR256(A##so, Do), 56); \
+    E##ma = XOR256(Ba, ANDN256(Be, Bi)); \
+    E##me = XOR256(Be, ANDN256(Bi, Bo)); \
+    E##mi = XOR256(Bi, ANDN256(Bo, Bu)); \
+    E##mo = XOR256(Bo, ANDN256(Bu, Ba)); \
+    E##mu = XOR256(Bu, ANDN256(Ba, Be)); \
+    Ba = ROL256(XOR256(A##bi, Di), 62); \
+    Be = ROL256(XOR256(A##go, Do), 55); \
+    Bi = ROL256(XOR256(A##ku, Du), 39); \
+    Bo = ROL256(XOR256(A##ma, Da), 41); \
+    Bu = ROL256(XOR256(A##se, De), 2); \
+    E##sa = XOR256(Ba, ANDN256(Be, Bi)); \
+    E##se = XOR256(Be, ANDN256(Bi, Bo)); \
+    E##si = XOR256(Bi, ANDN256(Bo, Bu)); \
+    E##so = XOR256(Bo, ANDN256(Bu, Ba)); \
+    E##su = XOR256(Bu, ANDN256(Ba, Be)); \
+    E##ba = XOR256(E##ba, _mm256_set1_epi64x((long long)(rc)))
+
+#define STORE_LANE(i, v) do { \
+    uint64_t out_[4]; \
+    _mm256_storeu_si256((__m256i *) out_, (v)); \
+    st[0][i] = out_[0]; \
+    st[1][i] = out_[1]; \
+    st[2][i] = out_[2]; \
+    st[3][i] = out_[3]; \
+} while (0)
+
+void keccakf_x4_avx2(uint64_t st[4][25], int rounds)
+{
+    __m256i Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu, Aka, Ake, Aki, Ako, Aku, Ama, Ame, Ami, Amo, Amu, Asa, Ase, Asi, Aso, Asu;
+    __m256i Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki, Eko, Eku, Ema, Eme, Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu;
+    __m256i Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du, Ba, Be, Bi, Bo, Bu;
+    int round;
+
+    Aba = _mm256_set_epi64x(st[3][0], st[2][0], st[1][0], st[0][0]);
+    Abe = _mm256_set_epi64x(st[3][1], st[2][1], st[1][1], st[0][1]);
+    Abi = _mm256_set_epi64x(st[3][2], st[2][2], st[1][2], st[0][2]);
+    Abo = _mm256_set_epi64x(st[3][3], st[2][3], st[1][3], st[0][3]);
+    Abu = _mm256_set_epi64x(st[3][4], st[2][4], st[1][4], st[0][4]);
+    Aga = _mm256_set_epi64x(st[3][5], st[2][5], st[1][5], st[0][5]);
+    Age = _mm256_set_epi64x(st[3][6], st[2][6], st[1][6], st[0][6]);
+    Agi = _mm256_set_epi64x(st[3][7], st[2][7], st[1][7], st[0][7]);
+    Ago = _mm256_set_epi64x(st[3][8], st[2][8], st[1][8], st[0][8]);
+    Agu = _mm256_set_epi64x(st[3][9], st[2][9], st[1][9], st[0][9]);
+    Aka = _mm256_set_epi64x(st[3][10], st[2][10], st[1][10], st[0][10]);
+    Ake = _mm256_set_epi64x(st[3][11], st[2][11], st[1][11], st[0][11]);
+    Aki = _mm256_set_epi64x(st[3][12], st[2][12], st[1][12], st[0][12]);
+    Ako = _mm256_set_epi64x(st[3][13], st[2][13], st[1][13], st[0][13]);
+    Aku = _mm256_set_epi64x(st[3][14], st[2][14], st[1][14], st[0][14]);
+    Ama = _mm256_set_epi64x(st[3][15], st[2][15], st[1][15], st[0][15]);
+    Ame = _mm256_set_epi64x(st[3][16], st[2][16], st[1][16], st[0][16]);
+    Ami = _mm256_set_epi64x(st[3][17], st[2][17], st[1][17], st[0][17]);
+    Amo = _mm256_set_epi64x(st[3][18], st[2][18], st[1][18], st[0][18]);
+    Amu = _mm256_set_epi64x(st[3][19], st[2][19], st[1][19], st[0][19]);
+    Asa = _mm256_set_epi64x(st[3][20], st[2][20], st[1][20], st[0][20]);
+    Ase = _mm256_set_epi64x(st[3][21], st[2][21], st[1][21], st[0][21]);
+    Asi = _mm256_set_epi64x(st[3][22], st[2][22], st[1][22], st[0][22]);
+    Aso = _mm256_set_epi64x(st[3][23], st[2][23], st[1][23], st[0][23]);
+    Asu = _mm256_set_epi64x(st[3][24], st[2][24], st[1][24], st[0][24]);
+
+    for (round = 0; round + 1 < rounds; round += 2) {
+        KECCAK_ROUND_X4(A, E, keccakf_rndc[round]);
+        KECCAK_ROUND_X4(E, A, keccakf_rndc[round + 1]);
+    }
+    if (round < rounds) {
+        KECCAK_ROUND_X4(A, E, keccakf_rndc[round]);
+        Aba = Eba;
+        Abe = Ebe;
+        Abi = Ebi;
+        Abo = Ebo;
+        Abu = Ebu;
+        Aga = Ega;
+        Age = Ege;
+        Agi = Egi;
+        Ago = Ego;
+        Agu = Egu;
+        Aka = Eka;
+        Ake = Eke;
+        Aki = Eki;
+        Ako = Eko;
+        Aku = Eku;
+        Ama = Ema;
+        Ame = Eme;
+        Ami = Emi;
+        Amo = Emo;
+        Amu = Emu;
+        Asa = Esa;
+        Ase = Ese;
+        Asi = Esi;
+        Aso = Eso;
+        Asu = Esu;
+    }
+
+    STORE_LANE(0, Aba);
+    STORE_LANE(1, Abe);
+    STORE_LANE(2, Abi);
+    STORE_LANE(3, Abo);
+    STORE_LANE(4, Abu);
+    STORE_LANE(5, Aga);
+    STORE_LANE(6, Age);
+    STORE_LANE(7, Agi);
+    STORE_LANE(8, Ago);
+    STORE_LANE(9, Agu);
+    STORE_LANE(10, Aka);
+    STORE_LANE(11, Ake);
+    STORE_LANE(12, Aki);
+    STORE_LANE(13, Ako);
+    STORE_LANE(14, Aku);
+    STORE_LANE(15, Ama);
+    STORE_LANE(16, Ame);
+    STORE_LANE(17, Ami);
+    STORE_LANE(18, Amo);
+    STORE_LANE(19, Amu);
+    STORE_LANE(20, Asa);
+    STORE_LANE(21, Ase);
+    STORE_LANE(22, Asi);
+    STORE_LANE(23, Aso);
+    STORE_LANE(24, Asu);
+}
+
+#endif
@@ -2,6 +2,10 @@
 // 19-Nov-11  Markku-Juhani O. Saarinen <mjos@iki.fi>
 // A baseline Keccak (3rd round) implementation.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -43,9 +47,9 @@ const int keccakf_piln[24] =
     15, 23, 19, 13, 12, 2, 20, 14, 22, 9,  6,  1 
 };
 
-// update the state with given number of rounds
+// update the state with given number of rounds (portable reference loop)
 
-void keccakf(uint64_t st[25], int rounds)
+void keccakf_generic(uint64_t st[25], int rounds)
 {
     int i, j, round;
     uint64_t t, bc[5];
@@ -84,6 +88,169 @@ void keccakf(uint64_t st[25], int rounds)
     }
 }
 
+// Fully unrolled Keccak-f[1600] using the lane complementing transform: six
+// lanes of the state are kept inverted between rounds, which turns most of
+// the andn operations of chi into plain and/or. Rounds are processed in
+// pairs so the two register sets A and E swap roles without copying.
+
+#define KECCAK_ROUND(A, E, rc) \
+    Ca = A##ba ^ A##ga ^ A##ka ^ A##ma ^ A##sa; \
+    Ce = A##be ^ A##ge ^ A##ke ^ A##me ^ A##se; \
+    Ci = A##bi ^ A##gi ^ A##ki ^ A##mi ^ A##si; \
+    Co = A##bo ^ A##go ^ A##ko ^ A##mo ^ A##so; \
+    Cu = A##bu ^ A##gu ^ A##ku ^ A##mu ^ A##su; \
+    Da = Cu ^ ROTL64(Ce, 1); \
+    De = Ca ^ ROTL64(Ci, 1); \
+    Di = Ce ^ ROTL64(Co, 1); \
+    Do = Ci ^ ROTL64(Cu, 1); \
+    Du = Co ^ ROTL64(Ca, 1); \
+    Ba = A##ba ^ Da; \
+    Be = ROTL64((A##ge ^ De), 44); \
+    Bi = ROTL64((A##ki ^ Di), 43); \
+    Bo = ROTL64((A##mo ^ Do), 21); \
+    Bu = ROTL64((A##su ^ Du), 14); \
+    E##ba = Ba ^ (Be | Bi); \
+    E##be = Be ^ ((~Bi) | Bo); \
+    E##bi = Bi ^ (Bo & Bu); \
+    E##bo = Bo ^ (Bu | Ba); \
+    E##bu = Bu ^ (Ba & Be); \
+    Ba = ROTL64((A##bo ^ Do), 28); \
+    Be = ROTL64((A##gu ^ Du), 20); \
+    Bi = ROTL64((A##ka ^ Da), 3); \
+    Bo = ROTL64((A##me ^ De), 45); \
+    Bu = ROTL64((A##si ^ Di), 61); \
+    E##ga = Ba ^ (Be | Bi); \
+    E##ge = Be ^ (Bi & Bo); \
+    E##gi = Bi ^ (Bo | (~Bu)); \
+    E##go = Bo ^ (Bu | Ba); \
+    E##gu = Bu ^ (Ba & Be); \
+    Ba = ROTL64((A##be ^ De), 1); \
+    Be = ROTL64((A##gi ^ Di), 6); \
+    Bi = ROTL64((A##ko ^ Do), 25); \
+    Bo = ROTL64((A##mu ^ Du), 8); \
+    Bu = ROTL64((A##sa ^ Da), 18); \
+    E##ka = Ba ^ (Be | Bi); \
+    E##ke = Be ^ (Bi & Bo); \
+    E##ki = Bi ^ ((~Bo) & Bu); \
+    E##ko = (~Bo) ^ (Bu | Ba); \
+    E##ku = Bu ^ (Ba & Be); \
+    Ba = ROTL64((A##bu ^ Du), 27); \
+    Be = ROTL64((A##ga ^ Da), 36); \
+    Bi = ROTL64((A##ke ^ De), 10); \
+    Bo = ROTL64((A##mi ^ Di), 15); \
+    Bu = ROTL64((A##so ^ Do), 56); \
+    E##ma = Ba ^ (Be & Bi); \
+    E##me = Be ^ (Bi | Bo); \
+    E##mi = Bi ^ ((~Bo) | Bu); \
+    E##mo = (~Bo) ^ (Bu & Ba); \
+    E##mu = Bu ^ (Ba | Be); \
+    Ba = ROTL64((A##bi ^ Di), 62); \
+    Be = ROTL64((A##go ^ Do), 55); \
+    Bi = ROTL64((A##ku ^ Du), 39); \
+    Bo = ROTL64((A##ma ^ Da), 41); \
+    Bu = ROTL64((A##se ^ De), 2); \
+    E##sa = Ba ^ ((~Be) & Bi); \
+    E##se = (~Be) ^ (Bi | Bo); \
+    E##si = Bi ^ (Bo & Bu); \
+    E##so = Bo ^ (Bu | Ba); \
+    E##su = Bu ^ (Ba & Be); \
+    E##ba ^= (rc)
+
+void keccakf(uint64_t st[25], int rounds)
+{
+    uint64_t Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu, Aka, Ake, Aki, Ako, Aku, Ama, Ame, Ami, Amo, Amu, Asa, Ase, Asi, Aso, Asu;
+    uint64_t Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki, Eko, Eku, Ema, Eme, Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu;
+    uint64_t Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du, Ba, Be, Bi, Bo, Bu;
+    int round;
+
+    Aba = st[0];
+    Abe = ~st[1];
+    Abi = ~st[2];
+    Abo = st[3];
+    Abu = st[4];
+    Aga = st[5];
+    Age = st[6];
+    Agi = st[7];
+    Ago = ~st[8];
+    Agu = st[9];
+    Aka = st[10];
+    Ake = st[11];
+    Aki = ~st[12];
+    Ako = st[13];
+    Aku = st[14];
+    Ama = st[15];
+    Ame = st[16];
+    Ami = ~st[17];
+    Amo = st[18];
+    Amu = st[19];
+    Asa = ~st[20];
+    Ase = st[21];
+    Asi = st[22];
+    Aso = st[23];
+    Asu = st[24];
+
+    for (round = 0; round + 1 < rounds; round += 2) {
+        KECCAK_ROUND(A, E, keccakf_rndc[round]);
+        KECCAK_ROUND(E, A, keccakf_rndc[round + 1]);
+    }
+    if (round < rounds) {
+        KECCAK_ROUND(A, E, keccakf_rndc[round]);
+        Aba = Eba;
+        Abe = Ebe;
+        Abi = Ebi;
+        Abo = Ebo;
+        Abu = Ebu;
+        Aga = Ega;
+        Age = Ege;
+        Agi = Egi;
+        Ago = Ego;
+        Agu = Egu;
+        Aka = Eka;
+        Ake = Eke;
+        Aki = Eki;
+        Ako = Eko;
+        Aku = Eku;
+        Ama = Ema;
+        Ame = Eme;
+        Ami = Emi;
+        Amo = Emo;
+        Amu = Emu;
+        Asa = Esa;
+        Ase = Ese;
+        Asi = Esi;
+        Aso = Eso;
+        Asu = Esu;
+    }
+
+    st[0] = Aba;
+    st[1] = ~Abe;
+    st[2] = ~Abi;
+    st[3] = Abo;
+    st[4] = Abu;
+    st[5] = Aga;
+    st[6] = Age;
+    st[7] = Agi;
+    st[8] = ~Ago;
+    st[9] = Agu;
+    st[10] = Aka;
+    st[11] = Ake;
+    st[12] = ~Aki;
+    st[13] = Ako;
+    st[14] = Aku;
+    st[15] = Ama;
+    st[16] = Ame;
+    st[17] = ~Ami;
+    st[18] = Amo;
+    st[19] = Amu;
+    st[20] = ~Asa;
+    st[21] = Ase;
+    st[22] = Asi;
+    st[23] = Aso;
+    st[24] = Asu;
+}
+
+#undef KECCAK_ROUND
+
 // compute a keccak hash (md) of given byte length from "in"
 typedef uint64_t state_t[25];
 
@@ -138,6 +305,79 @@ void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md)
     keccak(in, inlen, md, sizeof(state_t));
 }
 
+#if defined(ENABLE_AVX2)
+void keccakf_x4_avx2(uint64_t st[4][25], int rounds);
+
+static int keccak_have_avx2(void)
+{
+    static int have_avx2 = -1;
+    if (have_avx2 < 0) {
+        __builtin_cpu_init();
+        have_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return have_avx2;
+}
+#endif
+
+void keccakf_x4(uint64_t st[4][25], int rounds)
+{
+    int k;
+
+#if defined(ENABLE_AVX2)
+    if (keccak_have_avx2()) {
+        keccakf_x4_avx2(st, rounds);
+        return;
+    }
+#endif
+    for (k = 0; k < 4; k++)
+        keccakf(st[k], rounds);
+}
+
+void keccak_x4(const uint8_t *in, size_t inlen, uint8_t *md, int mdlen)
+{
+    uint64_t st[4][25];
+    uint8_t temp[144];
+    size_t i, k, off, rsiz, rsizw;
+
+    if (mdlen <= 0 || mdlen > 100 || ((size_t)mdlen % sizeof(uint64_t)) != 0)
+    {
+      local_abort("Bad keccak use");
+    }
+
+    rsiz = 200 - 2 * mdlen;
+    rsizw = rsiz / 8;
+
+    // the last block is padded in temp
+    if (rsiz > sizeof(temp))
+    {
+      local_abort("Bad keccak use");
+    }
+
+    memset(st, 0, sizeof(st));
+
+    for (off = 0; inlen - off >= rsiz; off += rsiz) {
+        for (k = 0; k < 4; k++)
+            for (i = 0; i < rsizw; i++)
+                st[k][i] ^= swap64le(((uint64_t *) (in + k * inlen + off))[i]);
+        keccakf_x4(st, KECCAK_ROUNDS);
+    }
+
+    // last block and padding
+    for (k = 0; k < 4; k++) {
+        memcpy(temp, in + k * inlen + off, inlen - off);
+        temp[inlen - off] = 1;
+        memset(temp + inlen - off + 1, 0, rsiz - (inlen - off) - 1);
+        temp[rsiz - 1] |= 0x80;
+        for (i = 0; i < rsizw; i++)
+            st[k][i] ^= swap64le(((uint64_t *) temp)[i]);
+    }
+
+    keccakf_x4(st, KECCAK_ROUNDS);
+
+    for (k = 0; k < 4; k++)
+        memcpy_swap64le(md + k * mdlen, st[k], mdlen/sizeof(uint64_t));
+}
+
 #define KECCAK_FINALIZED 0x80000000
 #define KECCAK_BLOCKLEN 136
 #define KECCAK_WORDS 17
@@ -32,6 +32,17 @@ void keccak(const uint8_t *in, size_t inlen, uint8_t *md, int mdlen);
 // update the state
 void keccakf(uint64_t st[25], int norounds);
 
+// portable reference permutation, kept for self-tests and benchmarks
+void keccakf_generic(uint64_t st[25], int norounds);
+
+// update four independent states at once (AVX2 when available)
+void keccakf_x4(uint64_t st[4][25], int norounds);
+
+// hash four equally sized messages stored back to back in "in"; the four
+// digests of mdlen bytes each are written back to back to md; mdlen must be
+// a multiple of 8 from 32 to 96
+void keccak_x4(const uint8_t *in, size_t inlen, uint8_t *md, int mdlen);
+
 void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md);
 
 void keccak_init(KECCAK_CTX * ctx);
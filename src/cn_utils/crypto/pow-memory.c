@@ -0,0 +1,199 @@
+// Copyright (c) 2018 The Kevacoin Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "c_threads.h"
+#include "pow-memory.h"
+
+#if !defined(_WIN32) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static volatile int large_pages_enabled = 1;
+
+static CTHR_MUTEX_TYPE pow_mem_mutex = CTHR_MUTEX_INIT;
+static struct pow_mem_stats pow_mem_stats[POW_MEM_KINDS];
+
+// Reserved scratchpads are chained through their first bytes
+struct pow_mem_reserved {
+  struct pow_mem_reserved *next;
+  enum pow_mem_page_type type;
+};
+static struct pow_mem_reserved *reserved_scratchpads = NULL;
+
+void pow_mem_set_large_pages(int enable)
+{
+  large_pages_enabled = enable ? 1 : 0;
+}
+
+int pow_mem_large_pages_enabled(void)
+{
+  return large_pages_enabled;
+}
+
+static void *alloc_pages(size_t size, enum pow_mem_page_type *type)
+{
+  void *ptr = NULL;
+
+#if defined(_WIN32)
+  if (large_pages_enabled) {
+    SIZE_T page = GetLargePageMinimum();
+    if (page > 0) {
+      ptr = VirtualAlloc(NULL, (size + page - 1) & ~(page - 1), MEM_LARGE_PAGES | MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+      if (ptr != NULL) {
+        *type = POW_MEM_PAGES_HUGE;
+        return ptr;
+      }
+    }
+  }
+  ptr = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  if (ptr != NULL) {
+    *type = POW_MEM_PAGES_MAPPED;
+    return ptr;
+  }
+#else
+#if defined(MAP_HUGETLB)
+  if (large_pages_enabled) {
+    ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+      *type = POW_MEM_PAGES_HUGE;
+      return ptr;
+    }
+  }
+#endif
+  ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr != MAP_FAILED) {
+#if defined(MADV_HUGEPAGE)
+    // No reserved huge pages: let the kernel back the region with
+    // transparent huge pages where it can
+    if (large_pages_enabled)
+      madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    *type = POW_MEM_PAGES_MAPPED;
+    return ptr;
+  }
+#endif
+
+  *type = POW_MEM_PAGES_HEAP;
+  return malloc(size);
+}
+
+static void free_pages(void *ptr, size_t size, enum pow_mem_page_type type)
+{
+  if (type == POW_MEM_PAGES_HEAP) {
+    free(ptr);
+    return;
+  }
+#if defined(_WIN32)
+  VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+  munmap(ptr, size);
+#endif
+}
+
+static void update_stats(enum pow_mem_kind kind, size_t size, int huge, int sign)
+{
+  struct pow_mem_stats *s = &pow_mem_stats[kind];
+
+  CTHR_MUTEX_LOCK(pow_mem_mutex);
+  s->regions += sign;
+  s->bytes += sign * (int64_t)size;
+  if (huge) {
+    s->huge_regions += sign;
+    s->huge_bytes += sign * (int64_t)size;
+  }
+  CTHR_MUTEX_UNLOCK(pow_mem_mutex);
+}
+
+void *pow_mem_alloc(enum pow_mem_kind kind, size_t size, enum pow_mem_page_type *type)
+{
+  void *ptr = alloc_pages(size, type);
+  if (ptr != NULL)
+    update_stats(kind, size, *type == POW_MEM_PAGES_HUGE, 1);
+  return ptr;
+}
+
+void pow_mem_free(enum pow_mem_kind kind, void *ptr, size_t size, enum pow_mem_page_type type)
+{
+  if (ptr == NULL)
+    return;
+  free_pages(ptr, size, type);
+  update_stats(kind, size, type == POW_MEM_PAGES_HUGE, -1);
+}
+
+void pow_mem_record(enum pow_mem_kind kind, size_t size, int huge)
+{
+  update_stats(kind, size, huge, 1);
+}
+
+void pow_mem_release(enum pow_mem_kind kind, size_t size, int huge)
+{
+  update_stats(kind, size, huge, -1);
+}
+
+unsigned pow_mem_reserve_scratchpads(unsigned count, size_t size)
+{
+  unsigned huge = 0;
+
+  while (count--) {
+    enum pow_mem_page_type type;
+    struct pow_mem_reserved *r = pow_mem_alloc(POW_MEM_CN_SCRATCHPAD, size, &type);
+    if (r == NULL)
+      break;
+    if (type == POW_MEM_PAGES_HUGE)
+      ++huge;
+    r->type = type;
+    CTHR_MUTEX_LOCK(pow_mem_mutex);
+    r->next = reserved_scratchpads;
+    reserved_scratchpads = r;
+    CTHR_MUTEX_UNLOCK(pow_mem_mutex);
+  }
+  return huge;
+}
+
+void *pow_mem_acquire_scratchpad(size_t size, enum pow_mem_page_type *type)
+{
+  struct pow_mem_reserved *r;
+
+  CTHR_MUTEX_LOCK(pow_mem_mutex);
+  r = reserved_scratchpads;
+  if (r != NULL)
+    reserved_scratchpads = r->next;
+  CTHR_MUTEX_UNLOCK(pow_mem_mutex);
+
+  if (r != NULL) {
+    *type = r->type;
+    return r;
+  }
+  return pow_mem_alloc(POW_MEM_CN_SCRATCHPAD, size, type);
+}
+
+void pow_mem_release_scratchpad(void *ptr, size_t size, enum pow_mem_page_type type)
+{
+  struct pow_mem_reserved *r = ptr;
+
+  if (ptr == NULL)
+    return;
+  (void)size;
+  r->type = type;
+  CTHR_MUTEX_LOCK(pow_mem_mutex);
+  r->next = reserved_scratchpads;
+  reserved_scratchpads = r;
+  CTHR_MUTEX_UNLOCK(pow_mem_mutex);
+}
+
+void pow_mem_get_stats(enum pow_mem_kind kind, struct pow_mem_stats *stats)
+{
+  CTHR_MUTEX_LOCK(pow_mem_mutex);
+  *stats = pow_mem_stats[kind];
+  CTHR_MUTEX_UNLOCK(pow_mem_mutex);
+}
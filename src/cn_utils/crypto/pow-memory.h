@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The Kevacoin Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Large-page aware allocator shared by the CryptoNight scratchpads and the
+// RandomX cache and dataset. It keeps track of which regions actually got
+// huge pages so the node can report it.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of one CryptoNight scratchpad
+#define POW_MEM_CN_SCRATCHPAD_SIZE (1 << 21)
+
+enum pow_mem_kind {
+  POW_MEM_CN_SCRATCHPAD,
+  POW_MEM_RX_CACHE,
+  POW_MEM_RX_DATASET,
+  POW_MEM_KINDS
+};
+
+// How a region was obtained: explicit huge pages (MAP_HUGETLB or
+// MEM_LARGE_PAGES), an anonymous mapping advised for transparent huge
+// pages, or plain heap memory.
+enum pow_mem_page_type {
+  POW_MEM_PAGES_HUGE,
+  POW_MEM_PAGES_MAPPED,
+  POW_MEM_PAGES_HEAP
+};
+
+struct pow_mem_stats {
+  uint64_t regions;
+  uint64_t huge_regions;
+  uint64_t bytes;
+  uint64_t huge_bytes;
+};
+
+// Enable or disable huge page allocation attempts (enabled by default).
+void pow_mem_set_large_pages(int enable);
+int pow_mem_large_pages_enabled(void);
+
+// Allocate a region of at least size bytes for the given use, trying huge
+// pages first when enabled. Never returns NULL unless all fallbacks fail.
+void *pow_mem_alloc(enum pow_mem_kind kind, size_t size, enum pow_mem_page_type *type);
+void pow_mem_free(enum pow_mem_kind kind, void *ptr, size_t size, enum pow_mem_page_type type);
+
+// Account for a region allocated elsewhere (RandomX allocates its own memory).
+void pow_mem_record(enum pow_mem_kind kind, size_t size, int huge);
+void pow_mem_release(enum pow_mem_kind kind, size_t size, int huge);
+
+// Reserve count CryptoNight scratchpads of size bytes up front, while huge
+// pages are still easy to come by. Returns how many got huge pages.
+unsigned pow_mem_reserve_scratchpads(unsigned count, size_t size);
+// Take a scratchpad from the reserve, or allocate a new one.
+void *pow_mem_acquire_scratchpad(size_t size, enum pow_mem_page_type *type);
+// Return a scratchpad to the reserve.
+void pow_mem_release_scratchpad(void *ptr, size_t size, enum pow_mem_page_type type);
+
+void pow_mem_get_stats(enum pow_mem_kind kind, struct pow_mem_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -37,8 +37,10 @@
 #include <limits.h>
 
 #include "randomx.h"
+#include "configuration.h"
 #include "c_threads.h"
 #include "hash-ops.h"
+#include "pow-memory.h"
 #include "misc_log_ex.h"
 
 #define RX_LOGCAT	"randomx"
@@ -54,14 +56,16 @@ typedef struct rx_state {
   char rs_hash[HASH_SIZE];
   uint64_t  rs_height;
   randomx_cache *rs_cache;
+  int rs_huge;
 } rx_state;
 
 static CTHR_MUTEX_TYPE rx_mutex = CTHR_MUTEX_INIT;
 static CTHR_MUTEX_TYPE rx_dataset_mutex = CTHR_MUTEX_INIT;
 
-static rx_state rx_s[2] = {{CTHR_MUTEX_INIT,{0},0,0},{CTHR_MUTEX_INIT,{0},0,0}};
+static rx_state rx_s[2] = {{CTHR_MUTEX_INIT,{0},0,0,0},{CTHR_MUTEX_INIT,{0},0,0,0}};
 
 static randomx_dataset *rx_dataset;
+static int rx_dataset_huge;
 static uint64_t rx_dataset_height;
 static THREADV randomx_vm *rx_vm = NULL;
 
@@ -221,15 +225,19 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
 
   cache = rx_sp->rs_cache;
   if (cache == NULL) {
-    if (cache == NULL) {
+    int huge = 0;
+    if (pow_mem_large_pages_enabled()) {
       cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
-      if (cache == NULL) {
-        //printf("Couldn't use largePages for RandomX cache\n");
-        cache = randomx_alloc_cache(flags);
-      }
-      if (cache == NULL)
-        local_abort("Couldn't allocate RandomX cache");
+      huge = cache != NULL;
+    }
+    if (cache == NULL) {
+      //printf("Couldn't use largePages for RandomX cache\n");
+      cache = randomx_alloc_cache(flags);
     }
+    if (cache == NULL)
+      local_abort("Couldn't allocate RandomX cache");
+    pow_mem_record(POW_MEM_RX_CACHE, (size_t)RANDOMX_ARGON_MEMORY * 1024, huge);
+    rx_sp->rs_huge = huge;
   }
   if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_sp->rs_hash, HASH_SIZE)) {
     randomx_init_cache(cache, seedhash, HASH_SIZE);
@@ -247,13 +255,19 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
     if (miners) {
       CTHR_MUTEX_LOCK(rx_dataset_mutex);
       if (rx_dataset == NULL) {
-        rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+        rx_dataset_huge = 0;
+        if (pow_mem_large_pages_enabled()) {
+          rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+          rx_dataset_huge = rx_dataset != NULL;
+        }
         if (rx_dataset == NULL) {
           //printf("Couldn't use largePages for RandomX dataset\n");
           rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
         }
-        if (rx_dataset != NULL)
+        if (rx_dataset != NULL) {
+          pow_mem_record(POW_MEM_RX_DATASET, randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE, rx_dataset_huge);
           rx_initdata(rx_sp->rs_cache, miners, seedheight);
+        }
       }
       if (rx_dataset != NULL)
         flags |= RANDOMX_FLAG_FULL_MEM;
@@ -263,7 +277,8 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
       }
       CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
     }
-    rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
+    if (pow_mem_large_pages_enabled())
+      rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
     if(rx_vm == NULL) { //large pages failed
       //printf("Couldn't use largePages for RandomX VM\n");
       rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
@@ -308,6 +323,24 @@ void rx_stop_mining(void) {
     randomx_dataset *rd = rx_dataset;
     rx_dataset = NULL;
     randomx_release_dataset(rd);
+    pow_mem_release(POW_MEM_RX_DATASET, randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE, rx_dataset_huge);
   }
   CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
 }
+
+void rx_release_caches(void) {
+  int i;
+  rx_stop_mining();
+  CTHR_MUTEX_LOCK(rx_mutex);
+  for (i=0; i<2; i++) {
+    CTHR_MUTEX_LOCK(rx_s[i].rs_mutex);
+    if (rx_s[i].rs_cache != NULL) {
+      randomx_release_cache(rx_s[i].rs_cache);
+      pow_mem_release(POW_MEM_RX_CACHE, (size_t)RANDOMX_ARGON_MEMORY * 1024, rx_s[i].rs_huge);
+      rx_s[i].rs_cache = NULL;
+      rx_s[i].rs_height = 1;	/* set to an invalid seed height */
+    }
+    CTHR_MUTEX_UNLOCK(rx_s[i].rs_mutex);
+  }
+  CTHR_MUTEX_UNLOCK(rx_mutex);
+}
@@ -41,6 +41,7 @@
 #include "variant2_int_sqrt.h"
 #include "variant4_random_math.h"
 #include "CryptonightR_JIT.h"
+#include "pow-memory.h"
 
 #include <errno.h>
 #include <string.h>
@@ -457,7 +458,7 @@ union cn_slow_hash_state
 #pragma pack(pop)
 
 THREADV uint8_t *hp_state = NULL;
-THREADV int hp_allocated = 0;
+THREADV enum pow_mem_page_type hp_page_type = POW_MEM_PAGES_HEAP;
 THREADV v4_random_math_JIT_func hp_jitfunc = NULL;
 THREADV uint8_t *hp_jitfunc_memory = NULL;
 THREADV int hp_jitfunc_allocated = 0;
@@ -750,26 +751,8 @@ void cn_slow_hash_allocate_state(void)
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
     SetLockPagesPrivilege(GetCurrentProcess(), TRUE);
-    hp_state = (uint8_t *) VirtualAlloc(hp_state, MEMORY, MEM_LARGE_PAGES |
-                                        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-#else
-#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
-  defined(__DragonFly__) || defined(__NetBSD__)
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANON, 0, 0);
-#else
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
-#endif
-    if(hp_state == MAP_FAILED)
-        hp_state = NULL;
 #endif
-    hp_allocated = 1;
-    if(hp_state == NULL)
-    {
-        hp_allocated = 0;
-        hp_state = (uint8_t *) malloc(MEMORY);
-    }
+    hp_state = (uint8_t *) pow_mem_acquire_scratchpad(MEMORY, &hp_page_type);
 
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
@@ -808,16 +791,7 @@ void cn_slow_hash_free_state(void)
     if(hp_state == NULL)
         return;
 
-    if(!hp_allocated)
-        free(hp_state);
-    else
-    {
-#if defined(_MSC_VER) || defined(__MINGW32__)
-        VirtualFree(hp_state, 0, MEM_RELEASE);
-#else
-        munmap(hp_state, MEMORY);
-#endif
-    }
+    pow_mem_release_scratchpad(hp_state, MEMORY, hp_page_type);
 
     if(!hp_jitfunc_allocated)
         free(hp_jitfunc_memory);
@@ -831,7 +805,6 @@ void cn_slow_hash_free_state(void)
     }
 
     hp_state = NULL;
-    hp_allocated = 0;
     hp_jitfunc = NULL;
     hp_jitfunc_memory = NULL;
     hp_jitfunc_allocated = 0;
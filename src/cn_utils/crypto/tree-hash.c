@@ -97,14 +97,20 @@ void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash) {
 
     memcpy(ints, hashes, (2 * cnt - count) * HASH_SIZE);
 
-    for (i = 2 * cnt - count, j = 2 * cnt - count; j < cnt; i += 2, ++j) {
+    for (i = 2 * cnt - count, j = 2 * cnt - count; j + 4 <= cnt; i += 8, j += 4) {
+      cn_fast_hash_x4(hashes[i], 64, ints[j]);
+    }
+    for (; j < cnt; i += 2, ++j) {
       cn_fast_hash(hashes[i], 64, ints[j]);
     }
     assert(i == count);
 
     while (cnt > 2) {
       cnt >>= 1;
-      for (i = 0, j = 0; j < cnt; i += 2, ++j) {
+      for (i = 0, j = 0; j + 4 <= cnt; i += 8, j += 4) {
+        cn_fast_hash_x4(ints[i], 64, ints[j]);
+      }
+      for (; j < cnt; i += 2, ++j) {
         cn_fast_hash(ints[i], 64, ints[j]);
       }
     }
@@ -5,16 +5,24 @@
 #include <coins.h>
 
 #include <consensus/consensus.h>
+#include <script/keva.h>
 #include <random.h>
+#include <streams.h>
+#include <version.h>
+
+bool fCoinStatsIndex = DEFAULT_COINSTATSINDEX;
 
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
 bool CCoinsView::GetNamespace(const valtype &nameSpace, CKevaData &data) const { return false; }
 bool CCoinsView::GetName(const valtype &nameSpace, const valtype &key, CKevaData &data) const { return false; }
+bool CCoinsView::GetNameHistory(const valtype &nameSpace, const valtype &key, CNameHistory &data) const { return false; }
+bool CCoinsView::GetKevaSetInfo(CKevaSetInfo &info) const { return false; }
 bool CCoinsView::GetNamesForHeight(unsigned nHeight, std::set<valtype>& names) const { return false; }
 CKevaIterator* CCoinsView::IterateKeys(const valtype& nameSpace) const { assert (false); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names) { return false; }
+bool CCoinsView::GetCoinsSetStats(CCoinsSetStats &stats) const { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names, const CCoinsSetStats &stats) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 bool CCoinsView::ValidateKevaDB() const {
     // TODO: return false, and implement it in txdb.cpp.
@@ -39,18 +47,69 @@ bool CCoinsViewBacked::GetNamespace(const valtype &nameSpace, CKevaData &data) c
 bool CCoinsViewBacked::GetName(const valtype &nameSpace, const valtype &key, CKevaData &data) const {
     return base->GetName(nameSpace, key, data);
 }
+bool CCoinsViewBacked::GetNameHistory(const valtype &nameSpace, const valtype &key, CNameHistory &data) const {
+    return base->GetNameHistory(nameSpace, key, data);
+}
+bool CCoinsViewBacked::GetKevaSetInfo(CKevaSetInfo &info) const { return base->GetKevaSetInfo(info); }
 bool CCoinsViewBacked::GetNamesForHeight(unsigned nHeight, std::set<valtype>& names) const {
     return base->GetNamesForHeight(nHeight, names);
 }
 CKevaIterator* CCoinsViewBacked::IterateKeys(const valtype& nameSpace) const { return base->IterateKeys(nameSpace); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names) {
-    return base->BatchWrite(mapCoins, hashBlock, names);
+bool CCoinsViewBacked::GetCoinsSetStats(CCoinsSetStats &stats) const { return base->GetCoinsSetStats(stats); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names, const CCoinsSetStats &stats) {
+    return base->BatchWrite(mapCoins, hashBlock, names, stats);
 }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 bool CCoinsViewBacked::ValidateKevaDB() const { return base->ValidateKevaDB(); }
 
+static CDataStream SerializeCoin(const COutPoint &outpoint, const Coin &coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint << coin;
+    return ss;
+}
+
+static int64_t GetBogoSize(const Coin &coin)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + coin.out.scriptPubKey.size() /* scriptPubKey */;
+}
+
+void CCoinsSetStats::AddCoin(const COutPoint &outpoint, const Coin &coin)
+{
+    const CDataStream ss = SerializeCoin(outpoint, coin);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+    nTransactionOutputs++;
+    nBogoSize += GetBogoSize(coin);
+    nTotalAmount += coin.out.nValue;
+}
+
+void CCoinsSetStats::RemoveCoin(const COutPoint &outpoint, const Coin &coin)
+{
+    const CDataStream ss = SerializeCoin(outpoint, coin);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+    nTransactionOutputs--;
+    nBogoSize -= GetBogoSize(coin);
+    nTotalAmount -= coin.out.nValue;
+}
+
+void CCoinsSetStats::Apply(const CCoinsSetStats &changes)
+{
+    muhash *= changes.muhash;
+    nTransactionOutputs += changes.nTransactionOutputs;
+    nBogoSize += changes.nBogoSize;
+    nTotalAmount += changes.nTotalAmount;
+}
+
+uint256 CCoinsSetStats::GetHash() const
+{
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
@@ -94,6 +153,16 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     bool fresh = false;
     if (!inserted) {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+        if (!it->second.coin.IsSpent()) {
+            RemoveFromStats(outpoint, it->second.coin);
+        }
+    } else if (possible_overwrite && fCoinStatsIndex) {
+        // The overwritten coin may only exist in the base view.  This is
+        // rare (coinbase outputs), so look it up to keep the statistics exact.
+        Coin old;
+        if (base->GetCoin(outpoint, old) && !old.IsSpent()) {
+            RemoveFromStats(outpoint, old);
+        }
     }
     if (!possible_overwrite) {
         if (!it->second.coin.IsSpent()) {
@@ -101,6 +170,7 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
         }
         fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
     }
+    AddToStats(outpoint, coin);
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
@@ -121,6 +191,9 @@ bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
     CCoinsMap::iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end()) return false;
     cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+    if (!it->second.coin.IsSpent()) {
+        RemoveFromStats(outpoint, it->second.coin);
+    }
     if (moveout) {
         *moveout = std::move(it->second.coin);
     }
@@ -133,6 +206,24 @@ bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
     return true;
 }
 
+void CCoinsViewCache::AddToStats(const COutPoint &outpoint, const Coin &coin) {
+    if (fCoinStatsIndex) {
+        cacheStats.AddCoin(outpoint, coin);
+    }
+    if (CKevaScript::isKevaScript(coin.out.scriptPubKey)) {
+        cacheNames.getSetInfo().addCoin(outpoint, coin.out, coin.nHeight);
+    }
+}
+
+void CCoinsViewCache::RemoveFromStats(const COutPoint &outpoint, const Coin &coin) {
+    if (fCoinStatsIndex) {
+        cacheStats.RemoveCoin(outpoint, coin);
+    }
+    if (CKevaScript::isKevaScript(coin.out.scriptPubKey)) {
+        cacheNames.getSetInfo().removeCoin(outpoint, coin.out, coin.nHeight);
+    }
+}
+
 static const Coin coinEmpty;
 
 const Coin& CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
@@ -183,6 +274,29 @@ bool CCoinsViewCache::GetName(const valtype &nameSpace, const valtype &key, CKev
     return base->GetName(nameSpace, key, data);
 }
 
+bool CCoinsViewCache::GetNameHistory(const valtype &nameSpace, const valtype &key, CNameHistory &data) const {
+    if (cacheNames.getHistory(nameSpace, key, data))
+        return true;
+
+    /* Note: This does not attempt to cache the base result, as with the
+       name data itself.  The history is only read on updates.  */
+    return base->GetNameHistory(nameSpace, key, data);
+}
+
+bool CCoinsViewCache::GetKevaSetInfo(CKevaSetInfo &info) const {
+    if (!base->GetKevaSetInfo(info))
+        return false;
+    info.apply(cacheNames.getSetInfo());
+    return true;
+}
+
+bool CCoinsViewCache::GetCoinsSetStats(CCoinsSetStats &stats) const {
+    if (!base->GetCoinsSetStats(stats))
+        return false;
+    stats.Apply(cacheStats);
+    return true;
+}
+
 bool CCoinsViewCache::GetNamesForHeight(unsigned nHeight, std::set<valtype>& names) const {
     /* Query the base view first, and then apply the cached changes (if
        there are any).  */
@@ -209,18 +323,53 @@ void CCoinsViewCache::SetName(const valtype &nameSpace, const valtype &key, cons
         namespaceData.setUpdateOutpoint(data.getUpdateOutpoint());
         cacheNames.setNamespace(nameSpace, namespaceData);
     }
+
+    CKevaData oldData;
+    const bool fHaveOld = GetName(nameSpace, key, oldData);
+    if (fHaveOld) {
+        cacheNames.getSetInfo().removeKey(nameSpace, key, oldData);
+    }
+    cacheNames.getSetInfo().addKey(nameSpace, key, data);
+
+    /* When undoing, the value restored now is the one on top of the
+       history stack.  Otherwise, an overwritten value is pushed onto it.  A
+       newly created key has no history (just the initial value).  */
+    if (fNameHistory) {
+        CNameHistory history;
+        if (undo) {
+            GetNameHistory(nameSpace, key, history);
+            history.pop(data);
+            cacheNames.setHistory(nameSpace, key, history);
+        } else if (fHaveOld) {
+            GetNameHistory(nameSpace, key, history);
+            history.push(oldData);
+            cacheNames.setHistory(nameSpace, key, history);
+        }
+    }
+
     cacheNames.set(nameSpace, key, data);
 }
 
-void CCoinsViewCache::DeleteName(const valtype &nameSpace, const valtype &key) {
+void CCoinsViewCache::DeleteName(const valtype &nameSpace, const valtype &key, bool undo) {
     CKevaData oldData;
     if (!GetName(nameSpace, key, oldData)) {
         assert(false);
     }
+    cacheNames.getSetInfo().removeKey(nameSpace, key, oldData);
+
+    /* Undoing a key's creation leaves its history alone, while deleting
+       the key keeps its last value in the history.  */
+    if (fNameHistory && !undo) {
+        CNameHistory history;
+        GetNameHistory(nameSpace, key, history);
+        history.push(oldData);
+        cacheNames.setHistory(nameSpace, key, history);
+    }
+
     cacheNames.remove(nameSpace, key);
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, const CKevaCache &names) {
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, const CKevaCache &names, const CCoinsSetStats &stats) {
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
         // Ignore non-dirty entries (optimization).
         if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
@@ -276,6 +425,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
     }
     hashBlock = hashBlockIn;
     cacheNames.apply(names);
+    cacheStats.Apply(stats);
     return true;
 }
 
@@ -286,10 +436,11 @@ bool CCoinsViewCache::Flush() {
     if (hashBlock.IsNull() && cacheCoins.empty() && cacheNames.empty())
         return true;
 
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock, cacheNames);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, cacheNames, cacheStats);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
     cacheNames.clear();
+    cacheStats = CCoinsSetStats();
     return fOk;
 }
 
@@ -9,6 +9,7 @@
 #include <primitives/transaction.h>
 #include <compressor.h>
 #include <core_memusage.h>
+#include <crypto/muhash.h>
 #include <hash.h>
 #include <memusage.h>
 #include <keva/common.h>
@@ -82,6 +83,59 @@ public:
     }
 };
 
+/** Default for -coinstatsindex.  */
+static const bool DEFAULT_COINSTATSINDEX = false;
+
+/** Whether the UTXO set statistics below are maintained.  */
+extern bool fCoinStatsIndex;
+
+/**
+ * Statistics about the unspent transaction output set, kept up to date as
+ * coins are added and spent: the number of outputs, their "bogosize" and
+ * total amount, and a rolling hash (MuHash) over all coins that does not
+ * depend on the order of updates.  A cache holds the changes since its last
+ * flush (the numbers may be negative there), while CCoinsViewDB stores the
+ * totals together with its best block.  Only maintained with -coinstatsindex.
+ */
+class CCoinsSetStats
+{
+private:
+    MuHash3072 muhash;
+
+public:
+    int64_t nTransactionOutputs;
+    int64_t nBogoSize;
+    CAmount nTotalAmount;
+
+    CCoinsSetStats() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        unsigned char buf[MuHash3072::SERIALIZED_SIZE];
+        muhash.ToBytes(buf);
+        s << nTransactionOutputs << nBogoSize << nTotalAmount;
+        s.write((const char*)buf, sizeof(buf));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned char buf[MuHash3072::SERIALIZED_SIZE];
+        s >> nTransactionOutputs >> nBogoSize >> nTotalAmount;
+        s.read((char*)buf, sizeof(buf));
+        if (!muhash.FromBytes(buf))
+            throw std::ios_base::failure("invalid UTXO set hash");
+    }
+
+    void AddCoin(const COutPoint &outpoint, const Coin &coin);
+    void RemoveCoin(const COutPoint &outpoint, const Coin &coin);
+
+    //! Apply the changes recorded in another instance on top of this one.
+    void Apply(const CCoinsSetStats &changes);
+
+    //! Compute the hash of the set of coins.
+    uint256 GetHash() const;
+};
+
 class SaltedOutpointHasher
 {
 private:
@@ -170,6 +224,15 @@ public:
     // Get a name (if it exists)
     virtual bool GetName(const valtype& nameSpace, const valtype& key, CKevaData& data) const;
 
+    // Get the previous values of a key (only with -kevahistory)
+    virtual bool GetNameHistory(const valtype& nameSpace, const valtype& key, CNameHistory& data) const;
+
+    // Get the keva set summary (counts and commitment)
+    virtual bool GetKevaSetInfo(CKevaSetInfo& info) const;
+
+    //! Get the statistics about the whole UTXO set
+    virtual bool GetCoinsSetStats(CCoinsSetStats &stats) const;
+
     // Query for names that were updated at the given height
     virtual bool GetNamesForHeight(unsigned nHeight, std::set<valtype>& names) const;
 
@@ -177,8 +240,9 @@ public:
     virtual CKevaIterator* IterateKeys(const valtype& nameSpace) const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names);
+    //! The passed mapCoins can be modified.  stats holds the changes to the
+    //! UTXO set statistics that come with them.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names, const CCoinsSetStats &stats);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -208,10 +272,13 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     bool GetNamespace(const valtype& nameSpace, CKevaData& data) const override;
     bool GetName(const valtype& nameSpace, const valtype& key, CKevaData& data) const override;
+    bool GetNameHistory(const valtype& nameSpace, const valtype& key, CNameHistory& data) const override;
+    bool GetKevaSetInfo(CKevaSetInfo& info) const override;
+    bool GetCoinsSetStats(CCoinsSetStats &stats) const override;
     bool GetNamesForHeight(unsigned nHeight, std::set<valtype>& names) const override;
     CKevaIterator* IterateKeys(const valtype& nameSpace) const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names, const CCoinsSetStats &stats) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
     bool ValidateKevaDB() const override;
@@ -235,6 +302,9 @@ protected:
     /** Name changes cache.  */
     CKevaCache cacheNames;
 
+    /* Changes to the UTXO set statistics. */
+    CCoinsSetStats cacheStats;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -250,16 +320,21 @@ public:
     void SetBestBlock(const uint256 &hashBlock);
     bool GetNamespace(const valtype &nameSpace, CKevaData& data) const override;
     bool GetName(const valtype &nameSpace, const valtype &key, CKevaData& data) const override;
+    bool GetNameHistory(const valtype &nameSpace, const valtype &key, CNameHistory& data) const override;
+    bool GetKevaSetInfo(CKevaSetInfo& info) const override;
+    bool GetCoinsSetStats(CCoinsSetStats &stats) const override;
     bool GetNamesForHeight(unsigned nHeight, std::set<valtype>& names) const override;
     CKevaIterator* IterateKeys(const valtype& nameSpace) const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names, const CCoinsSetStats &stats) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
 
-    /* Changes to the name database.  */
+    /* Changes to the name database.  With -kevahistory, overwritten and
+       deleted values are pushed onto the key's history, and popped again
+       when undo is set.  */
     void SetName(const valtype &nameSpace, const valtype &key, const CKevaData &data, bool undo);
-    void DeleteName(const valtype &nameSpace, const valtype &key);
+    void DeleteName(const valtype &nameSpace, const valtype &key, bool undo);
 
     /**
      * Check if we have the given utxo already loaded in this cache.
@@ -327,6 +402,10 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    //! Account for a coin entering or leaving the UTXO set in the statistics.
+    void AddToStats(const COutPoint &outpoint, const Coin &coin);
+    void RemoveFromStats(const COutPoint &outpoint, const Coin &coin);
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
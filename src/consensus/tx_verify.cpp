@@ -206,7 +206,7 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
     return true;
 }
 
-bool Consensus::CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, unsigned flags, CAmount& txfee)
+bool Consensus::CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, unsigned flags, CAmount& txfee, bool fCheckKeva)
 {
     // are the actual inputs available?
     if (!inputs.HaveInputs(tx)) {
@@ -214,7 +214,7 @@ bool Consensus::CheckTxInputs(const CTransaction& tx, CValidationState& state, c
                          strprintf("%s: inputs missing/spent", __func__));
     }
 
-    if (!CheckKevaTransaction (tx, nSpendHeight, inputs, state, flags)) {
+    if (fCheckKeva && !CheckKevaTransaction (tx, nSpendHeight, inputs, state, flags)) {
         return state.Invalid(false, 0, "", "Tx invalid for Kevacoin");
     }
 
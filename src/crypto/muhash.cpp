@@ -0,0 +1,214 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/sha256.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <openssl/bn.h>
+
+namespace {
+
+/** Serialize a number below the modulus, little endian. */
+void BignumToBytes(const BIGNUM* bn, unsigned char out[MuHash3072::NUM_BYTES])
+{
+    memset(out, 0, MuHash3072::NUM_BYTES);
+    int len = BN_num_bytes(bn);
+    assert(len >= 0 && (size_t)len <= MuHash3072::NUM_BYTES);
+    BN_bn2bin(bn, out);
+    std::reverse(out, out + len);
+}
+
+BIGNUM* BignumFromBytes(const unsigned char in[MuHash3072::NUM_BYTES])
+{
+    unsigned char tmp[MuHash3072::NUM_BYTES];
+    std::reverse_copy(in, in + MuHash3072::NUM_BYTES, tmp);
+    BIGNUM* bn = BN_bin2bn(tmp, sizeof(tmp), nullptr);
+    assert(bn);
+    return bn;
+}
+
+/** The prime 2^3072 - 1103717. */
+const BIGNUM* Modulus()
+{
+    static const BIGNUM* modulus = [] {
+        BIGNUM* p = BN_new();
+        BIGNUM* c = BN_new();
+        assert(p && c);
+        BN_set_bit(p, 3072);
+        BN_set_word(c, 1103717);
+        BN_sub(p, p, c);
+        BN_free(c);
+        return p;
+    }();
+    return modulus;
+}
+
+struct BignumCtx {
+    BN_CTX* ctx;
+    BignumCtx() : ctx(BN_CTX_new()) { assert(ctx); }
+    ~BignumCtx() { BN_CTX_free(ctx); }
+};
+
+/** Montgomery multiplication context for the modulus, with R = 2^3072. */
+const BN_MONT_CTX* Montgomery()
+{
+    static const BN_MONT_CTX* mont = [] {
+        BignumCtx bctx;
+        BN_MONT_CTX* m = BN_MONT_CTX_new();
+        assert(m);
+        int ret = BN_MONT_CTX_set(m, Modulus(), bctx.ctx);
+        assert(ret);
+        return m;
+    }();
+    return mont;
+}
+
+/** Hash an element to a number modulo the prime. */
+BIGNUM* HashElement(const unsigned char* data, size_t len, BN_CTX* ctx)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    unsigned char bytes[MuHash3072::NUM_BYTES];
+    ChaCha20(key, sizeof(key)).Output(bytes, sizeof(bytes));
+    BIGNUM* bn = BignumFromBytes(bytes);
+    BN_nnmod(bn, bn, Modulus(), ctx);
+    return bn;
+}
+
+/** a = a * b / R modulo the prime. */
+void MulMont(BIGNUM* a, const BIGNUM* b, BN_CTX* ctx)
+{
+    int ret = BN_mod_mul_montgomery(a, a, b, const_cast<BN_MONT_CTX*>(Montgomery()), ctx);
+    assert(ret);
+}
+
+void ToMont(BIGNUM* a, BN_CTX* ctx)
+{
+    int ret = BN_to_montgomery(a, a, const_cast<BN_MONT_CTX*>(Montgomery()), ctx);
+    assert(ret);
+}
+
+void FromMont(BIGNUM* a, BN_CTX* ctx)
+{
+    int ret = BN_from_montgomery(a, a, const_cast<BN_MONT_CTX*>(Montgomery()), ctx);
+    assert(ret);
+}
+
+} // namespace
+
+void MuHash3072::BignumDeleter::operator()(BIGNUM* bn) const
+{
+    BN_free(bn);
+}
+
+MuHash3072::MuHash3072() : numerator(BN_new()), denominator(BN_new())
+{
+    assert(numerator && denominator);
+    BignumCtx bctx;
+    BN_one(numerator.get());
+    BN_one(denominator.get());
+    ToMont(numerator.get(), bctx.ctx);
+    ToMont(denominator.get(), bctx.ctx);
+}
+
+MuHash3072::MuHash3072(const MuHash3072& other) : numerator(BN_dup(other.numerator.get())), denominator(BN_dup(other.denominator.get()))
+{
+    assert(numerator && denominator);
+}
+
+MuHash3072& MuHash3072::operator=(const MuHash3072& other)
+{
+    if (this != &other) {
+        BN_copy(numerator.get(), other.numerator.get());
+        BN_copy(denominator.get(), other.denominator.get());
+    }
+    return *this;
+}
+
+MuHash3072::~MuHash3072() {}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    BignumCtx bctx;
+    Bignum element(HashElement(data, len, bctx.ctx));
+    MulMont(numerator.get(), element.get(), bctx.ctx);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    BignumCtx bctx;
+    Bignum element(HashElement(data, len, bctx.ctx));
+    MulMont(denominator.get(), element.get(), bctx.ctx);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& other)
+{
+    BignumCtx bctx;
+    MulMont(numerator.get(), other.numerator.get(), bctx.ctx);
+    MulMont(denominator.get(), other.denominator.get(), bctx.ctx);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& other)
+{
+    BignumCtx bctx;
+    MulMont(numerator.get(), other.denominator.get(), bctx.ctx);
+    MulMont(denominator.get(), other.numerator.get(), bctx.ctx);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char out[OUTPUT_SIZE]) const
+{
+    BignumCtx bctx;
+    Bignum num(BN_dup(numerator.get()));
+    Bignum den(BN_dup(denominator.get()));
+    assert(num && den);
+    FromMont(num.get(), bctx.ctx);
+    FromMont(den.get(), bctx.ctx);
+    Bignum result(BN_mod_inverse(nullptr, den.get(), Modulus(), bctx.ctx));
+    assert(result);
+    int ret = BN_mod_mul(result.get(), result.get(), num.get(), Modulus(), bctx.ctx);
+    assert(ret);
+
+    unsigned char bytes[NUM_BYTES];
+    BignumToBytes(result.get(), bytes);
+    CSHA256().Write(bytes, sizeof(bytes)).Finalize(out);
+}
+
+void MuHash3072::ToBytes(unsigned char out[SERIALIZED_SIZE]) const
+{
+    BignumCtx bctx;
+    Bignum num(BN_dup(numerator.get()));
+    Bignum den(BN_dup(denominator.get()));
+    assert(num && den);
+    FromMont(num.get(), bctx.ctx);
+    FromMont(den.get(), bctx.ctx);
+    BignumToBytes(num.get(), out);
+    BignumToBytes(den.get(), out + NUM_BYTES);
+}
+
+bool MuHash3072::FromBytes(const unsigned char in[SERIALIZED_SIZE])
+{
+    Bignum num(BignumFromBytes(in));
+    Bignum den(BignumFromBytes(in + NUM_BYTES));
+    if (BN_cmp(num.get(), Modulus()) >= 0 || BN_cmp(den.get(), Modulus()) >= 0 || BN_is_zero(num.get()) || BN_is_zero(den.get())) {
+        return false;
+    }
+    BignumCtx bctx;
+    ToMont(num.get(), bctx.ctx);
+    ToMont(den.get(), bctx.ctx);
+    numerator = std::move(num);
+    denominator = std::move(den);
+    return true;
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <memory>
+
+typedef struct bignum_st BIGNUM;
+
+/** A rolling hash of a multiset (MuHash3072).
+ *
+ * Each element is hashed to a number modulo the prime 2^3072 - 1103717, and
+ * the set hash is the product of those numbers. The result does not depend
+ * on the order in which elements were added, and an element is removed by
+ * dividing it out again. Divisions are deferred by keeping a numerator and a
+ * denominator, so only Finalize() computes a modular inverse.
+ *
+ * The numerator and denominator are kept in Montgomery form, and the hash h
+ * of an element stands for the number h / 2^3072, so that every update is a
+ * single Montgomery multiplication.
+ */
+class MuHash3072
+{
+private:
+    struct BignumDeleter {
+        void operator()(BIGNUM* bn) const;
+    };
+    typedef std::unique_ptr<BIGNUM, BignumDeleter> Bignum;
+
+    Bignum numerator;
+    Bignum denominator;
+
+public:
+    /** Size of a serialized number, in bytes. */
+    static const size_t NUM_BYTES = 384;
+    /** Size of the serialized state, in bytes. */
+    static const size_t SERIALIZED_SIZE = 2 * NUM_BYTES;
+    static const size_t OUTPUT_SIZE = 32;
+
+    /** Construct the hash of the empty set. */
+    MuHash3072();
+    MuHash3072(const MuHash3072& other);
+    MuHash3072& operator=(const MuHash3072& other);
+    ~MuHash3072();
+
+    /** Add an element to the set. */
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    /** Remove an element from the set. It need not have been added before. */
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /** Add all elements of another set. */
+    MuHash3072& operator*=(const MuHash3072& other);
+    /** Remove all elements of another set. */
+    MuHash3072& operator/=(const MuHash3072& other);
+
+    /** Compute the 32-byte hash of the set. */
+    void Finalize(unsigned char out[OUTPUT_SIZE]) const;
+
+    /** Write the numerator and denominator, little endian. */
+    void ToBytes(unsigned char out[SERIALIZED_SIZE]) const;
+    /** Restore a state written by ToBytes(). Fails for out-of-range numbers. */
+    bool FromBytes(const unsigned char in[SERIALIZED_SIZE]);
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATSET_H
+#define BITCOIN_FLATSET_H
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/* Set stored as a sorted vector.
+ *
+ * Offers the subset of the std::set interface needed for small sets that are
+ * mostly iterated: one contiguous allocation instead of a tree node per
+ * element, at the cost of O(n) insertion and removal. Iterators are
+ * invalidated by insert() and erase().
+ */
+template <class K, class Compare = std::less<K> >
+class flatset {
+private:
+    typedef std::vector<K> base;
+    base v;
+    Compare comp;
+
+public:
+    typedef typename base::const_iterator iterator;
+    typedef typename base::const_iterator const_iterator;
+    typedef typename base::size_type size_type;
+    typedef K value_type;
+
+    flatset() {}
+    template <class InputIt>
+    flatset(InputIt first, InputIt last) : v(first, last)
+    {
+        std::sort(v.begin(), v.end(), comp);
+        v.erase(std::unique(v.begin(), v.end(), [this](const K& a, const K& b) { return !comp(a, b) && !comp(b, a); }), v.end());
+    }
+
+    const_iterator find(const K& key) const
+    {
+        const_iterator it = std::lower_bound(v.begin(), v.end(), key, comp);
+        return (it != v.end() && !comp(key, *it)) ? it : v.end();
+    }
+    size_type count(const K& key) const { return find(key) != v.end(); }
+
+    std::pair<iterator, bool> insert(const K& key)
+    {
+        typename base::iterator it = std::lower_bound(v.begin(), v.end(), key, comp);
+        if (it != v.end() && !comp(key, *it))
+            return std::make_pair(iterator(it), false);
+        return std::make_pair(iterator(v.insert(it, key)), true);
+    }
+
+    size_type erase(const K& key)
+    {
+        typename base::iterator it = std::lower_bound(v.begin(), v.end(), key, comp);
+        if (it == v.end() || comp(key, *it))
+            return 0;
+        v.erase(it);
+        // Give memory back once the set has mostly drained
+        if (v.size() * 2 < v.capacity())
+            v.shrink_to_fit();
+        return 1;
+    }
+
+    bool empty() const              { return v.empty(); }
+    size_type size() const          { return v.size(); }
+    size_type capacity() const      { return v.capacity(); }
+    void clear()                    { base().swap(v); }
+    const_iterator begin() const    { return v.begin(); }
+    const_iterator end() const      { return v.end(); }
+
+    friend bool operator==(const flatset& a, const flatset& b) { return a.v == b.v; }
+    friend bool operator!=(const flatset& a, const flatset& b) { return a.v != b.v; }
+};
+
+#endif // BITCOIN_FLATSET_H
@@ -9,7 +9,10 @@
 #include <keva/common.h>
 
 #include <script/keva.h>
+#include <streams.h>
+#include <version.h>
 
+bool fNameHistory = false;
 
 /* ************************************************************************** */
 /* CKevaData.  */
@@ -32,6 +35,85 @@ CKevaData::fromScript (unsigned h, const COutPoint& out,
   addr = script.getAddress();
 }
 
+/* ************************************************************************** */
+/* CKevaSetInfo.  */
+
+namespace
+{
+
+/* Prefixes that keep keva entries and coins apart in the set hash.  */
+const char KEVA_SET_ENTRY = 'n';
+const char KEVA_SET_COIN = 'c';
+
+CDataStream
+KeyElement (const valtype& nameSpace, const valtype& key, const CKevaData& data)
+{
+  CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+  ss << KEVA_SET_ENTRY << nameSpace << key << data.getValue () << data.getHeight ();
+  return ss;
+}
+
+CDataStream
+CoinElement (const COutPoint& outpoint, const CTxOut& out, unsigned nHeight)
+{
+  CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+  ss << KEVA_SET_COIN << outpoint << out << nHeight;
+  return ss;
+}
+
+} // anonymous namespace
+
+void
+CKevaSetInfo::addKey (const valtype& nameSpace, const valtype& key, const CKevaData& data)
+{
+  const CDataStream ss = KeyElement (nameSpace, key, data);
+  hash.Insert ((const unsigned char*)ss.data (), ss.size ());
+  ++nKeys;
+  nValueBytes += data.getValue ().size ();
+}
+
+void
+CKevaSetInfo::removeKey (const valtype& nameSpace, const valtype& key, const CKevaData& data)
+{
+  const CDataStream ss = KeyElement (nameSpace, key, data);
+  hash.Remove ((const unsigned char*)ss.data (), ss.size ());
+  --nKeys;
+  nValueBytes -= data.getValue ().size ();
+}
+
+void
+CKevaSetInfo::addCoin (const COutPoint& outpoint, const CTxOut& out, unsigned nHeight)
+{
+  const CDataStream ss = CoinElement (outpoint, out, nHeight);
+  hash.Insert ((const unsigned char*)ss.data (), ss.size ());
+  ++nCoins;
+}
+
+void
+CKevaSetInfo::removeCoin (const COutPoint& outpoint, const CTxOut& out, unsigned nHeight)
+{
+  const CDataStream ss = CoinElement (outpoint, out, nHeight);
+  hash.Remove ((const unsigned char*)ss.data (), ss.size ());
+  --nCoins;
+}
+
+void
+CKevaSetInfo::apply (const CKevaSetInfo& changes)
+{
+  hash *= changes.hash;
+  nKeys += changes.nKeys;
+  nValueBytes += changes.nValueBytes;
+  nCoins += changes.nCoins;
+}
+
+uint256
+CKevaSetInfo::getCommitment () const
+{
+  uint256 res;
+  hash.Finalize (res.begin ());
+  return res;
+}
+
 /* ************************************************************************** */
 /* CKevaIterator.  */
 
@@ -233,6 +315,26 @@ CKevaCache::remove(const valtype& nameSpace, const valtype& key)
   deleted.insert(name);
 }
 
+bool
+CKevaCache::getHistory(const valtype& nameSpace, const valtype& key, CNameHistory& res) const
+{
+  assert(fNameHistory);
+
+  const auto i = history.find(std::make_tuple(nameSpace, key));
+  if (i == history.end())
+    return false;
+
+  res = i->second;
+  return true;
+}
+
+void
+CKevaCache::setHistory(const valtype& nameSpace, const valtype& key, const CNameHistory& data)
+{
+  assert(fNameHistory);
+  history[std::make_tuple(nameSpace, key)] = data;
+}
+
 CKevaIterator*
 CKevaCache::iterateKeys(CKevaIterator* base) const
 {
@@ -256,4 +358,10 @@ void CKevaCache::apply(const CKevaCache& cache)
   for (std::set<NamespaceKeyType>::const_iterator i = cache.deleted.begin(); i != cache.deleted.end(); ++i) {
     remove(std::get<0>(*i), std::get<1>(*i));
   }
+
+  for (const auto& entry : cache.history) {
+    history[entry.first] = entry.second;
+  }
+
+  setInfo.apply(cache.setInfo);
 }
@@ -11,6 +11,7 @@
 #define H_BITCOIN_NAMES_COMMON
 
 #include <compat/endian.h>
+#include <crypto/muhash.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
 #include <serialize.h>
@@ -23,6 +24,9 @@ class CDBBatch;
 
 typedef std::vector<unsigned char> valtype;
 
+/** Default for -kevahistory.  */
+static const bool DEFAULT_KEVA_HISTORY = false;
+
 /** Whether or not name history is enabled.  */
 extern bool fNameHistory;
 
@@ -245,6 +249,77 @@ public:
 
 };
 
+/* ************************************************************************** */
+/* CKevaSetInfo.  */
+
+/**
+ * Summary of the keva state:  the number of keys, the total size of their
+ * values and the number of keva coins in the UTXO set, together with a
+ * rolling hash (MuHash) over all (namespace, key, value, height) entries and
+ * all keva coins.  The hash does not depend on the order of updates, so it
+ * can be maintained incrementally.  Instances held by caches record the
+ * changes since the last flush (the counts may be negative there), while
+ * CCoinsViewDB stores the totals.
+ */
+class CKevaSetInfo
+{
+
+private:
+
+  /** Rolling hash of the keva entries and coins.  */
+  MuHash3072 hash;
+
+public:
+
+  /** Number of keys, including the namespace entries.  */
+  int64_t nKeys;
+
+  /** Total size of all values, in bytes.  */
+  int64_t nValueBytes;
+
+  /** Number of unspent keva coins.  */
+  int64_t nCoins;
+
+  CKevaSetInfo ()
+    : nKeys(0), nValueBytes(0), nCoins(0)
+  {}
+
+  template<typename Stream>
+    void Serialize (Stream& s) const
+  {
+    unsigned char buf[MuHash3072::SERIALIZED_SIZE];
+    hash.ToBytes (buf);
+    s << nKeys << nValueBytes << nCoins;
+    s.write ((const char*)buf, sizeof (buf));
+  }
+
+  template<typename Stream>
+    void Unserialize (Stream& s)
+  {
+    unsigned char buf[MuHash3072::SERIALIZED_SIZE];
+    s >> nKeys >> nValueBytes >> nCoins;
+    s.read ((char*)buf, sizeof (buf));
+    if (!hash.FromBytes (buf))
+      throw std::ios_base::failure ("invalid keva set hash");
+  }
+
+  /* Record that a key was set to the given data, or that this data
+     was overwritten or deleted.  */
+  void addKey (const valtype& nameSpace, const valtype& key, const CKevaData& data);
+  void removeKey (const valtype& nameSpace, const valtype& key, const CKevaData& data);
+
+  /* Record that a keva coin was created or spent.  */
+  void addCoin (const COutPoint& outpoint, const CTxOut& out, unsigned nHeight);
+  void removeCoin (const COutPoint& outpoint, const CTxOut& out, unsigned nHeight);
+
+  /* Apply the changes recorded in another instance on top of this one.  */
+  void apply (const CKevaSetInfo& changes);
+
+  /* Compute the commitment to the keva set.  */
+  uint256 getCommitment () const;
+
+};
+
 /* ************************************************************************** */
 /* CKevaIterator.  */
 
@@ -344,6 +419,15 @@ private:
   /** Deleted names.  */
   std::set<NamespaceKeyType> deleted;
 
+  /**
+   * Changed key histories (only used with -kevahistory).  An empty history
+   * means that the entry should be removed from the database.
+   */
+  std::map<NamespaceKeyType, CNameHistory> history;
+
+  /** Changes to the keva set summary.  */
+  CKevaSetInfo setInfo;
+
   friend class CCacheKeyIterator;
 
 public:
@@ -353,6 +437,8 @@ public:
   {
     entries.clear ();
     deleted.clear ();
+    history.clear ();
+    setInfo = CKevaSetInfo ();
   }
 
   /**
@@ -364,7 +450,7 @@ public:
   inline bool
   empty () const
   {
-    if (entries.empty() && deleted.empty()) {
+    if (entries.empty() && deleted.empty() && history.empty()) {
       return true;
     }
 
@@ -394,6 +480,24 @@ public:
   /* Delete a name.  If it is in the "entries" set also, remove it there.  */
   void remove(const valtype& nameSpace, const valtype& key);
 
+  /* Try to get a key's history.  Returns false if it is not cached.  */
+  bool getHistory(const valtype& nameSpace, const valtype& key, CNameHistory& res) const;
+
+  /* Set a key's history.  */
+  void setHistory(const valtype& nameSpace, const valtype& key, const CNameHistory& data);
+
+  /* Access the changes to the keva set summary.  */
+  inline const CKevaSetInfo&
+  getSetInfo () const
+  {
+    return setInfo;
+  }
+  inline CKevaSetInfo&
+  getSetInfo ()
+  {
+    return setInfo;
+  }
+
   /* Return a name iterator that combines a "base" iterator with the changes
      made to it according to the cache.  The base iterator is taken
      ownership of.  */
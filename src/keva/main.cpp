@@ -13,6 +13,7 @@
 #include <coins.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <memusage.h>
 #include <dbwrapper.h>
 #include <script/interpreter.h>
 #include <script/keva.h>
@@ -39,16 +40,72 @@ void
 CKevaTxUndo::apply(CCoinsViewCache& view) const
 {
   if (isNew) {
-    view.DeleteName(nameSpace, key);
+    /* With compacted undo data, a key created and deleted again within
+       the same block is already gone.  */
+    CKevaData data;
+    if (view.GetName(nameSpace, key, data)) {
+      view.DeleteName(nameSpace, key, true);
+    }
   }
   else {
     view.SetName(nameSpace, key, oldData, true);
   }
 }
 
+void
+CompactKevaUndo (std::vector<CKevaTxUndo>& undo)
+{
+  /* Every update pushes onto the key's history, and every undo record
+     pops one entry again.  */
+  if (fNameHistory) {
+    return;
+  }
+
+  std::set<std::pair<valtype, valtype>> seen;
+  auto out = undo.begin ();
+  for (auto& rec : undo) {
+    if (!seen.emplace (rec.getNamespace (), rec.getKey ()).second) {
+      continue;
+    }
+    if (&*out != &rec) {
+      *out = std::move (rec);
+    }
+    ++out;
+  }
+  undo.erase (out, undo.end ());
+}
+
 /* ************************************************************************** */
 /* CKevaMemPool.  */
 
+namespace
+{
+
+size_t
+NamespaceUsage(const std::tuple<uint256, valtype, valtype>& entry)
+{
+  return memusage::DynamicUsage(std::get<1>(entry))
+           + memusage::DynamicUsage(std::get<2>(entry));
+}
+
+size_t
+KeyValueUsage(const std::tuple<uint256, valtype, valtype, valtype>& entry)
+{
+  return memusage::DynamicUsage(std::get<1>(entry))
+           + memusage::DynamicUsage(std::get<2>(entry))
+           + memusage::DynamicUsage(std::get<3>(entry));
+}
+
+/** Allocated size of a std::list node holding T.  */
+template<typename T>
+size_t
+ListNodeUsage()
+{
+  return memusage::MallocUsage(sizeof(T) + 2 * sizeof(void*));
+}
+
+} // anonymous namespace
+
 void
 CKevaMemPool::addUnchecked(const uint256& hash, const CKevaScript& kevaOp)
 {
@@ -56,17 +113,23 @@ CKevaMemPool::addUnchecked(const uint256& hash, const CKevaScript& kevaOp)
   if (kevaOp.isNamespaceRegistration()) {
     const valtype& nameSpace = kevaOp.getOpNamespace();
     listUnconfirmedNamespaces.push_back(std::make_tuple(hash, nameSpace, kevaOp.getOpNamespaceDisplayName()));
+    mapNamespaceTx[hash] = std::prev(listUnconfirmedNamespaces.end());
+    cachedInnerUsage += NamespaceUsage(listUnconfirmedNamespaces.back());
   }
 
   if (kevaOp.getKevaOp() == OP_KEVA_PUT) {
     const valtype& nameSpace = kevaOp.getOpNamespace();
     listUnconfirmedKeyValues.push_back(std::make_tuple(hash, nameSpace, kevaOp.getOpKey(), kevaOp.getOpValue()));
+    mapKeyValueTx[hash] = std::prev(listUnconfirmedKeyValues.end());
+    cachedInnerUsage += KeyValueUsage(listUnconfirmedKeyValues.back());
   }
 
   if (kevaOp.getKevaOp() == OP_KEVA_DELETE) {
     const valtype& nameSpace = kevaOp.getOpNamespace();
     const valtype& empty = ValtypeFromString("");
     listUnconfirmedKeyValues.push_back(std::make_tuple(hash, nameSpace, kevaOp.getOpKey(), empty));
+    mapKeyValueTx[hash] = std::prev(listUnconfirmedKeyValues.end());
+    cachedInnerUsage += KeyValueUsage(listUnconfirmedKeyValues.back());
   }
 }
 
@@ -114,26 +177,54 @@ void CKevaMemPool::remove(const CTxMemPoolEntry& entry)
 {
   AssertLockHeld (pool.cs);
   if (entry.isNamespaceRegistration()) {
-    auto hash = entry.GetTx().GetHash();
-    for (auto iter = listUnconfirmedNamespaces.begin(); iter != listUnconfirmedNamespaces.end(); ++iter) {
-      if (std::get<0>(*iter) == hash) {
-        listUnconfirmedNamespaces.erase(iter);
-        break;
-      }
+    auto mit = mapNamespaceTx.find(entry.GetTx().GetHash());
+    if (mit != mapNamespaceTx.end()) {
+      cachedInnerUsage -= NamespaceUsage(*mit->second);
+      listUnconfirmedNamespaces.erase(mit->second);
+      mapNamespaceTx.erase(mit);
     }
   }
 
   if (entry.isKeyUpdate() || entry.isKeyDelete()) {
-    auto hash = entry.GetTx().GetHash();
-    for (auto iter = listUnconfirmedKeyValues.begin(); iter != listUnconfirmedKeyValues.end(); ++iter) {
-      if (std::get<0>(*iter) == hash) {
-        listUnconfirmedKeyValues.erase(iter);
-        break;
-      }
+    auto mit = mapKeyValueTx.find(entry.GetTx().GetHash());
+    if (mit != mapKeyValueTx.end()) {
+      cachedInnerUsage -= KeyValueUsage(*mit->second);
+      listUnconfirmedKeyValues.erase(mit->second);
+      mapKeyValueTx.erase(mit);
     }
   }
 }
 
+size_t
+CKevaMemPool::DynamicMemoryUsage() const
+{
+  return ListNodeUsage<NamespaceList::value_type>() * listUnconfirmedNamespaces.size()
+           + ListNodeUsage<KeyValueList::value_type>() * listUnconfirmedKeyValues.size()
+           + memusage::DynamicUsage(mapNamespaceTx)
+           + memusage::DynamicUsage(mapKeyValueTx)
+           + cachedInnerUsage;
+}
+
+void
+CKevaMemPool::check() const
+{
+  assert(mapNamespaceTx.size() == listUnconfirmedNamespaces.size());
+  assert(mapKeyValueTx.size() == listUnconfirmedKeyValues.size());
+
+  size_t innerUsage = 0;
+  for (auto iter = listUnconfirmedNamespaces.begin(); iter != listUnconfirmedNamespaces.end(); ++iter) {
+    auto mit = mapNamespaceTx.find(std::get<0>(*iter));
+    assert(mit != mapNamespaceTx.end() && mit->second == iter);
+    innerUsage += NamespaceUsage(*iter);
+  }
+  for (auto iter = listUnconfirmedKeyValues.begin(); iter != listUnconfirmedKeyValues.end(); ++iter) {
+    auto mit = mapKeyValueTx.find(std::get<0>(*iter));
+    assert(mit != mapKeyValueTx.end() && mit->second == iter);
+    innerUsage += KeyValueUsage(*iter);
+  }
+  assert(innerUsage == cachedInnerUsage);
+}
+
 void
 CKevaMemPool::removeConflicts(const CTransaction& tx)
 {
@@ -159,10 +250,8 @@ CKevaMemPool::checkTx(const CTransaction& tx) const
     return true;
   }
 
-  for (const auto& txout : tx.vout) {
-    const CKevaScript nameOp(txout.scriptPubKey);
-    if (!nameOp.isKevaOp())
-      continue;
+  for (const auto& txop : tx.GetKevaOps()) {
+    const CKevaScript& nameOp = txop.second;
     switch (nameOp.getKevaOp()) {
       case OP_KEVA_NAMESPACE:
       {
@@ -230,80 +319,83 @@ CNameConflictTracker::AddConflictedEntry (CTransactionRef txRemoved)
 
 /* ************************************************************************** */
 
-CKevaNotifier::CKevaNotifier(CMainSignals* signals) {
-  this->signals = signals;
-}
+CKevaNotifier::CKevaNotifier(CMainSignals* signals)
+  : signals(signals && signals->HasKevaListeners() ? signals : nullptr)
+{}
 
-void CKevaNotifier::KevaNamespaceCreated(const CTransaction& tx, const CBlockIndex &pindex, const std::string& nameSpace) {
+void CKevaNotifier::KevaNamespaceCreated(const CTransactionRef& ptx, const CBlockIndex &pindex, const valtype& nameSpace) {
   if (signals) {
-    CTransactionRef ptx = MakeTransactionRef(tx);
     signals->KevaNamespaceCreated(ptx, pindex, nameSpace);
   }
 }
 
-void CKevaNotifier::KevaUpdated(const CTransaction& tx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key, const std::string& value) {
+void CKevaNotifier::KevaUpdated(const CTransactionRef& ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key, const valtype& value) {
   if (signals) {
-    CTransactionRef ptx = MakeTransactionRef(tx);
     signals->KevaUpdated(ptx, pindex, nameSpace, key, value);
   }
 }
 
-void CKevaNotifier::KevaDeleted(const CTransaction& tx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key) {
+void CKevaNotifier::KevaDeleted(const CTransactionRef& ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key) {
   if (signals) {
-    CTransactionRef ptx = MakeTransactionRef(tx);
     signals->KevaDeleted(ptx, pindex, nameSpace, key);
   }
 }
 
 /* ************************************************************************** */
 
+CKevaCheck::CKevaCheck (const CTransaction& tx, unsigned h,
+                        const CCoinsViewCache& view)
+  : ptx(&tx), nHeight(h), nKevaInputs(0), fMissingInputs(false)
+{
+  /* Only the keva input is needed later on, so look at the input coins
+     in place and copy just that one script.  */
+  for (const auto& txin : tx.vin) {
+    const Coin& coin = view.AccessCoin(txin.prevout);
+    if (coin.IsSpent()) {
+      fMissingInputs = true;
+      continue;
+    }
+
+    if (CKevaScript::isKevaScript(coin.out.scriptPubKey)) {
+      if (nKevaInputs == 0) {
+        scriptIn = coin.out.scriptPubKey;
+      }
+      ++nKevaInputs;
+    }
+  }
+}
+
 bool
-CheckKevaTransaction (const CTransaction& tx, unsigned nHeight,
-                      const CCoinsView& view,
-                      CValidationState& state, unsigned flags)
+CKevaCheck::isNeeded () const
 {
-  const std::string strTxid = tx.GetHash ().GetHex ();
-  const char* txid = strTxid.c_str ();
+  return fMissingInputs || nKevaInputs > 0
+          || ptx->IsKevacoin() || ptx->HasKevaOps();
+}
+
+bool
+CKevaCheck::check (CValidationState& state) const
+{
+  const CTransaction& tx = *ptx;
 
   /*
-    As a first step, try to locate inputs and outputs of the transaction
+    As a first step, look at the inputs and outputs of the transaction
     that are keva scripts.  At most one input and output should be
     a keva operation.
   */
 
-  int nameIn = -1;
-  CKevaScript nameOpIn;
-  Coin coinIn;
-  for (unsigned i = 0; i < tx.vin.size(); ++i) {
-    const COutPoint& prevout = tx.vin[i].prevout;
-    Coin coin;
-    if (!view.GetCoin(prevout, coin)) {
-      return error("%s: failed to fetch input coin for %s", __func__, txid);
-    }
-
-    const CKevaScript op(coin.out.scriptPubKey);
-    if (op.isKevaOp()) {
-      if (nameIn != -1) {
-        return state.Invalid(error("%s: multiple name inputs into transaction %s", __func__, txid));
-      }
-      nameIn = i;
-      nameOpIn = op;
-      coinIn = coin;
-    }
+  if (fMissingInputs) {
+    return error("%s: failed to fetch input coin for %s", __func__, tx.GetHash().GetHex());
   }
+  if (nKevaInputs > 1) {
+    return state.Invalid(error("%s: multiple name inputs into transaction %s", __func__, tx.GetHash().GetHex()));
+  }
+  const bool hasNameIn = (nKevaInputs == 1);
 
-  int nameOut = -1;
-  CKevaScript nameOpOut;
-  for (unsigned i = 0; i < tx.vout.size(); ++i) {
-    const CKevaScript op(tx.vout[i].scriptPubKey);
-    if (op.isKevaOp()) {
-      if (nameOut != -1) {
-        return state.Invalid(error("%s: multiple name outputs from transaction %s", __func__, txid));
-      }
-      nameOut = i;
-      nameOpOut = op;
-    }
+  const CKevaTxOps& opsOut = tx.GetKevaOps();
+  if (opsOut.size() > 1) {
+    return state.Invalid(error("%s: multiple name outputs from transaction %s", __func__, tx.GetHash().GetHex()));
   }
+  const int nameOut = opsOut.empty() ? -1 : opsOut[0].first;
 
   /*
     Check that no keva inputs/outputs are present for a non-Kevacoin tx.
@@ -312,20 +404,21 @@ CheckKevaTransaction (const CTransaction& tx, unsigned nHeight,
   */
 
   if (!tx.IsKevacoin()) {
-    if (nameIn != -1) {
-      return state.Invalid(error("%s: non-Kevacoin tx %s has keva inputs", __func__, txid));
+    if (hasNameIn) {
+      return state.Invalid(error("%s: non-Kevacoin tx %s has keva inputs", __func__, tx.GetHash().GetHex()));
     }
     if (nameOut != -1) {
       return state.Invalid (error ("%s: non-Kevacoin tx %s at height %u has keva outputs",
-                                     __func__, txid, nHeight));
+                                     __func__, tx.GetHash().GetHex(), nHeight));
     }
     return true;
   }
 
   assert(tx.IsKevacoin());
   if (nameOut == -1) {
-    return state.Invalid (error ("%s: Kevacoin tx %s has no keva outputs", __func__, txid));
+    return state.Invalid (error ("%s: Kevacoin tx %s has no keva outputs", __func__, tx.GetHash().GetHex()));
   }
+  const CKevaScript& nameOpOut = opsOut[0].second;
 
   /* Reject "greedy names".  */
   if (tx.vout[nameOut].nValue < KEVA_LOCKED_AMOUNT) {
@@ -341,9 +434,10 @@ CheckKevaTransaction (const CTransaction& tx, unsigned nHeight,
 
   assert(nameOpOut.isAnyUpdate());
 
-  if (nameIn == -1) {
+  if (!hasNameIn) {
     return state.Invalid(error("CheckKevaTransaction: update without previous keva input"));
   }
+  const CKevaScriptView nameOpIn(scriptIn);
 
   const valtype& key = nameOpOut.getOpKey();
   if (key.size() > MAX_KEY_LENGTH) {
@@ -351,8 +445,8 @@ CheckKevaTransaction (const CTransaction& tx, unsigned nHeight,
   }
 
   const valtype& nameSpace = nameOpOut.getOpNamespace();
-  if (nameSpace != nameOpIn.getOpNamespace()) {
-    return state.Invalid(error("%s: KEVA_PUT namespace mismatch to prev tx found in %s", __func__, txid));
+  if (MakeSpan(nameSpace) != nameOpIn.getOpNamespace()) {
+    return state.Invalid(error("%s: KEVA_PUT namespace mismatch to prev tx found in %s", __func__, tx.GetHash().GetHex()));
   }
 
   if (nameOpOut.getKevaOp() == OP_KEVA_PUT) {
@@ -373,9 +467,18 @@ CheckKevaTransaction (const CTransaction& tx, unsigned nHeight,
   return true;
 }
 
-void ApplyKevaTransaction(const CTransaction& tx, const CBlockIndex& pindex,
+bool
+CheckKevaTransaction (const CTransaction& tx, unsigned nHeight,
+                      const CCoinsViewCache& view,
+                      CValidationState& state, unsigned flags)
+{
+  return CKevaCheck(tx, nHeight, view).check(state);
+}
+
+void ApplyKevaTransaction(const CTransactionRef& ptx, const CBlockIndex& pindex,
                         CCoinsViewCache& view, CBlockUndo& undo, CKevaNotifier& notifier)
 {
+  const CTransaction& tx = *ptx;
   unsigned int nHeight = pindex.nHeight;
   assert (nHeight != MEMPOOL_HEIGHT);
   if (!tx.IsKevacoin())
@@ -384,11 +487,9 @@ void ApplyKevaTransaction(const CTransaction& tx, const CBlockIndex& pindex,
   /* Changes are encoded in the outputs.  We don't have to do any checks,
      so simply apply all these.  */
 
-  for (unsigned i = 0; i < tx.vout.size(); ++i) {
-    const CKevaScript op(tx.vout[i].scriptPubKey);
-    if (!op.isKevaOp()) {
-      continue;
-    }
+  for (const auto& txop : tx.GetKevaOps()) {
+    const unsigned i = txop.first;
+    const CKevaScript& op = txop.second;
     if (op.isNamespaceRegistration()) {
       const valtype& nameSpace = op.getOpNamespace();
       const valtype& displayName = op.getOpNamespaceDisplayName();
@@ -404,7 +505,7 @@ void ApplyKevaTransaction(const CTransaction& tx, const CBlockIndex& pindex,
       CKevaData data;
       data.fromScript(nHeight, COutPoint(tx.GetHash(), i), op);
       view.SetName(nameSpace, key, data, false);
-      notifier.KevaNamespaceCreated(tx, pindex, EncodeBase58Check(nameSpace));
+      notifier.KevaNamespaceCreated(ptx, pindex, nameSpace);
     } else if (op.isAnyUpdate()) {
       const valtype& nameSpace = op.getOpNamespace();
       const valtype& key = op.getOpKey();
@@ -419,21 +520,33 @@ void ApplyKevaTransaction(const CTransaction& tx, const CBlockIndex& pindex,
       if (op.isDelete()) {
         CKevaData oldData;
         if (view.GetName(nameSpace, key, oldData)) {
-          view.DeleteName(nameSpace, key);
-          notifier.KevaDeleted(tx, pindex, EncodeBase58Check(nameSpace), ValtypeToString(key));
+          view.DeleteName(nameSpace, key, false);
+          notifier.KevaDeleted(ptx, pindex, nameSpace, key);
         }
       } else {
         data.fromScript(nHeight, COutPoint(tx.GetHash(), i), op);
         view.SetName(nameSpace, key, data, false);
-        notifier.KevaUpdated(tx, pindex, EncodeBase58Check(nameSpace), ValtypeToString(key), ValtypeToString(data.getValue()));
+        notifier.KevaUpdated(ptx, pindex, nameSpace, key, op.getOpValue());
       }
     }
   }
 }
 
+/** Number of recent blocks for which the keva set commitment is kept.  */
+static const size_t MAX_KEVA_SET_COMMITMENTS = 1000;
+
+/**
+ * Keva set commitments recorded when blocks were connected, by height.
+ * The block hash is kept as well, so that a commitment is only compared
+ * against the state after the same block.  Protected by cs_main.
+ */
+static std::map<int, std::pair<uint256, uint256>> mapKevaSetCommitments;
+
 void
 CheckNameDB (bool disconnect)
 {
+  AssertLockHeld (cs_main);
+
   const int option
     = gArgs.GetArg ("-checkkevadb", Params().DefaultCheckKevaDB ());
 
@@ -441,27 +554,43 @@ CheckNameDB (bool disconnect)
     return;
 
   assert (option >= 0);
-  if (option != 0)
+
+  const CBlockIndex* pindex = chainActive.Tip ();
+  CKevaSetInfo info;
+  if (pindex == nullptr || !pcoinsTip->GetKevaSetInfo (info))
+    return;
+  const int nHeight = pindex->nHeight;
+  const uint256 commitment = info.getCommitment ();
+
+  if (disconnect)
     {
-      if (disconnect || chainActive.Height () % option != 0)
-        return;
+      const auto it = mapKevaSetCommitments.find (nHeight);
+      if (it != mapKevaSetCommitments.end ()
+          && it->second.first == pindex->GetBlockHash ()
+          && it->second.second != commitment)
+        {
+          LogPrintf ("ERROR: %s : keva set commitment at height %d is %s, expected %s\n",
+                     __func__, nHeight, commitment.GetHex (),
+                     it->second.second.GetHex ());
+          assert (false);
+        }
+      mapKevaSetCommitments.erase (mapKevaSetCommitments.upper_bound (nHeight),
+                                   mapKevaSetCommitments.end ());
+      return;
     }
 
+  mapKevaSetCommitments[nHeight]
+    = std::make_pair (pindex->GetBlockHash (), commitment);
+  while (mapKevaSetCommitments.size () > MAX_KEVA_SET_COMMITMENTS)
+    mapKevaSetCommitments.erase (mapKevaSetCommitments.begin ());
+
+  if (option == 0 || nHeight % option != 0)
+    return;
+
   pcoinsTip->Flush ();
-  const bool ok = pcoinsTip->ValidateKevaDB();
-
-  /* The DB is inconsistent (mismatch between UTXO set and names DB) between
-     (roughly) blocks 139,000 and 180,000.  This is caused by libcoin's
-     "name stealing" bug.  For instance, d/postmortem is removed from
-     the UTXO set shortly after registration (when it is used to steal
-     names), but it remains in the name DB until it expires.  */
-  if (!ok)
+  if (!pcoinsTip->ValidateKevaDB ())
     {
-      const unsigned nHeight = chainActive.Height ();
       LogPrintf ("ERROR: %s : name database is inconsistent\n", __func__);
-      if (nHeight >= 139000 && nHeight <= 180000)
-        LogPrintf ("This is expected due to 'name stealing'.\n");
-      else
-        assert (false);
+      assert (false);
     }
 }
@@ -96,8 +96,127 @@ public:
    */
   void apply (CCoinsViewCache& view) const;
 
+  inline const valtype&
+  getNamespace () const
+  {
+    return nameSpace;
+  }
+
+  inline const valtype&
+  getKey () const
+  {
+    return key;
+  }
+
+  /**
+   * Serialize everything but the namespace, which the compact format of
+   * the block undo data stores only once per block.
+   */
+  template<typename Stream>
+    void SerializeWithoutNamespace (Stream& s) const
+  {
+    ::Serialize (s, key);
+    ::Serialize (s, isNew);
+    if (!isNew) {
+      ::Serialize (s, oldData);
+    }
+  }
+
+  template<typename Stream>
+    void UnserializeWithoutNamespace (Stream& s, const valtype& ns)
+  {
+    nameSpace = ns;
+    ::Unserialize (s, key);
+    ::Unserialize (s, isNew);
+    if (!isNew) {
+      ::Unserialize (s, oldData);
+    }
+  }
+
+};
+
+/**
+ * Compact serialization of the keva undo records of a block.  Every
+ * namespace is written once, and the records refer to it by its index.
+ */
+class KevaUndoCompactSerializer
+{
+  const std::vector<CKevaTxUndo>* pundo;
+
+public:
+
+  explicit KevaUndoCompactSerializer (const std::vector<CKevaTxUndo>* p)
+    : pundo(p)
+  {}
+
+  template<typename Stream>
+    void Serialize (Stream& s) const
+  {
+    std::vector<const valtype*> namespaces;
+    std::map<valtype, uint64_t> indices;
+    std::vector<uint64_t> recordIndices;
+    recordIndices.reserve (pundo->size ());
+    for (const auto& rec : *pundo) {
+      auto mit = indices.find (rec.getNamespace ());
+      if (mit == indices.end ()) {
+        mit = indices.emplace (rec.getNamespace (), namespaces.size ()).first;
+        namespaces.push_back (&rec.getNamespace ());
+      }
+      recordIndices.push_back (mit->second);
+    }
+
+    WriteCompactSize (s, namespaces.size ());
+    for (const valtype* ns : namespaces) {
+      ::Serialize (s, *ns);
+    }
+    WriteCompactSize (s, pundo->size ());
+    for (size_t i = 0; i < pundo->size (); ++i) {
+      ::Serialize (s, VARINT (recordIndices[i]));
+      (*pundo)[i].SerializeWithoutNamespace (s);
+    }
+  }
 };
 
+class KevaUndoCompactDeserializer
+{
+  std::vector<CKevaTxUndo>* pundo;
+
+public:
+
+  explicit KevaUndoCompactDeserializer (std::vector<CKevaTxUndo>* p)
+    : pundo(p)
+  {}
+
+  template<typename Stream>
+    void Unserialize (Stream& s)
+  {
+    std::vector<valtype> namespaces;
+    ::Unserialize (s, namespaces);
+
+    const uint64_t count = ReadCompactSize (s);
+    pundo->clear ();
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t index;
+      ::Unserialize (s, VARINT (index));
+      if (index >= namespaces.size ()) {
+        throw std::ios_base::failure ("Invalid keva undo namespace index");
+      }
+      pundo->emplace_back ();
+      pundo->back ().UnserializeWithoutNamespace (s, namespaces[index]);
+    }
+  }
+};
+
+/**
+ * Drop all but the first undo record for each namespace and key from the
+ * undo records of a block.  The first one restores the state from before
+ * the block, and the later ones are overridden by it when the block is
+ * disconnected anyway.  With -kevahistory, all records are kept, since
+ * each of them rolls back one entry of the key's history.
+ * @param undo The records to compact, in the order they were made.
+ */
+void CompactKevaUndo (std::vector<CKevaTxUndo>& undo);
+
 /* ************************************************************************** */
 /* CKevaMemPool.  */
 
@@ -115,17 +234,28 @@ private:
   /** The parent mempool object.  Used to, e. g., remove conflicting tx.  */
   CTxMemPool& pool;
 
+  typedef std::list<std::tuple<uint256, valtype, valtype>> NamespaceList;
+  typedef std::list<std::tuple<uint256, valtype, valtype, valtype>> KeyValueList;
+
   /**
-   * Pending/unconfirmed namespaces.
+   * Pending/unconfirmed namespaces, in the order they were added.
    * Tuple: txid, namespace, display name
    */
-  std::vector<std::tuple<uint256, valtype, valtype>> listUnconfirmedNamespaces;
+  NamespaceList listUnconfirmedNamespaces;
 
   /**
-   * Pending/unconfirmed key-values.
+   * Pending/unconfirmed key-values, in the order they were added.
    * Tuple: txid, namespace, key, value
    */
-  std::vector<std::tuple<uint256, valtype, valtype, valtype>> listUnconfirmedKeyValues;
+  KeyValueList listUnconfirmedKeyValues;
+
+  /** Position of each tx in the lists above, so that removal does not
+   *  need to scan them.  */
+  std::map<uint256, NamespaceList::iterator> mapNamespaceTx;
+  std::map<uint256, KeyValueList::iterator> mapKeyValueTx;
+
+  /** Heap usage of the values held in the lists.  */
+  size_t cachedInnerUsage = 0;
 
   /**
    * Validate that the namespace is the hash of the first TxIn.
@@ -147,8 +277,17 @@ public:
   {
     listUnconfirmedNamespaces.clear();
     listUnconfirmedKeyValues.clear();
+    mapNamespaceTx.clear();
+    mapKeyValueTx.clear();
+    cachedInnerUsage = 0;
   }
 
+  /** Heap memory used for the unconfirmed keva data.  */
+  size_t DynamicMemoryUsage() const;
+
+  /** Check internal consistency (for the mempool sanity check).  */
+  void check() const;
+
   /**
    * Added unconfirmed keva values.
    * @param hash The tx hash.
@@ -221,18 +360,27 @@ public:
 };
 
 /**
- * Notify Keva transactions. This is for ZMQ notification.
+ * Forwards the keva changes of connected blocks to the validation
+ * interface listeners.  Whether anyone listens is determined once on
+ * construction, so that connecting blocks costs nothing otherwise.
  */
 class CKevaNotifier
 {
 private:
+  /** The signals to notify, or null if nobody listens.  */
   CMainSignals* signals;
 
 public:
-  CKevaNotifier(CMainSignals*);
-  void KevaNamespaceCreated(const CTransaction& tx, const CBlockIndex &pindex, const std::string& nameSpace);
-  void KevaUpdated(const CTransaction& tx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key, const std::string& value);
-  void KevaDeleted(const CTransaction& tx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key);
+  explicit CKevaNotifier(CMainSignals*);
+
+  inline bool isEnabled() const
+  {
+    return signals != nullptr;
+  }
+
+  void KevaNamespaceCreated(const CTransactionRef& ptx, const CBlockIndex &pindex, const valtype& nameSpace);
+  void KevaUpdated(const CTransactionRef& ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key, const valtype& value);
+  void KevaDeleted(const CTransactionRef& ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key);
 };
 
 /* ************************************************************************** */
@@ -249,9 +397,54 @@ public:
  * @return True in case of success.
  */
 bool CheckKevaTransaction (const CTransaction& tx, unsigned nHeight,
-                           const CCoinsView& view,
+                           const CCoinsViewCache& view,
                            CValidationState& state, unsigned flags);
 
+/**
+ * Closure checking a transaction according to the Kevacoin rules, as done
+ * by CheckKevaTransaction.  The keva input (if any) is looked up in the
+ * coins view when the check is constructed, so that running it depends
+ * on the transaction only and can be done on a script check thread while
+ * the block is being connected.
+ */
+class CKevaCheck
+{
+private:
+
+  const CTransaction* ptx;
+  unsigned nHeight;
+
+  /** Number of inputs spending a keva script.  */
+  unsigned nKevaInputs;
+  /** Whether some input coin was not found in the view.  */
+  bool fMissingInputs;
+  /** The script of the keva input, if there is one.  */
+  CScript scriptIn;
+
+public:
+
+  CKevaCheck (const CTransaction& tx, unsigned h, const CCoinsViewCache& view);
+
+  /**
+   * Returns whether the check can fail at all.  That is not the case for
+   * non-Kevacoin transactions without keva inputs and outputs.
+   */
+  bool isNeeded () const;
+
+  /**
+   * Perform the check.  The txid is only formatted if it fails.
+   * @param state Resulting validation state.
+   * @return True if the transaction is valid.
+   */
+  bool check (CValidationState& state) const;
+
+  const uint256&
+  GetTxHash () const
+  {
+    return ptx->GetHash ();
+  }
+};
+
 /**
  * Apply the changes of a keva transaction to the database.
  * @param tx The transaction to apply.
@@ -259,7 +452,7 @@ bool CheckKevaTransaction (const CTransaction& tx, unsigned nHeight,
  * @param view The chain state to update.
  * @param undo Record undo information here.
  */
-void ApplyKevaTransaction (const CTransaction& tx, const CBlockIndex& pindex,
+void ApplyKevaTransaction (const CTransactionRef& ptx, const CBlockIndex& pindex,
                            CCoinsViewCache& view, CBlockUndo& undo, CKevaNotifier& notifier);
 
 /**
@@ -287,9 +480,13 @@ bool UnexpireNames (unsigned nHeight, CBlockUndo& undo,
                     CCoinsViewCache& view, std::set<valtype>& names);
 
 /**
- * Check the name database consistency.  This calls CCoinsView::ValidateKevaDB,
- * but only if applicable depending on the -checkkevadb setting.  If it fails,
- * this throws an assertion failure.
+ * Check the name database consistency, depending on the -checkkevadb
+ * setting.  Unless it is -1, the keva set commitment is recorded whenever a
+ * block is connected and compared to the recorded one after disconnecting
+ * back to that block, which is cheap.  If it is positive, every n-th
+ * connected block additionally flushes the state and recomputes the keva set
+ * summary from the database with CCoinsView::ValidateKevaDB.  If a check
+ * fails, this throws an assertion failure.
  * @param disconnect Whether we are disconnecting blocks.
  */
 void CheckNameDB (bool disconnect);
@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <keva/registry.h>
+
+#include <coins.h>
+#include <primitives/block.h>
+#include <script/keva.h>
+#include <txdb.h>
+#include <undo.h>
+
+#include <algorithm>
+
+bool fKevaRegistry = false;
+
+valtype
+NormalizeRegistryName (const valtype& name)
+{
+  valtype res(name);
+  for (auto& c : res)
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+  return res;
+}
+
+std::set<valtype>
+GetRegistryTrigrams (const valtype& normalized)
+{
+  std::set<valtype> res;
+  const size_t len = std::min (normalized.size (), MAX_REGISTRY_SEARCH_LENGTH);
+  for (size_t i = 0; i + 3 <= len; ++i)
+    res.insert (valtype (normalized.begin () + i, normalized.begin () + i + 3));
+  return res;
+}
+
+void
+BuildKevaRegistryUpdate (const CBlock& block, const CBlockUndo& blockundo,
+                         int nHeight, bool fConnect, const CCoinsView& view,
+                         CBlockTreeDB& db, CKevaRegistryUpdate& update)
+{
+  /* The namespaces with keva outputs in the block, and the owner they have
+     after it (the address of their last keva output).  */
+  std::map<valtype, CScript> ownerAfter;
+  std::set<valtype> registered;
+  /* The owner before the block, which is the address of the first keva
+     output of the namespace that the block spends.  */
+  std::map<valtype, CScript> ownerBefore;
+
+  for (size_t i = 0; i < block.vtx.size (); ++i)
+    {
+      const CTransaction& tx = *block.vtx[i];
+      if (!tx.IsKevacoin ())
+        continue;
+
+      if (!fConnect && i > 0)
+        for (const Coin& coin : blockundo.vtxundo[i - 1].vprevout)
+          {
+            const CKevaScriptView op(coin.out.scriptPubKey);
+            if (!op.isKevaOp ())
+              continue;
+            const Span<const unsigned char> nameSpace = op.getOpNamespace ();
+            ownerBefore.emplace (valtype (nameSpace.begin (), nameSpace.end ()), op.getAddress ());
+          }
+
+      for (const auto& txop : tx.GetKevaOps ())
+        {
+          const CKevaScript& op = txop.second;
+          if (op.isNamespaceRegistration ())
+            registered.insert (op.getOpNamespace ());
+          ownerAfter[op.getOpNamespace ()] = op.getAddress ();
+        }
+    }
+
+  for (const auto& entry : ownerAfter)
+    {
+      const valtype& nameSpace = entry.first;
+      if (!fConnect && registered.count (nameSpace) > 0)
+        {
+          update.erased.insert (nameSpace);
+          continue;
+        }
+
+      CKevaRegistryEntry reg;
+      const bool fHaveOld = db.ReadKevaRegistryEntry (nameSpace, reg);
+      CKevaData data;
+      if (!view.GetNamespace (nameSpace, data))
+        {
+          if (fHaveOld)
+            update.erased.insert (nameSpace);
+          continue;
+        }
+
+      /* The display name is a key of the namespace and may change with any
+         update, so it is taken from the chain state.  */
+      reg.displayName = data.getValue ();
+      if (!fHaveOld)
+        reg.nHeight = fConnect ? nHeight : data.getHeight ();
+      if (fConnect)
+        reg.owner = entry.second;
+      else
+        {
+          const auto it = ownerBefore.find (nameSpace);
+          if (it != ownerBefore.end ())
+            reg.owner = it->second;
+        }
+      update.changed[nameSpace] = reg;
+    }
+}
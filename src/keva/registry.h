@@ -0,0 +1,94 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef H_BITCOIN_KEVA_REGISTRY
+#define H_BITCOIN_KEVA_REGISTRY
+
+#include <script/script.h>
+#include <serialize.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+class CBlock;
+class CBlockTreeDB;
+class CBlockUndo;
+class CCoinsView;
+
+typedef std::vector<unsigned char> valtype;
+
+/** Whether to keep the namespace registry by default.  */
+static const bool DEFAULT_KEVA_REGISTRY = false;
+
+/** Whether the namespace registry is kept (-kevaregistry).  */
+extern bool fKevaRegistry;
+
+/**
+ * Number of leading bytes of a display name that the search index covers.
+ * Longer names are still found, but only by their beginning.
+ */
+static const size_t MAX_REGISTRY_SEARCH_LENGTH = 64;
+
+/**
+ * A namespace in the registry:  its current display name, the height at
+ * which it was registered, and the address its current keva output pays to.
+ */
+class CKevaRegistryEntry
+{
+
+public:
+
+  valtype displayName;
+  int nHeight;
+  CScript owner;
+
+  CKevaRegistryEntry ()
+    : nHeight(0)
+  {}
+
+  ADD_SERIALIZE_METHODS;
+
+  template<typename Stream, typename Operation>
+    inline void SerializationOp (Stream& s, Operation ser_action)
+  {
+    READWRITE (displayName);
+    READWRITE (nHeight);
+    READWRITE (*(CScriptBase*)(&owner));
+  }
+
+};
+
+/**
+ * The changes to the registry for connecting or disconnecting a block:  the
+ * new entries of changed namespaces, and namespaces that no longer exist.
+ */
+struct CKevaRegistryUpdate
+{
+  std::map<valtype, CKevaRegistryEntry> changed;
+  std::set<valtype> erased;
+};
+
+/**
+ * Return the form of a display name (or search query) that is indexed:
+ * ASCII letters are lower-cased, so that the search is case-insensitive.
+ */
+valtype NormalizeRegistryName (const valtype& name);
+
+/**
+ * Return the distinct three-byte substrings of the indexed part of a
+ * normalised display name.
+ */
+std::set<valtype> GetRegistryTrigrams (const valtype& normalized);
+
+/**
+ * Compute the registry changes for a block.  view must be the chain state
+ * after connecting (or disconnecting, if fConnect is false) the block, and
+ * db is used to look up the previous registry entries.
+ */
+void BuildKevaRegistryUpdate (const CBlock& block, const CBlockUndo& blockundo,
+                              int nHeight, bool fConnect, const CCoinsView& view,
+                              CBlockTreeDB& db, CKevaRegistryUpdate& update);
+
+#endif // H_BITCOIN_KEVA_REGISTRY
@@ -5,7 +5,9 @@
 #ifndef BITCOIN_MEMUSAGE_H
 #define BITCOIN_MEMUSAGE_H
 
+#include <flatset.h>
 #include <indirectmap.h>
+#include <prevector.h>
 
 #include <stdlib.h>
 
@@ -105,6 +107,12 @@ static inline size_t IncrementalDynamicUsage(const std::set<X, Y>& s)
     return MallocUsage(sizeof(stl_tree_node<X>));
 }
 
+template<typename X, typename Y>
+static inline size_t DynamicUsage(const flatset<X, Y>& s)
+{
+    return MallocUsage(s.capacity() * sizeof(X));
+}
+
 template<typename X, typename Y, typename Z>
 static inline size_t DynamicUsage(const std::map<X, Y, Z>& m)
 {
@@ -32,6 +32,8 @@
 #include <queue>
 #include <utility>
 
+#include <boost/bind.hpp>
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // BitcoinMiner
@@ -61,14 +63,68 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
     return nNewTime - nOldTime;
 }
 
+// Above this many mempool additions between two templates, re-walking the
+// mempool is no more expensive than replaying the additions.
+static const size_t MAX_TEMPLATE_CACHE_ADDED = 10000;
+
+BlockTemplateCache::BlockTemplateCache(CTxMemPool& pool) : fValid(false)
+{
+    connAdded = pool.NotifyEntryAdded.connect(boost::bind(&BlockTemplateCache::TransactionAddedToMempool, this, _1));
+    connRemoved = pool.NotifyEntryRemoved.connect(boost::bind(&BlockTemplateCache::TransactionRemovedFromMempool, this, _1, _2));
+}
+
+void BlockTemplateCache::Invalidate()
+{
+    LOCK(cs);
+    fValid = false;
+    vSelected.clear();
+    setSelected.clear();
+    vAdded.clear();
+}
+
+void BlockTemplateCache::TransactionAddedToMempool(CTransactionRef tx)
+{
+    LOCK(cs);
+    if (!fValid)
+        return;
+    if (vAdded.size() >= MAX_TEMPLATE_CACHE_ADDED) {
+        fValid = false;
+        return;
+    }
+    vAdded.push_back(tx->GetHash());
+    ++nTransactionsUpdated;
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (!fValid)
+        return;
+    // The cached iterators of selected entries must stay valid; anything
+    // else leaving the pool is simply skipped when the additions are replayed.
+    if (setSelected.count(tx->GetHash())) {
+        fValid = false;
+        return;
+    }
+    ++nTransactionsUpdated;
+}
+
+BlockTemplateCache& GetBlockTemplateCache()
+{
+    static BlockTemplateCache cache(mempool);
+    return cache;
+}
+
 BlockAssembler::Options::Options() {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    templateCache = nullptr;
 }
 
 BlockAssembler::BlockAssembler(const CChainParams& params, const Options& options) : chainparams(params)
 {
     blockMinFeeRate = options.blockMinFeeRate;
+    templateCache = options.templateCache;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
 }
@@ -86,6 +142,7 @@ static BlockAssembler::Options DefaultOptions(const CChainParams& params)
     } else {
         options.blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     }
+    options.templateCache = &GetBlockTemplateCache();
     return options;
 }
 
@@ -94,6 +151,8 @@ BlockAssembler::BlockAssembler(const CChainParams& params) : BlockAssembler(para
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
+    vInBlock.clear();
+    fPackagesTruncated = false;
 
     // Reserve space for coinbase tx
     nBlockWeight = 4000;
@@ -105,6 +164,21 @@ void BlockAssembler::resetBlock()
     nFees = 0;
 }
 
+void BlockAssembler::resetSelection()
+{
+    pblock->vtx.resize(1);
+    pblocktemplate->vTxFees.resize(1);
+    pblocktemplate->vTxSigOpsCost.resize(1);
+    inBlock.clear();
+    vInBlock.clear();
+    fPackagesTruncated = false;
+
+    nBlockWeight = 4000;
+    nBlockSigOpsCost = 400;
+    nBlockTx = 0;
+    nFees = 0;
+}
+
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
 {
     int64_t nTimeStart = GetTimeMicros();
@@ -150,7 +224,16 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    bool fIncremental = false;
+    if (templateCache) {
+        LOCK(templateCache->cs);
+        fIncremental = addPackageTxsIncremental(nPackagesSelected);
+        if (!fIncremental)
+            addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+        UpdateTemplateCache();
+    } else {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -182,11 +265,13 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        if (templateCache)
+            templateCache->Invalidate();
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%s, %d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), fIncremental ? "incremental" : "full", nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -239,6 +324,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nBlockSigOpsCost += iter->GetSigOpCost();
     nFees += iter->GetFee();
     inBlock.insert(iter);
+    vInBlock.push_back(iter);
 
     bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
@@ -386,6 +472,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            fPackagesTruncated = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -393,6 +480,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
                 mapModifiedTx.get<ancestor_score>().erase(modit);
                 failedTx.insert(iter);
             }
+            SkipNamespaceChain(iter, mapModifiedTx, failedTx);
 
             ++nConsecutiveFailed;
 
@@ -418,9 +506,12 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
                 mapModifiedTx.get<ancestor_score>().erase(modit);
                 failedTx.insert(iter);
             }
+            SkipNamespaceChain(iter, mapModifiedTx, failedTx);
             continue;
         }
 
+        AddNamespaceChains(ancestors, packageSize, packageFees, packageSigOpsCost);
+
         // This transaction will make it in; reset the failed counter.
         nConsecutiveFailed = 0;
 
@@ -441,6 +532,234 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+bool BlockAssembler::addPackageTxsIncremental(int &nPackagesSelected)
+{
+    AssertLockHeld(templateCache->cs);
+    BlockTemplateCache& cache = *templateCache;
+
+    // A selection that hit the weight or sigops limit could now be displaced
+    // by better packages, which only a full pass can find.
+    if (!cache.fValid || cache.hashPrevBlock != chainActive.Tip()->GetBlockHash() ||
+            cache.nHeight != nHeight || cache.nLockTimeCutoff != nLockTimeCutoff ||
+            cache.fIncludeWitness != fIncludeWitness || cache.nBlockMaxWeight != nBlockMaxWeight ||
+            cache.blockMinFeeRate != blockMinFeeRate ||
+            cache.nTransactionsUpdated != mempool.GetTransactionsUpdated()) {
+        return false;
+    }
+
+    for (CTxMemPool::txiter it : cache.vSelected) {
+        AddToBlock(it);
+    }
+
+    // Every package that was below the minimum feerate or not final before is
+    // still so, unless one of the new transactions pulls it in as an ancestor
+    // or one of its ancestors gets included. So only the packages of the new
+    // transactions, and then of the descendants of whatever got included,
+    // need to be evaluated.
+    std::vector<CTxMemPool::txiter> vCandidates;
+    vCandidates.reserve(cache.vAdded.size());
+    for (const uint256& hash : cache.vAdded) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end() && !inBlock.count(it))
+            vCandidates.push_back(it);
+    }
+
+    while (!vCandidates.empty()) {
+        std::sort(vCandidates.begin(), vCandidates.end(), [](const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) {
+            return CompareTxMemPoolEntryByAncestorFee()(*a, *b);
+        });
+
+        CTxMemPool::setEntries setNext;
+        for (CTxMemPool::txiter iter : vCandidates) {
+            if (inBlock.count(iter))
+                continue;
+
+            CTxMemPool::setEntries ancestors;
+            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+            std::string dummy;
+            mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            onlyUnconfirmed(ancestors);
+            ancestors.insert(iter);
+
+            // Some of the ancestors may be in the block by now, so the package
+            // state is recomputed instead of taken from mapTx.
+            uint64_t packageSize = 0;
+            CAmount packageFees = 0;
+            int64_t packageSigOpsCost = 0;
+            for (CTxMemPool::txiter it : ancestors) {
+                packageSize += it->GetTxSize();
+                packageFees += it->GetModifiedFee();
+                packageSigOpsCost += it->GetSigOpCost();
+            }
+
+            if (packageFees < blockMinFeeRate.GetFee(packageSize))
+                continue;
+            if (!TestPackage(packageSize, packageSigOpsCost)) {
+                // The package may still belong in the block ahead of lower
+                // feerate ones already selected. Only a full pass can tell.
+                resetSelection();
+                nPackagesSelected = 0;
+                return false;
+            }
+            if (!TestPackageTransactions(ancestors))
+                continue;
+
+            AddNamespaceChains(ancestors, packageSize, packageFees, packageSigOpsCost);
+
+            std::vector<CTxMemPool::txiter> sortedEntries;
+            SortForBlock(ancestors, iter, sortedEntries);
+            for (CTxMemPool::txiter it : sortedEntries) {
+                AddToBlock(it);
+            }
+            ++nPackagesSelected;
+
+            for (CTxMemPool::txiter it : ancestors) {
+                CTxMemPool::setEntries descendants;
+                mempool.CalculateDescendants(it, descendants);
+                for (CTxMemPool::txiter desc : descendants) {
+                    if (!inBlock.count(desc))
+                        setNext.insert(desc);
+                }
+            }
+        }
+        vCandidates.assign(setNext.begin(), setNext.end());
+    }
+    return true;
+}
+
+void BlockAssembler::UpdateTemplateCache()
+{
+    AssertLockHeld(templateCache->cs);
+    BlockTemplateCache& cache = *templateCache;
+
+    cache.vAdded.clear();
+    cache.fValid = !fPackagesTruncated;
+    if (!cache.fValid) {
+        cache.vSelected.clear();
+        cache.setSelected.clear();
+        return;
+    }
+    cache.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    cache.nHeight = nHeight;
+    cache.nLockTimeCutoff = nLockTimeCutoff;
+    cache.fIncludeWitness = fIncludeWitness;
+    cache.nBlockMaxWeight = nBlockMaxWeight;
+    cache.blockMinFeeRate = blockMinFeeRate;
+    cache.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    cache.vSelected = vInBlock;
+    cache.setSelected.clear();
+    for (CTxMemPool::txiter it : vInBlock) {
+        cache.setSelected.insert(it->GetTx().GetHash());
+    }
+}
+
+CTxMemPool::txiter BlockAssembler::NextInNamespaceChain(CTxMemPool::txiter it) const
+{
+    if (!it->isKevaOp())
+        return mempool.mapTx.end();
+
+    const CTransaction& tx = it->GetTx();
+    for (CTxMemPool::txiter child : mempool.GetMemPoolChildren(it)) {
+        if (!child->isKevaOp() || child->getNamespace() != it->getNamespace())
+            continue;
+        for (const CTxIn& txin : child->GetTx().vin) {
+            if (txin.prevout.hash == tx.GetHash() && tx.GetKevaOp(txin.prevout.n))
+                return child;
+        }
+    }
+    return mempool.mapTx.end();
+}
+
+// A namespace chain is typically funded by the change of the previous
+// operation, so the ancestor-feerate walk would otherwise take it apart one
+// package at a time, re-scoring every remaining operation in mapModifiedTx
+// after each step. Appending the rest of the chain while its aggregated
+// feerate is at least that of the package only includes operations whose
+// marginal feerate is at least the best one available, which the walk would
+// have picked next anyway.
+void BlockAssembler::AddNamespaceChains(CTxMemPool::setEntries& package, uint64_t& packageSize, CAmount& packageFees, int64_t& packageSigOpsCost)
+{
+    std::vector<CTxMemPool::txiter> vTails;
+    for (CTxMemPool::txiter it : package) {
+        CTxMemPool::txiter next = NextInNamespaceChain(it);
+        if (next != mempool.mapTx.end() && !package.count(next))
+            vTails.push_back(it);
+    }
+    if (vTails.empty())
+        return;
+
+    const double dBaseSize = packageSize;
+    const double dBaseFees = packageFees;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+
+    for (CTxMemPool::txiter tail : vTails) {
+        // Entries in the order they were pulled in; the first nAccepted of
+        // them form the longest extension that keeps the feerate.
+        std::vector<CTxMemPool::txiter> vExtension;
+        CTxMemPool::setEntries setExtension;
+        size_t nAccepted = 0;
+        uint64_t extSize = 0;
+        CAmount extFees = 0;
+        int64_t extSigOpsCost = 0;
+        uint64_t acceptedSize = 0;
+        CAmount acceptedFees = 0;
+        int64_t acceptedSigOpsCost = 0;
+
+        for (CTxMemPool::txiter next = NextInNamespaceChain(tail); next != mempool.mapTx.end(); next = NextInNamespaceChain(next)) {
+            if (package.count(next))
+                break;
+
+            CTxMemPool::setEntries step;
+            for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(next)) {
+                if (package.count(parent) || setExtension.count(parent) || inBlock.count(parent))
+                    continue;
+                CTxMemPool::setEntries ancestors;
+                mempool.CalculateMemPoolAncestors(*parent, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+                ancestors.insert(parent);
+                for (CTxMemPool::txiter ancestor : ancestors) {
+                    if (!package.count(ancestor) && !setExtension.count(ancestor) && !inBlock.count(ancestor))
+                        step.insert(ancestor);
+                }
+            }
+            step.insert(next);
+
+            if (!TestPackageTransactions(step))
+                break;
+            for (CTxMemPool::txiter it : step) {
+                vExtension.push_back(it);
+                setExtension.insert(it);
+                extSize += it->GetTxSize();
+                extFees += it->GetModifiedFee();
+                extSigOpsCost += it->GetSigOpCost();
+            }
+            if (!TestPackage(packageSize + extSize, packageSigOpsCost + extSigOpsCost))
+                break;
+
+            if ((double)(packageFees + extFees) * dBaseSize >= dBaseFees * (double)(packageSize + extSize)) {
+                nAccepted = vExtension.size();
+                acceptedSize = extSize;
+                acceptedFees = extFees;
+                acceptedSigOpsCost = extSigOpsCost;
+            }
+        }
+
+        package.insert(vExtension.begin(), vExtension.begin() + nAccepted);
+        packageSize += acceptedSize;
+        packageFees += acceptedFees;
+        packageSigOpsCost += acceptedSigOpsCost;
+    }
+}
+
+void BlockAssembler::SkipNamespaceChain(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx)
+{
+    for (CTxMemPool::txiter next = NextInNamespaceChain(it); next != mempool.mapTx.end(); next = NextInNamespaceChain(next)) {
+        if (!failedTx.insert(next).second)
+            break;
+        mapModifiedTx.erase(next);
+    }
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -7,12 +7,15 @@
 #define BITCOIN_MINER_H
 
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 
 #include <stdint.h>
 #include <memory>
+#include <unordered_set>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/signals2/connection.hpp>
 
 class CBlockIndex;
 class CChainParams;
@@ -119,6 +122,60 @@ struct update_for_parent_inclusion
     CTxMemPool::txiter iter;
 };
 
+/**
+ * Transaction selection of the most recently assembled block template.
+ *
+ * The cache follows the mempool through NotifyEntryAdded/NotifyEntryRemoved.
+ * As long as the tip and the assembler options are unchanged, none of the
+ * selected transactions left the pool and the previous template was not
+ * limited by block weight or sigops, the next template is produced by
+ * restoring the previous selection and only considering the packages of
+ * transactions that arrived in between, rather than walking the whole
+ * ancestor_score index again. In every other case the assembler falls back
+ * to a full rebuild and refills the cache.
+ */
+class BlockTemplateCache
+{
+public:
+    explicit BlockTemplateCache(CTxMemPool& pool);
+
+    /** Forget the cached selection; the next template is built from scratch */
+    void Invalidate();
+
+private:
+    friend class BlockAssembler;
+
+    void TransactionAddedToMempool(CTransactionRef tx);
+    void TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    CCriticalSection cs;
+
+    bool fValid;
+    // Conditions under which the selection was made
+    uint256 hashPrevBlock;
+    int nHeight;
+    int64_t nLockTimeCutoff;
+    bool fIncludeWitness;
+    unsigned int nBlockMaxWeight;
+    CFeeRate blockMinFeeRate;
+    // Mempool update counter at the time of selection, advanced for every
+    // add/remove notification seen since. A mismatch means the mempool was
+    // changed in a way we did not track (clear, prioritisetransaction, ...).
+    unsigned int nTransactionsUpdated;
+
+    // The selection, in block order
+    std::vector<CTxMemPool::txiter> vSelected;
+    std::unordered_set<uint256, SaltedTxidHasher> setSelected;
+    // Transactions added to the mempool since the selection was made
+    std::vector<uint256> vAdded;
+
+    boost::signals2::scoped_connection connAdded;
+    boost::signals2::scoped_connection connRemoved;
+};
+
+/** Template cache shared by getblocktemplate and the generate RPCs */
+BlockTemplateCache& GetBlockTemplateCache();
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
@@ -139,17 +196,24 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    std::vector<CTxMemPool::txiter> vInBlock;
+    // Set when a package was left out because it did not fit
+    bool fPackagesTruncated;
 
     // Chain context for the block
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams& chainparams;
 
+    // Selection cache to reuse, or nullptr to always assemble from scratch
+    BlockTemplateCache* templateCache;
+
 public:
     struct Options {
         Options();
         size_t nBlockMaxWeight;
         CFeeRate blockMinFeeRate;
+        BlockTemplateCache* templateCache;
     };
 
     explicit BlockAssembler(const CChainParams& params);
@@ -162,6 +226,8 @@ private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Drop the transactions added so far, keeping the coinbase placeholder */
+    void resetSelection();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
@@ -170,6 +236,27 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated);
+    /** Restore the cached selection and add the packages of transactions that
+      * entered the mempool since. Returns false, leaving the block empty, if
+      * the cached selection cannot be reused or a new package no longer fits
+      * into it. */
+    bool addPackageTxsIncremental(int &nPackagesSelected);
+    /** Store the current selection in templateCache */
+    void UpdateTemplateCache();
+
+    // Keva operations on one namespace form chains in which every operation
+    // spends the namespace output of the previous one.
+    /** Return the mempool transaction spending the namespace output of the
+      * given one, or mempool.mapTx.end() if there is none */
+    CTxMemPool::txiter NextInNamespaceChain(CTxMemPool::txiter it) const;
+    /** Extend a package with the following operations of its namespace
+      * chains (and their missing ancestors) for as long as the aggregated
+      * feerate does not drop below the feerate of the package itself */
+    void AddNamespaceChains(CTxMemPool::setEntries& package, uint64_t& packageSize, CAmount& packageFees, int64_t& packageSigOpsCost);
+    /** Mark the namespace chain continuing from a package that could not be
+      * added as failed, since every package further down the chain contains
+      * it */
+    void SkipNamespaceChain(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
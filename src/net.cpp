@@ -21,12 +21,18 @@
 #include <utilstrencodings.h>
 
 #include <memory>
+#include <unordered_map>
 #ifdef WIN32
 #include <string.h>
 #else
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -43,6 +49,13 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+/** Maximum time to wait for socket events before servicing peers again (in milliseconds) */
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
+#ifdef USE_EPOLL
+/** Maximum number of socket events to collect per epoll_wait() call */
+static const int MAX_SOCKET_EVENTS = 256;
+#endif
+
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -71,8 +84,6 @@ enum BindFlags {
     BF_WHITELIST    = (1U << 2),
 };
 
-const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
-
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
 //
@@ -678,6 +689,18 @@ void CNode::SetAddrLocal(const CService& addrLocalIn) {
 
 #undef X
 #define X(name) stats.name = name
+void CMsgProcessingStats::Add(int64_t nTimeIn, int64_t nLockTimeIn)
+{
+    nCount++;
+    nTime += nTimeIn;
+    nLockTime += nLockTimeIn;
+    nMaxTime = std::max(nMaxTime, nTimeIn);
+    size_t nBucket = 0;
+    while (nBucket < MSG_PROCESSING_HISTOGRAM_SIZE - 1 && nTimeIn >= MSG_PROCESSING_HISTOGRAM_BOUNDS[nBucket])
+        nBucket++;
+    vHistogram[nBucket]++;
+}
+
 void CNode::copyStats(CNodeStats &stats)
 {
     stats.nodeid = this->GetId();
@@ -711,6 +734,11 @@ void CNode::copyStats(CNodeStats &stats)
         X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_processingStats);
+        X(mapProcessingPerMsgCmd);
+        X(sendProcessing);
+    }
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -906,12 +934,15 @@ size_t CConnman::SocketSendData(CNode *pnode) const
                 it++;
             } else {
                 // could not send full message; stop sending more
+                pnode->fSocketWritable = false;
                 break;
             }
         } else {
             if (nBytes < 0) {
                 // error
                 int nErr = WSAGetLastError();
+                if (nErr == WSAEWOULDBLOCK)
+                    pnode->fSocketWritable = false;
                 if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                 {
                     LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
@@ -1149,6 +1180,263 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+#ifdef USE_EPOLL
+bool CConnman::StartSocketEvents()
+{
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupfd == -1) {
+        LogPrintf("eventfd failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+
+    // Listening sockets and the wakeup fd stay level-triggered
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wakeupfd;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeupfd, &event) == SOCKET_ERROR) {
+        LogPrintf("epoll_ctl failed for wakeup fd: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        event.data.fd = hListenSocket.socket;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) == SOCKET_ERROR) {
+            LogPrintf("epoll_ctl failed for listening socket: %s\n", NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+    }
+    return true;
+}
+
+void CConnman::StopSocketEvents()
+{
+    if (wakeupfd != -1) {
+        close(wakeupfd);
+        wakeupfd = -1;
+    }
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+}
+#endif
+
+void CConnman::WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (wakeupfd != -1) {
+        uint64_t one = 1;
+        // Fails with EAGAIN only if a wakeup is already pending
+        if (write(wakeupfd, &one, sizeof(one)) != sizeof(one)) {}
+    }
+#endif
+}
+
+#ifdef USE_EPOLL
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    // Peer sockets are registered once, edge-triggered, for both directions.
+    // Each edge is remembered in fSocketReadable/fSocketWritable until a read
+    // or write would block. A peer with queued data is only serviced once it
+    // is writable, and any other peer once it is readable and not paused;
+    // epoll_wait only skips its timeout for a peer the service loop below
+    // will actually hand out, or the thread would spin on it.
+    std::unordered_map<SOCKET, CNode*> mapSocketNode;
+    bool fReady = false;
+    {
+        LOCK(cs_vNodes);
+        mapSocketNode.reserve(vNodes.size());
+        for (CNode* pnode : vNodes)
+        {
+            bool fServiceable;
+            {
+                LOCK(pnode->cs_vSend);
+                fServiceable = !pnode->vSendMsg.empty() ? pnode->fSocketWritable : (!pnode->fPauseRecv && pnode->fSocketReadable);
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            if (!pnode->fSocketRegistered) {
+                struct epoll_event event = {};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.fd = pnode->hSocket;
+                if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) == SOCKET_ERROR) {
+                    LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+                    pnode->fDisconnect = true;
+                    continue;
+                }
+                pnode->fSocketRegistered = true;
+            }
+            mapSocketNode.emplace(pnode->hSocket, pnode);
+
+            fReady |= fServiceable;
+        }
+    }
+
+    // Nodes are only deleted by this thread, so the pointers in mapSocketNode
+    // stay valid until the service loop is done with them.
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, MAX_SOCKET_EVENTS, fReady ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+    if (interruptNet)
+        return;
+    if (nEvents == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR)
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+        nEvents = 0;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        const SOCKET hSocket = events[i].data.fd;
+        if ((int)hSocket == wakeupfd) {
+            uint64_t count;
+            if (read(wakeupfd, &count, sizeof(count)) != sizeof(count)) {}
+            continue;
+        }
+        auto it = mapSocketNode.find(hSocket);
+        if (it == mapSocketNode.end()) {
+            // listening socket
+            recv_set.insert(hSocket);
+            continue;
+        }
+        CNode* pnode = it->second;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            error_set.insert(hSocket);
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP))
+            pnode->fSocketReadable = true;
+        if (events[i].events & EPOLLOUT) {
+            LOCK(pnode->cs_vSend);
+            pnode->fSocketWritable = true;
+        }
+    }
+
+    for (const auto& item : mapSocketNode)
+    {
+        CNode* pnode = item.second;
+        bool select_send;
+        {
+            LOCK(pnode->cs_vSend);
+            select_send = !pnode->vSendMsg.empty();
+            if (select_send && pnode->fSocketWritable)
+                send_set.insert(item.first);
+        }
+        if (!select_send && !pnode->fPauseRecv && pnode->fSocketReadable)
+            recv_set.insert(item.first);
+    }
+}
+#else
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        recv_select_set.insert(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            error_select_set.insert(pnode->hSocket);
+            if (select_send) {
+                send_select_set.insert(pnode->hSocket);
+                continue;
+            }
+            if (select_recv) {
+                recv_select_set.insert(pnode->hSocket);
+            }
+        }
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SELECT_TIMEOUT_MILLISECONDS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    for (SOCKET hSocket : recv_select_set) {
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : error_select_set) {
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    bool have_fds = !recv_select_set.empty() || !send_select_set.empty() || !error_select_set.empty();
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            recv_set = recv_select_set;
+        }
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    for (SOCKET hSocket : recv_select_set) {
+        if (FD_ISSET(hSocket, &fdsetRecv)) {
+            recv_set.insert(hSocket);
+        }
+    }
+    for (SOCKET hSocket : send_select_set) {
+        if (FD_ISSET(hSocket, &fdsetSend)) {
+            send_set.insert(hSocket);
+        }
+    }
+    for (SOCKET hSocket : error_select_set) {
+        if (FD_ISSET(hSocket, &fdsetError)) {
+            error_set.insert(hSocket);
+        }
+    }
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1215,94 +1503,17 @@ void CConnman::ThreadSocketHandler()
                 clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::set<SOCKET> recv_set, send_set, error_set;
+        SocketEvents(recv_set, send_set, error_set);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket) > 0)
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1333,9 +1544,9 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = recv_set.count(pnode->hSocket) > 0;
+                sendSet = send_set.count(pnode->hSocket) > 0;
+                errorSet = error_set.count(pnode->hSocket) > 0;
             }
             if (recvSet || errorSet)
             {
@@ -1348,6 +1559,9 @@ void CConnman::ThreadSocketHandler()
                         continue;
                     nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                 }
+                // A short read drains a stream socket; wait for the next edge
+                if (nBytes > 0 && (size_t)nBytes < sizeof(pchBuf))
+                    pnode->fSocketReadable = false;
                 if (nBytes > 0)
                 {
                     bool notify = false;
@@ -1383,6 +1597,8 @@ void CConnman::ThreadSocketHandler()
                 {
                     // error
                     int nErr = WSAGetLastError();
+                    if (nErr == WSAEWOULDBLOCK)
+                        pnode->fSocketReadable = false;
                     if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                     {
                         if (!pnode->fDisconnect)
@@ -2205,6 +2421,10 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nReceiveFloodSize = 0;
     flagInterruptMsgProc = false;
     SetTryNewOutboundPeer(false);
+#ifdef USE_EPOLL
+    epollfd = -1;
+    wakeupfd = -1;
+#endif
 
     Options connOptions;
     Init(connOptions);
@@ -2334,6 +2554,18 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         fMsgProcWake = false;
     }
 
+#ifdef USE_EPOLL
+    if (!StartSocketEvents()) {
+        StopSocketEvents();
+        if (clientInterface) {
+            clientInterface->ThreadSafeMessageBox(
+                _("Failed to set up the network event loop."),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+        return false;
+    }
+#endif
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2389,6 +2621,7 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    WakeSocketHandler();
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2416,6 +2649,9 @@ void CConnman::Stop()
         threadDNSAddressSeed.join();
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
+#ifdef USE_EPOLL
+    StopSocketEvents();
+#endif
 
     if (fAddressesInitialized)
     {
@@ -2742,6 +2978,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nextSendTimeFeeFilter = 0;
     fPauseRecv = false;
     fPauseSend = false;
+    fSocketReadable = true;
+    fSocketWritable = true;
+    fSocketRegistered = false;
     nProcessQueueSize = 0;
 
     for (const std::string &msg : getAllNetMessageTypes())
@@ -2814,6 +3053,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
     size_t nBytesSent = 0;
+    bool fWakeSocketHandler = false;
     {
         LOCK(pnode->cs_vSend);
         bool optimisticSend(pnode->vSendMsg.empty());
@@ -2831,7 +3071,12 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
             nBytesSent = SocketSendData(pnode);
+        // Data is queued for a socket that can take it: let the socket
+        // handler send it now rather than after its next timeout
+        fWakeSocketHandler = !pnode->vSendMsg.empty() && pnode->fSocketWritable;
     }
+    if (fWakeSocketHandler)
+        WakeSocketHandler();
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
 }
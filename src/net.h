@@ -28,6 +28,7 @@
 #include <thread>
 #include <memory>
 #include <condition_variable>
+#include <set>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -314,6 +315,8 @@ public:
     unsigned int GetReceiveFloodSize() const;
 
     void WakeMessageHandler();
+    /** Interrupt the socket handler's wait for socket events (no-op for the select() backend). */
+    void WakeSocketHandler();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -331,6 +334,12 @@ private:
     void ThreadOpenConnections(std::vector<std::string> connect);
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    /** Wait for socket events and return the sockets to receive from, send to and check for errors. */
+    void SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#ifdef USE_EPOLL
+    bool StartSocketEvents();
+    void StopSocketEvents();
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -427,6 +436,13 @@ private:
 
     CThreadInterrupt interruptNet;
 
+#ifdef USE_EPOLL
+    /** epoll instance holding a persistent edge-triggered registration for each peer socket */
+    int epollfd;
+    /** eventfd registered with epollfd, written by WakeSocketHandler() */
+    int wakeupfd;
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
@@ -518,6 +534,29 @@ extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
+/** Command under which messages of unknown type are accounted */
+const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
+/** Key under which later passes over getdata requests queued by an earlier message are timed */
+const static std::string NET_MESSAGE_COMMAND_GETDATA_QUEUED = "*getdata-queued*";
+
+/** Upper bounds (exclusive), in microseconds, of the buckets of message processing time histograms but the last */
+static const int64_t MSG_PROCESSING_HISTOGRAM_BOUNDS[] = {100, 1000, 10000, 100000, 1000000};
+static const size_t MSG_PROCESSING_HISTOGRAM_SIZE = sizeof(MSG_PROCESSING_HISTOGRAM_BOUNDS) / sizeof(MSG_PROCESSING_HISTOGRAM_BOUNDS[0]) + 1;
+
+/** Time the message handler thread spent on messages of one type, in microseconds */
+struct CMsgProcessingStats
+{
+    uint64_t nCount = 0;
+    int64_t nTime = 0;
+    /** Part of nTime during which cs_main was held */
+    int64_t nLockTime = 0;
+    int64_t nMaxTime = 0;
+    uint64_t vHistogram[MSG_PROCESSING_HISTOGRAM_SIZE] = {};
+
+    void Add(int64_t nTimeIn, int64_t nLockTimeIn);
+};
+typedef std::map<std::string, CMsgProcessingStats> mapMsgCmdProcessing;
+
 class CNodeStats
 {
 public:
@@ -538,6 +577,8 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdProcessing mapProcessingPerMsgCmd;
+    CMsgProcessingStats sendProcessing;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -660,12 +701,23 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Readiness of hSocket as reported by edge-triggered socket events. Set
+    // when an edge arrives and cleared once a read or write would block.
+    bool fSocketReadable; // only accessed by the socket handler thread
+    bool fSocketWritable; // protected by cs_vSend
+    bool fSocketRegistered; // only accessed by the socket handler thread
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
 
 public:
+    CCriticalSection cs_processingStats;
+    // Time spent by the message handler on this peer, per received command
+    // and in SendMessages. Protected by cs_processingStats.
+    mapMsgCmdProcessing mapProcessingPerMsgCmd;
+    CMsgProcessingStats sendProcessing;
+
     uint256 hashContinue;
     std::atomic<int> nStartingHeight;
 
@@ -25,12 +25,14 @@
 #include <scheduler.h>
 #include <tinyformat.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <utilmoneystr.h>
 #include <utilstrencodings.h>
 
 #include <memory>
+#include <unordered_map>
 
 #if defined(NDEBUG)
 # error "Kevacoin cannot be compiled without assertions."
@@ -38,28 +40,35 @@
 
 std::atomic<int64_t> nTimeBestReceived(0); // Used only to inform the wallet of when we last received a block
 
-struct IteratorComparator
-{
-    template<typename I>
-    bool operator()(const I& a, const I& b) const
-    {
-        return &(*a) < &(*b);
-    }
-};
-
 struct COrphanTx {
     // When modifying, adapt the copy of this definition in tests/DoS_tests.
     CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    size_t nUsage;
+    size_t list_pos;
+};
+struct COrphanPeerUsage {
+    unsigned int nCount;
+    size_t nUsage;
 };
 static CCriticalSection g_cs_orphans;
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
-std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
+// Entries of the hashed maps below are never moved on rehash, so the pointers
+// kept in mapOrphanTransactionsByPrev and g_orphan_list stay valid until the
+// orphan is erased.
+std::unordered_map<uint256, COrphanTx, SaltedTxidHasher> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+std::unordered_map<COutPoint, std::set<const COrphanTx*>, SaltedOutpointHasher> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
+/** Orphans in no particular order, for uniform random eviction */
+static std::vector<COrphanTx*> g_orphan_list GUARDED_BY(g_cs_orphans);
+/** Number and memory usage of the orphans announced by each peer */
+static std::map<NodeId, COrphanPeerUsage> mapOrphanPeerUsage GUARDED_BY(g_cs_orphans);
+/** Total memory usage of all orphans */
+size_t nOrphanTxUsage GUARDED_BY(g_cs_orphans) = 0;
 void EraseOrphansFor(NodeId peer);
 
-static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
-static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
+/** Transactions that are not in the mempool but may show up in blocks, oldest first */
+static std::deque<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
+static size_t nExtraTxnForCompactBytes GUARDED_BY(g_cs_orphans) = 0;
 
 static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SHA256("main address relay")[0:8]
 
@@ -108,6 +117,9 @@ namespace {
     std::unique_ptr<CRollingBloomFilter> recentRejects;
     uint256 hashRecentRejectsChainTip;
 
+    /** Compact block reconstruction statistics. Protected by cs_main. */
+    CCompactBlockStats compactBlockStats;
+
     /** Blocks that are in flight, and that are in the queue to be downloaded. Protected by cs_main. */
     struct QueuedBlock {
         uint256 hash;
@@ -137,6 +149,51 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /** Set reconciliation state of the peers that negotiated it. Null unless -txreconciliation is set. */
+    std::unique_ptr<TxReconciliationTracker> g_txreconciliation;
+
+    /** Message handler time spent on all peers together. */
+    CCriticalSection cs_processingStats;
+    mapMsgCmdProcessing mapProcessingPerMsgCmd GUARDED_BY(cs_processingStats);
+    CMsgProcessingStats sendProcessing GUARDED_BY(cs_processingStats);
+
+    /**
+     * Measures the time spent in its scope and how long cs_main was held in
+     * it, and accounts it to a peer and to the node wide totals: under the
+     * given command, or as SendMessages time if there is none.
+     */
+    class CProcessingTimer
+    {
+    private:
+        CNode* const pnode;
+        const std::string* const pstrCommand;
+        const int64_t nTimeStart;
+        const int64_t nLockTimeStart;
+
+    public:
+        CProcessingTimer(CNode* pnodeIn, const std::string* pstrCommandIn)
+            : pnode(pnodeIn), pstrCommand(pstrCommandIn), nTimeStart(GetTimeMicros()), nLockTimeStart(GetLockHoldTime()) {}
+
+        ~CProcessingTimer()
+        {
+            const int64_t nTime = GetTimeMicros() - nTimeStart;
+            const int64_t nLockTime = GetLockHoldTime() - nLockTimeStart;
+            {
+                LOCK(pnode->cs_processingStats);
+                (pstrCommand ? pnode->mapProcessingPerMsgCmd[*pstrCommand] : pnode->sendProcessing).Add(nTime, nLockTime);
+            }
+            LOCK(cs_processingStats);
+            (pstrCommand ? mapProcessingPerMsgCmd[*pstrCommand] : sendProcessing).Add(nTime, nLockTime);
+        }
+    };
+
+    /** The command to account a message under, so that peers cannot make up new entries. */
+    const std::string& GetProcessingCommand(const std::string& strCommand)
+    {
+        static const std::set<std::string> setKnownCommands(getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+        return setKnownCommands.count(strCommand) ? strCommand : NET_MESSAGE_COMMAND_OTHER;
+    }
 } // namespace
 
 namespace {
@@ -596,6 +653,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    if (g_txreconciliation) g_txreconciliation->ForgetPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -626,9 +684,25 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.fTxReconciliation = g_txreconciliation && g_txreconciliation->IsPeerRegistered(nodeid);
     return true;
 }
 
+void GetMessageProcessingStats(mapMsgCmdProcessing &mapPerMsgCmd, CMsgProcessingStats &sendProcessingOut)
+{
+    LOCK(cs_processingStats);
+    mapPerMsgCmd = mapProcessingPerMsgCmd;
+    sendProcessingOut = sendProcessing;
+}
+
+void GetCompactBlockStats(CCompactBlockStats &stats)
+{
+    LOCK2(cs_main, g_cs_orphans);
+    stats = compactBlockStats;
+    stats.nExtraPoolTxs = vExtraTxnForCompact.size();
+    stats.nExtraPoolBytes = nExtraTxnForCompactBytes;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -636,13 +710,38 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
 
 void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 {
-    size_t max_extra_txn = gArgs.GetArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN);
-    if (max_extra_txn <= 0)
+    // The pool is bounded by memory rather than by count, so that a few
+    // large (e.g. keva) transactions cannot push out many small ones and
+    // small ones are not limited by the worst case size.
+    const size_t max_extra_bytes = std::max((int64_t)0, gArgs.GetArg("-blockreconstructionextratxnsize", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN_SIZE)) * 1000000;
+    const size_t tx_bytes = RecursiveDynamicUsage(tx);
+    if (tx_bytes > max_extra_bytes)
         return;
-    if (!vExtraTxnForCompact.size())
-        vExtraTxnForCompact.resize(max_extra_txn);
-    vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
-    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
+    vExtraTxnForCompact.emplace_back(tx->GetWitnessHash(), tx);
+    nExtraTxnForCompactBytes += tx_bytes;
+    while (nExtraTxnForCompactBytes > max_extra_bytes) {
+        nExtraTxnForCompactBytes -= RecursiveDynamicUsage(vExtraTxnForCompact.front().second);
+        vExtraTxnForCompact.pop_front();
+    }
+}
+
+static unsigned int GetMaxOrphanTxs()
+{
+    return (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+}
+
+static size_t GetMaxOrphanTxUsage()
+{
+    return std::max((int64_t)0, gArgs.GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE)) * 1000000;
+}
+
+static unsigned int GetMaxPeerOrphanTxs()
+{
+    // Orphans deeper than the ancestor limit could never enter the mempool,
+    // so there is no point in letting a peer keep more than that.
+    static_assert(MIN_PEER_ORPHAN_TRANSACTIONS <= DEFAULT_ANCESTOR_LIMIT, "orphans beyond the ancestor limit are useless");
+    const uint64_t nMaxOrphans = GetMaxOrphanTxs();
+    return std::min(nMaxOrphans, std::max((uint64_t)MIN_PEER_ORPHAN_TRANSACTIONS, nMaxOrphans * MAX_PEER_ORPHAN_SHARE / 100));
 }
 
 bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
@@ -656,8 +755,8 @@ bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRE
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 100 orphans, each of which is at most 99,999 bytes big is
-    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    // The pool as a whole is bounded by -maxorphantxsize, so this only keeps
+    // a single orphan from taking up a large part of it.
     unsigned int sz = GetTransactionWeight(*tx);
     if (sz >= MAX_STANDARD_TX_WEIGHT)
     {
@@ -665,33 +764,69 @@ bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRE
         return false;
     }
 
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
+    // A single peer may only use its share of the pool, so that it cannot
+    // flush out the orphans of everyone else by announcing many of its own.
+    // The count share never drops below what a chain of transactions relayed
+    // out of order needs, up to the ancestor limit, since those all arrive
+    // from the same peer. It never exceeds the pool itself either.
+    const size_t nUsage = RecursiveDynamicUsage(tx);
+    COrphanPeerUsage& peerUsage = mapOrphanPeerUsage[peer];
+    if (peerUsage.nCount + 1 > GetMaxPeerOrphanTxs() ||
+        (uint64_t)(peerUsage.nUsage + nUsage) * 100 > (uint64_t)GetMaxOrphanTxUsage() * MAX_PEER_ORPHAN_SHARE) {
+        LogPrint(BCLog::MEMPOOL, "ignoring orphan tx %s, peer=%d is over its orphan quota (%u txn, %u kB)\n",
+                 hash.ToString(), peer, peerUsage.nCount, peerUsage.nUsage / 1000);
+        if (peerUsage.nCount == 0) mapOrphanPeerUsage.erase(peer);
+        return false;
+    }
+
+    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, nUsage, g_orphan_list.size()});
     assert(ret.second);
+    COrphanTx* orphan = &ret.first->second;
+    g_orphan_list.push_back(orphan);
     for (const CTxIn& txin : tx->vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
+        mapOrphanTransactionsByPrev[txin.prevout].insert(orphan);
     }
+    peerUsage.nCount++;
+    peerUsage.nUsage += nUsage;
+    nOrphanTxUsage += nUsage;
 
     AddToCompactExtraTransactions(tx);
 
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u, %u kB)\n", hash.ToString(),
+             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(), nOrphanTxUsage / 1000);
     return true;
 }
 
 int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 {
-    std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
+    auto it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return 0;
-    for (const CTxIn& txin : it->second.tx->vin)
+    COrphanTx& orphan = it->second;
+    for (const CTxIn& txin : orphan.tx->vin)
     {
         auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
         if (itPrev == mapOrphanTransactionsByPrev.end())
             continue;
-        itPrev->second.erase(it);
+        itPrev->second.erase(&orphan);
         if (itPrev->second.empty())
             mapOrphanTransactionsByPrev.erase(itPrev);
     }
+
+    // Fill the hole in g_orphan_list with its last entry.
+    COrphanTx* last = g_orphan_list.back();
+    g_orphan_list[orphan.list_pos] = last;
+    last->list_pos = orphan.list_pos;
+    g_orphan_list.pop_back();
+
+    auto itPeer = mapOrphanPeerUsage.find(orphan.fromPeer);
+    assert(itPeer != mapOrphanPeerUsage.end());
+    itPeer->second.nCount--;
+    itPeer->second.nUsage -= orphan.nUsage;
+    if (itPeer->second.nCount == 0)
+        mapOrphanPeerUsage.erase(itPeer);
+    nOrphanTxUsage -= orphan.nUsage;
+
     mapOrphanTransactions.erase(it);
     return 1;
 }
@@ -699,21 +834,26 @@ int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 void EraseOrphansFor(NodeId peer)
 {
     LOCK(g_cs_orphans);
+    // Most peers never announce an orphan; avoid walking the pool for them.
+    if (!mapOrphanPeerUsage.count(peer))
+        return;
     int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
+    for (size_t i = 0; i < g_orphan_list.size(); )
     {
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
+        const COrphanTx* orphan = g_orphan_list[i];
+        if (orphan->fromPeer == peer)
         {
-            nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
+            // Erasing moves the last entry into position i.
+            nErased += EraseOrphanTx(orphan->tx->GetHash());
+        } else {
+            ++i;
         }
     }
     if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
 }
 
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphanUsage)
 {
     LOCK(g_cs_orphans);
 
@@ -724,28 +864,26 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
         // Sweep out expired orphan pool entries:
         int nErased = 0;
         int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-        while (iter != mapOrphanTransactions.end())
+        for (size_t i = 0; i < g_orphan_list.size(); )
         {
-            std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-            if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
+            const COrphanTx* orphan = g_orphan_list[i];
+            if (orphan->nTimeExpire <= nNow) {
+                nErased += EraseOrphanTx(orphan->tx->GetHash());
             } else {
-                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+                nMinExpTime = std::min(orphan->nTimeExpire, nMinExpTime);
+                ++i;
             }
         }
         // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
         nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
         if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
     }
-    while (mapOrphanTransactions.size() > nMaxOrphans)
+    FastRandomContext rng;
+    while (mapOrphanTransactions.size() > nMaxOrphans || nOrphanTxUsage > nMaxOrphanUsage)
     {
         // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
+        size_t randompos = rng.randrange(g_orphan_list.size());
+        EraseOrphanTx(g_orphan_list[randompos]->tx->GetHash());
         ++nEvicted;
     }
     return nEvicted;
@@ -799,6 +937,11 @@ static bool BlockRequestAllowed(const CBlockIndex* pindex, const Consensus::Para
 PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &scheduler) : connman(connmanIn), m_stale_tip_check_time(0) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    // Attribute the time cs_main is held to the messages being processed.
+    g_profiled_lock = &cs_main;
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION_ENABLE)) {
+        g_txreconciliation.reset(new TxReconciliationTracker());
+    }
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
@@ -822,7 +965,7 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
             auto itByPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
             if (itByPrev == mapOrphanTransactionsByPrev.end()) continue;
             for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                const CTransaction& orphanTx = *(*mi)->second.tx;
+                const CTransaction& orphanTx = *(*mi)->tx;
                 const uint256& orphanHash = orphanTx.GetHash();
                 vOrphanErase.push_back(orphanHash);
             }
@@ -849,7 +992,26 @@ static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
 
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
+    // Transactions that did not make it into our mempool (for instance keva
+    // updates rejected by policy) are most likely missing from our peers'
+    // mempools as well, so send them along rather than have every peer ask
+    // for them in another round trip.
+    std::vector<size_t> prefill;
+    {
+        LOCK(mempool.cs);
+        size_t nPrefillSize = 0;
+        for (size_t i = 1; i < pblock->vtx.size(); i++) {
+            const CTransaction& tx = *pblock->vtx[i];
+            if (mempool.exists(tx.GetHash()))
+                continue;
+            const size_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            if (nPrefillSize + nTxSize > MAX_CMPCTBLOCK_PREFILL_SIZE)
+                continue;
+            nPrefillSize += nTxSize;
+            prefill.push_back(i);
+        }
+    }
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true, prefill);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
@@ -1490,6 +1652,22 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
     return true;
 }
 
+/** Announce transactions that were queued for reconciliation with a peer. */
+static void PushReconciledInventory(CNode* pto, const std::vector<uint256>& vTxs, const CNetMsgMaker& msgMaker, CConnman* connman)
+{
+    std::vector<CInv> vInv;
+    vInv.reserve(std::min<size_t>(vTxs.size(), MAX_INV_SZ));
+    for (const uint256& hash : vTxs) {
+        vInv.push_back(CInv(MSG_TX, hash));
+        if (vInv.size() == MAX_INV_SZ) {
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty())
+        connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -1760,6 +1938,19 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             nCMPCTBLOCKVersion = 1;
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
         }
+        if (g_txreconciliation && fRelayTxes && pfrom->nVersion >= TXRECONCILIATION_PROTO_VERSION) {
+            // Offer to relay transactions by set reconciliation rather than
+            // by flooding invs. It is only used if the peer offers it too.
+            bool fPeerRelaysTxes;
+            {
+                LOCK(pfrom->cs_filter);
+                fPeerRelaysTxes = pfrom->fRelayTxes;
+            }
+            if (fPeerRelaysTxes) {
+                uint64_t nSalt = g_txreconciliation->PreRegisterPeer(pfrom->GetId());
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDRECON, TXRECONCILIATION_VERSION, nSalt));
+            }
+        }
         pfrom->fSuccessfullyConnected = true;
     }
 
@@ -1851,6 +2042,69 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
+    else if (strCommand == NetMsgType::SENDRECON)
+    {
+        uint32_t nReconVersion = 0;
+        uint64_t nRemoteSalt = 0;
+        vRecv >> nReconVersion >> nRemoteSalt;
+        // Ignored unless we offered reconciliation to this peer ourselves.
+        if (g_txreconciliation && g_txreconciliation->RegisterPeer(pfrom->GetId(), pfrom->fInbound, nReconVersion, nRemoteSalt)) {
+            LogPrint(BCLog::NET, "peer=%d relays transactions by set reconciliation (version %u)\n", pfrom->GetId(), nReconVersion);
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::REQRECON)
+    {
+        uint16_t nRemoteSetSize = 0;
+        vRecv >> nRemoteSetSize;
+        TxReconSketch sketch;
+        if (!g_txreconciliation || !g_txreconciliation->HandleReconciliationRequest(pfrom->GetId(), nRemoteSetSize, sketch)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            LogPrint(BCLog::NET, "unexpected reqrecon from peer=%d\n", pfrom->GetId());
+            return true;
+        }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+    }
+
+
+    else if (strCommand == NetMsgType::SKETCH)
+    {
+        TxReconSketch sketch;
+        vRecv >> sketch;
+        bool fSuccess = false;
+        std::vector<uint256> vAnnounce;
+        std::vector<uint32_t> vRequest;
+        if (!g_txreconciliation || !g_txreconciliation->HandleSketch(pfrom->GetId(), sketch, fSuccess, vAnnounce, vRequest)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            LogPrint(BCLog::NET, "unexpected sketch from peer=%d\n", pfrom->GetId());
+            return true;
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d %s (%u cells), announcing %u txs, requesting %u\n",
+                 pfrom->GetId(), fSuccess ? "succeeded" : "failed", sketch.GetCells(), vAnnounce.size(), vRequest.size());
+        PushReconciledInventory(pfrom, vAnnounce, msgMaker, connman);
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, fSuccess, vRequest));
+    }
+
+
+    else if (strCommand == NetMsgType::RECONCILDIFF)
+    {
+        bool fSuccess = false;
+        std::vector<uint32_t> vRequested;
+        vRecv >> fSuccess >> vRequested;
+        std::vector<uint256> vAnnounce;
+        if (!g_txreconciliation || !g_txreconciliation->HandleReconciliationDifference(pfrom->GetId(), fSuccess, vRequested, vAnnounce)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            LogPrint(BCLog::NET, "unexpected reconcildiff from peer=%d\n", pfrom->GetId());
+            return true;
+        }
+        PushReconciledInventory(pfrom, vAnnounce, msgMaker, connman);
+    }
+
+
     else if (strCommand == NetMsgType::INV)
     {
         std::vector<CInv> vInv;
@@ -2115,7 +2369,6 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
 
         std::deque<COutPoint> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
         CTransactionRef ptx;
         vRecv >> ptx;
         const CTransaction& tx = *ptx;
@@ -2148,21 +2401,29 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 tx.GetHash().ToString(),
                 mempool.size(), mempool.DynamicMemoryUsage() / 1000);
 
-            // Recursively process any orphan transactions that depended on this one
+            // Recursively process any orphan transactions that depended on this one.
+            // Outputs of every orphan accepted on the way are queued as well, so
+            // a whole chain of orphans is resolved here. Orphans are erased as
+            // soon as they are resolved, so that one spending several outputs
+            // of the same parent is only validated once.
             std::set<NodeId> setMisbehaving;
+            std::vector<std::pair<CTransactionRef, NodeId>> vChildren;
             while (!vWorkQueue.empty()) {
                 auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
                 vWorkQueue.pop_front();
                 if (itByPrev == mapOrphanTransactionsByPrev.end())
                     continue;
-                for (auto mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
+                // Resolving an orphan modifies the entry, so work on a copy.
+                vChildren.clear();
+                for (const COrphanTx* orphan : itByPrev->second) {
+                    vChildren.emplace_back(orphan->tx, orphan->fromPeer);
+                }
+                for (const auto& child : vChildren)
                 {
-                    const CTransactionRef& porphanTx = (*mi)->second.tx;
+                    const CTransactionRef& porphanTx = child.first;
                     const CTransaction& orphanTx = *porphanTx;
                     const uint256& orphanHash = orphanTx.GetHash();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
+                    NodeId fromPeer = child.second;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
                     // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
@@ -2172,13 +2433,15 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
                     if (setMisbehaving.count(fromPeer))
                         continue;
+                    if (!mapOrphanTransactions.count(orphanHash))
+                        continue;
                     if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, &fMissingInputs2, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
                         LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
                         RelayTransaction(orphanTx, connman);
                         for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
                             vWorkQueue.emplace_back(orphanHash, i);
                         }
-                        vEraseQueue.push_back(orphanHash);
+                        EraseOrphanTx(orphanHash);
                     }
                     else if (!fMissingInputs2)
                     {
@@ -2193,7 +2456,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                         // Has inputs but not accepted to mempool
                         // Probably non-standard or insufficient fee
                         LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
+                        EraseOrphanTx(orphanHash);
                         if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
                             // Do not use rejection cache for witness transactions or
                             // witness-stripped transactions, as they can have been malleated.
@@ -2205,9 +2468,6 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     mempool.check(pcoinsTip.get());
                 }
             }
-
-            for (uint256 hash : vEraseQueue)
-                EraseOrphanTx(hash);
         }
         else if (fMissingInputs)
         {
@@ -2228,8 +2488,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 AddOrphanTx(ptx, pfrom->GetId());
 
                 // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                unsigned int nEvicted = LimitOrphanTxSize(GetMaxOrphanTxs(), GetMaxOrphanTxUsage());
                 if (nEvicted > 0) {
                     LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
                 }
@@ -2412,6 +2671,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     return true;
                 } else if (status == READ_STATUS_FAILED) {
                     // Duplicate txindexes, the block is now in-flight, so just request it
+                    compactBlockStats.nBlocks++;
+                    compactBlockStats.nFailed++;
                     std::vector<CInv> vInv(1);
                     vInv[0] = CInv(MSG_BLOCK | GetFetchFlags(pfrom), cmpctblock.header.GetHash());
                     connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
@@ -2423,13 +2684,20 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     if (!partialBlock.IsTxAvailable(i))
                         req.indexes.push_back(i);
                 }
+                compactBlockStats.nBlocks++;
+                compactBlockStats.nTxPrefilled += partialBlock.GetPrefilledCount();
+                compactBlockStats.nTxMempool += partialBlock.GetMempoolCount();
+                compactBlockStats.nTxExtra += partialBlock.GetExtraCount();
                 if (req.indexes.empty()) {
+                    compactBlockStats.nReconstructed++;
                     // Dirty hack to jump to BLOCKTXN code (TODO: move message handling into their own functions)
                     BlockTransactions txn;
                     txn.blockhash = cmpctblock.header.GetHash();
                     blockTxnMsg << txn;
                     fProcessBLOCKTXN = true;
                 } else {
+                    compactBlockStats.nRoundTrips++;
+                    compactBlockStats.nTxRequested += req.indexes.size();
                     req.blockhash = pindex->GetBlockHash();
                     connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
                 }
@@ -2540,6 +2808,13 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 return true;
             } else if (status == READ_STATUS_FAILED) {
                 // Might have collided, fall back to getdata now :(
+                // The block was counted when its cmpctblock came in; move it
+                // over so that the outcomes still add up to nBlocks.
+                if (resp.txn.empty())
+                    compactBlockStats.nReconstructed--;
+                else
+                    compactBlockStats.nRoundTrips--;
+                compactBlockStats.nFailed++;
                 std::vector<CInv> invs;
                 invs.push_back(CInv(MSG_BLOCK | GetFetchFlags(pfrom), resp.blockhash));
                 connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, invs));
@@ -2897,8 +3172,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     //
     bool fMoreWork = false;
 
-    if (!pfrom->vRecvGetData.empty())
+    // The getdata message itself was counted when it was processed; the
+    // passes over what it left queued are timed under their own key.
+    if (!pfrom->vRecvGetData.empty()) {
+        CProcessingTimer timer(pfrom, &NET_MESSAGE_COMMAND_GETDATA_QUEUED);
         ProcessGetData(pfrom, chainparams.GetConsensus(), connman, interruptMsgProc);
+    }
 
     if (pfrom->fDisconnect)
         return false;
@@ -2911,6 +3190,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return false;
 
     std::list<CNetMessage> msgs;
+    bool fWasPaused;
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
@@ -2918,9 +3198,13 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        fWasPaused = pfrom->fPauseRecv;
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
+    // Resume reading from the socket without waiting for the next socket event
+    if (fWasPaused && !pfrom->fPauseRecv)
+        connman->WakeSocketHandler();
     CNetMessage& msg(msgs.front());
 
     msg.SetVersion(pfrom->GetRecvVersion());
@@ -2957,6 +3241,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     // Process message
     bool fRet = false;
+    CProcessingTimer timer(pfrom, &GetProcessingCommand(strCommand));
     try
     {
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
@@ -3153,6 +3438,7 @@ public:
 
 bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptMsgProc)
 {
+    CProcessingTimer timer(pto, nullptr);
     const Consensus::Params& consensusParams = Params().GetConsensus();
     {
         // Don't send anything until the version handshake is complete
@@ -3494,6 +3780,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
+                // Peers that negotiated reconciliation get transactions through
+                // their reconciliation set instead, unless it is full.
+                const bool fReconcile = g_txreconciliation && g_txreconciliation->IsPeerRegistered(pto->GetId());
                 LOCK(pto->cs_filter);
                 while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
@@ -3517,7 +3806,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     }
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                     // Send
-                    vInv.push_back(CInv(MSG_TX, hash));
+                    if (!fReconcile || !g_txreconciliation->AddToSet(pto->GetId(), hash)) {
+                        vInv.push_back(CInv(MSG_TX, hash));
+                    }
                     nRelayedTransactions++;
                     {
                         // Expire old relay messages
@@ -3543,6 +3834,19 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reconciliation request
+        //
+        std::vector<uint256> vReconTimedOut;
+        if (g_txreconciliation && g_txreconciliation->CheckSketchTimeout(pto->GetId(), nNow, vReconTimedOut)) {
+            LogPrint(BCLog::NET, "reconciliation with peer=%d timed out, announcing %u txs\n", pto->GetId(), vReconTimedOut.size());
+            PushReconciledInventory(pto, vReconTimedOut, msgMaker, connman);
+        }
+        uint16_t nReconSetSize = 0;
+        if (g_txreconciliation && g_txreconciliation->InitiateReconciliationRequest(pto->GetId(), nNow, nReconSetSize)) {
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, nReconSetSize));
+        }
+
         // Detect whether we're stalling
         nNow = GetTimeMicros();
         if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -3690,5 +3994,8 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        g_orphan_list.clear();
+        mapOrphanPeerUsage.clear();
+        nOrphanTxUsage = 0;
     }
 } instance_of_cnetprocessingcleanup;
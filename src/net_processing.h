@@ -12,12 +12,20 @@
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphantxsize, maximum memory (in MB) used by orphan transactions */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE = 5;
+/** Maximum share (in percent) of the orphan pool count and memory limits a single peer may use */
+static const unsigned int MAX_PEER_ORPHAN_SHARE = 25;
+/** Number of orphan transactions a single peer may have even below its share, enough for a chain as deep as the default ancestor limit; never more than the whole pool */
+static const unsigned int MIN_PEER_ORPHAN_TRANSACTIONS = 25;
 /** Expiration time for orphan transactions in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 /** Minimum time between orphan transactions expire time checks in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
-/** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
-static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Default for -blockreconstructionextratxnsize, maximum memory (in MB) of orphan, rejected and recently-replaced txn to keep around for block reconstruction */
+static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN_SIZE = 10;
+/** Maximum total size of the transactions besides the coinbase that are prefilled in compact blocks we announce */
+static const unsigned int MAX_CMPCTBLOCK_PREFILL_SIZE = 20000;
 /** Headers download timeout expressed in microseconds
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
@@ -76,10 +84,29 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    bool fTxReconciliation;
 };
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+
+struct CCompactBlockStats {
+    uint64_t nBlocks = 0;           //!< compact blocks we downloaded, each counted in one of:
+    uint64_t nReconstructed = 0;    //!< ... of which all transactions were available
+    uint64_t nRoundTrips = 0;       //!< ... for which we had to send getblocktxn
+    uint64_t nFailed = 0;           //!< ... for which we fell back to requesting the full block
+    uint64_t nTxPrefilled = 0;      //!< transactions prefilled by the sender
+    uint64_t nTxMempool = 0;        //!< transactions found in the mempool
+    uint64_t nTxExtra = 0;          //!< transactions found in the extra pool
+    uint64_t nTxRequested = 0;      //!< transactions requested with getblocktxn
+    size_t nExtraPoolTxs = 0;       //!< current size of the extra pool
+    size_t nExtraPoolBytes = 0;     //!< current memory usage of the extra pool
+};
+
+/** Get statistics about compact block reconstruction */
+void GetCompactBlockStats(CCompactBlockStats &stats);
+/** Get the time the message handler spent on each message type and in SendMessages, for all peers together */
+void GetMessageProcessingStats(mapMsgCmdProcessing &mapPerMsgCmd, CMsgProcessingStats &sendProcessing);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
@@ -14,6 +14,11 @@
 
 static constexpr double INF_FEERATE = 1e99;
 
+/** Format of the estimates written by CBlockPolicyEstimator::Write.  They
+ *  go to a file of their own, so clients knowing only the older format
+ *  never see them. */
+static constexpr int FLAT_FILE_FORMAT = 1;
+
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
         {FeeEstimateHorizon::SHORT_HALFLIFE, "short"},
@@ -76,6 +81,11 @@ private:
     const std::vector<double>& buckets;              // The upper-bound of the range for the bucket (inclusive)
     const std::map<double, unsigned int>& bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    // The moving averages below are stored divided by decayFactor, the
+    // product of the decays applied since they were last normalized. Decaying
+    // all of them for a new block then only takes a multiplication of
+    // decayFactor, instead of a pass over every bucket and period.
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
@@ -83,11 +93,11 @@ private:
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Y * buckets + X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Y * buckets + X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -98,6 +108,12 @@ private:
 
     double decay;
 
+    // Scale of the stored moving averages, see above
+    double decayFactor;
+
+    // Number of periods confirmations are tracked for
+    unsigned int maxPeriods;
+
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
@@ -110,6 +126,11 @@ private:
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Apply decayFactor to the stored moving averages and reset it to 1 */
+    void Normalize();
+
+    size_t NumBuckets() const { return txCtAvg.size(); }
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -159,7 +180,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * maxPeriods; }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -168,26 +189,25 @@ public:
      * Read saved state of estimation data from a file and replace all internal data structures and
      * variables with this state.
      */
-    void Read(CAutoFile& filein, int nFileVersion, size_t numBuckets);
+    void Read(CAutoFile& filein, bool fLegacy, size_t numBuckets);
+
+    /** Read state written by a version before the flat file format */
+    void ReadLegacy(CAutoFile& filein, size_t numBuckets);
 };
 
 
 TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
                                 const std::map<double, unsigned int>& defaultBucketMap,
-                               unsigned int maxPeriods, double _decay, unsigned int _scale)
+                               unsigned int _maxPeriods, double _decay, unsigned int _scale)
     : buckets(defaultBuckets), bucketMap(defaultBucketMap)
 {
     decay = _decay;
+    decayFactor = 1;
     assert(_scale != 0 && "_scale must be non-zero");
     scale = _scale;
-    confAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-    }
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        failAvg[i].resize(buckets.size());
-    }
+    maxPeriods = _maxPeriods;
+    confAvg.resize(maxPeriods * buckets.size());
+    failAvg.resize(maxPeriods * buckets.size());
 
     txCtAvg.resize(buckets.size());
     avg.resize(buckets.size());
@@ -221,23 +241,30 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    const size_t nBuckets = NumBuckets();
+    const double increment = 1 / decayFactor;
+    for (size_t i = periodsToConfirm; i <= maxPeriods; i++) {
+        confAvg[(i - 1) * nBuckets + bucketindex] += increment;
     }
-    txCtAvg[bucketindex]++;
-    avg[bucketindex] += val;
+    txCtAvg[bucketindex] += increment;
+    avg[bucketindex] += val * increment;
 }
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
-        avg[j] = avg[j] * decay;
-        txCtAvg[j] = txCtAvg[j] * decay;
-    }
+    decayFactor *= decay;
+    // Keep the stored values well within the range of a double
+    if (decayFactor < 1e-100)
+        Normalize();
+}
+
+void TxConfirmStats::Normalize()
+{
+    for (double& v : confAvg) v *= decayFactor;
+    for (double& v : failAvg) v *= decayFactor;
+    for (double& v : avg) v *= decayFactor;
+    for (double& v : txCtAvg) v *= decayFactor;
+    decayFactor = 1;
 }
 
 // returns -1 on error conditions
@@ -251,6 +278,8 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     int extraNum = 0;  // Number of tx's still in mempool for confTarget or longer
     double failNum = 0; // Number of tx's that were never confirmed but removed from the mempool after confTarget
     int periodTarget = (confTarget + scale - 1)/scale;
+    const double* confRow = &confAvg[(periodTarget - 1) * NumBuckets()];
+    const double* failRow = &failAvg[(periodTarget - 1) * NumBuckets()];
 
     int maxbucketindex = buckets.size() - 1;
 
@@ -285,9 +314,9 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        nConf += confRow[bucket] * decayFactor;
+        totalNum += txCtAvg[bucket] * decayFactor;
+        failNum += failRow[bucket] * decayFactor;
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -344,6 +373,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     // and reporting the average which is less accurate
     unsigned int minBucket = std::min(bestNearBucket, bestFarBucket);
     unsigned int maxBucket = std::max(bestNearBucket, bestFarBucket);
+    // (the scale of txCtAvg does not matter here)
     for (unsigned int j = minBucket; j <= maxBucket; j++) {
         txSum += txCtAvg[j];
     }
@@ -396,29 +426,41 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
     fileout << decay;
+    fileout << decayFactor;
     fileout << scale;
+    fileout << maxPeriods;
     fileout << avg;
     fileout << txCtAvg;
     fileout << confAvg;
     fileout << failAvg;
 }
 
-void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
+void TxConfirmStats::Read(CAutoFile& filein, bool fLegacy, size_t numBuckets)
 {
     // Read data file and do some very basic sanity checking
     // buckets and bucketMap are not updated yet, so don't access them
     // If there is a read failure, we'll just discard this entire object anyway
-    size_t maxConfirms, maxPeriods;
+    if (fLegacy) {
+        ReadLegacy(filein, numBuckets);
+        return;
+    }
 
-    // The current version will store the decay with each individual TxConfirmStats and also keep a scale factor
     filein >> decay;
     if (decay <= 0 || decay >= 1) {
         throw std::runtime_error("Corrupt estimates file. Decay must be between 0 and 1 (non-inclusive)");
     }
+    filein >> decayFactor;
+    if (!(decayFactor > 0 && decayFactor <= 1)) {
+        throw std::runtime_error("Corrupt estimates file. Decay factor must be between 0 and 1");
+    }
     filein >> scale;
     if (scale == 0) {
         throw std::runtime_error("Corrupt estimates file. Scale must be non-zero");
     }
+    filein >> maxPeriods;
+    if (maxPeriods == 0 || scale * maxPeriods > 6 * 24 * 7) { // one week
+        throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
+    }
 
     filein >> avg;
     if (avg.size() != numBuckets) {
@@ -429,28 +471,79 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
     filein >> confAvg;
-    maxPeriods = confAvg.size();
+    if (confAvg.size() != maxPeriods * numBuckets) {
+        throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
+    }
+    filein >> failAvg;
+    if (failAvg.size() != maxPeriods * numBuckets) {
+        throw std::runtime_error("Corrupt estimates file. Mismatch in failure average bucket count");
+    }
+
+    // Resize the current block variables which aren't stored in the data file
+    // to match the number of confirms and buckets
+    resizeInMemoryCounters(numBuckets);
+
+    LogPrint(BCLog::ESTIMATEFEE, "Reading estimates: %u buckets counting confirms up to %u blocks\n",
+             numBuckets, GetMaxConfirms());
+}
+
+void TxConfirmStats::ReadLegacy(CAutoFile& filein, size_t numBuckets)
+{
+    // Read data file and do some very basic sanity checking
+    // buckets and bucketMap are not updated yet, so don't access them
+    // If there is a read failure, we'll just discard this entire object anyway
+    size_t maxConfirms;
+    std::vector<std::vector<double>> fileConfAvg, fileFailAvg;
+
+    // The current version will store the decay with each individual TxConfirmStats and also keep a scale factor
+    filein >> decay;
+    if (decay <= 0 || decay >= 1) {
+        throw std::runtime_error("Corrupt estimates file. Decay must be between 0 and 1 (non-inclusive)");
+    }
+    filein >> scale;
+    if (scale == 0) {
+        throw std::runtime_error("Corrupt estimates file. Scale must be non-zero");
+    }
+
+    filein >> avg;
+    if (avg.size() != numBuckets) {
+        throw std::runtime_error("Corrupt estimates file. Mismatch in feerate average bucket count");
+    }
+    filein >> txCtAvg;
+    if (txCtAvg.size() != numBuckets) {
+        throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
+    }
+    filein >> fileConfAvg;
+    maxPeriods = fileConfAvg.size();
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
+        if (fileConfAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
         }
     }
 
-    filein >> failAvg;
-    if (maxPeriods != failAvg.size()) {
+    filein >> fileFailAvg;
+    if (maxPeriods != fileFailAvg.size()) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (failAvg[i].size() != numBuckets) {
+        if (fileFailAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
         }
     }
 
+    confAvg.clear();
+    failAvg.clear();
+    for (unsigned int i = 0; i < maxPeriods; i++) {
+        confAvg.insert(confAvg.end(), fileConfAvg[i].begin(), fileConfAvg[i].end());
+        failAvg.insert(failAvg.end(), fileFailAvg[i].begin(), fileFailAvg[i].end());
+    }
+    decayFactor = 1;
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -498,8 +591,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+        for (size_t i = 0; i < periodsAgo && i < maxPeriods; i++) {
+            failAvg[i * NumBuckets() + bucketindex] += 1 / decayFactor;
         }
     }
 }
@@ -514,6 +607,10 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     LOCK(cs_feeEstimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
+        // Transactions from the current height are not looked at by any
+        // estimate yet, see TxConfirmStats::EstimateMedianVal
+        if (pos->second.blockHeight != nBestSeenHeight)
+            nEstimatesGeneration++;
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
@@ -525,7 +622,7 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
 }
 
 CBlockPolicyEstimator::CBlockPolicyEstimator()
-    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
+    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0), nEstimatesGeneration(0)
 {
     static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
     size_t bucketIndex = 0;
@@ -629,6 +726,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
+    nEstimatesGeneration++;
 
     // Update unconfirmed circular buffer
     feeStats->ClearCurrent(nBlockHeight);
@@ -821,6 +919,34 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
 {
     LOCK(cs_feeEstimator);
 
+    // Answer repeated queries from the cache until the underlying data changes
+    std::vector<CachedEstimate>& cache = smartFeeCache[conservative];
+    if (confTarget > 0 && (unsigned int)confTarget < cache.size()) {
+        const CachedEstimate& cached = cache[confTarget];
+        if (cached.generation == nEstimatesGeneration) {
+            if (feeCalc) *feeCalc = cached.feeCalc;
+            return cached.feeRate;
+        }
+    }
+
+    FeeCalculation tempCalc;
+    CFeeRate feeRate = estimateSmartFeeUncached(confTarget, &tempCalc, conservative);
+    if (feeCalc) *feeCalc = tempCalc;
+
+    if (confTarget > 0 && (unsigned int)confTarget <= longStats->GetMaxConfirms()) {
+        if (cache.size() <= (unsigned int)confTarget)
+            cache.resize(longStats->GetMaxConfirms() + 1);
+        cache[confTarget].generation = nEstimatesGeneration;
+        cache[confTarget].feeRate = feeRate;
+        cache[confTarget].feeCalc = tempCalc;
+    }
+    return feeRate;
+}
+
+CFeeRate CBlockPolicyEstimator::estimateSmartFeeUncached(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
+    AssertLockHeld(cs_feeEstimator);
+
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
@@ -900,7 +1026,7 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
     try {
         LOCK(cs_feeEstimator);
-        fileout << 149900; // version required to read: 0.14.99 or later
+        fileout << FLAT_FILE_FORMAT;
         fileout << CLIENT_VERSION; // version that wrote the file
         fileout << nBestSeenHeight;
         if (BlockSpan() > HistoricalBlockSpan()/2) {
@@ -921,13 +1047,15 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
     return true;
 }
 
-bool CBlockPolicyEstimator::Read(CAutoFile& filein)
+bool CBlockPolicyEstimator::Read(CAutoFile& filein, bool fLegacy)
 {
     try {
         LOCK(cs_feeEstimator);
+        // Legacy files start with the client version required to read them
+        // where newer ones have their format
         int nVersionRequired, nVersionThatWrote;
         filein >> nVersionRequired >> nVersionThatWrote;
-        if (nVersionRequired > CLIENT_VERSION)
+        if (nVersionRequired > (fLegacy ? CLIENT_VERSION : FLAT_FILE_FORMAT))
             return error("CBlockPolicyEstimator::Read(): up-version (%d) fee estimate file", nVersionRequired);
 
         // Read fee estimates file into temporary variables so existing data
@@ -935,7 +1063,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
         unsigned int nFileBestSeenHeight;
         filein >> nFileBestSeenHeight;
 
-        if (nVersionRequired < 149900) {
+        if (fLegacy && nVersionRequired < 149900) {
             LogPrintf("%s: incompatible old fee estimation data (non-fatal). Version: %d\n", __func__, nVersionRequired);
         } else { // New format introduced in 149900
             unsigned int nFileHistoricalFirst, nFileHistoricalBest;
@@ -952,9 +1080,9 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             std::unique_ptr<TxConfirmStats> fileFeeStats(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
             std::unique_ptr<TxConfirmStats> fileShortStats(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
             std::unique_ptr<TxConfirmStats> fileLongStats(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
-            fileFeeStats->Read(filein, nVersionThatWrote, numBuckets);
-            fileShortStats->Read(filein, nVersionThatWrote, numBuckets);
-            fileLongStats->Read(filein, nVersionThatWrote, numBuckets);
+            fileFeeStats->Read(filein, fLegacy, numBuckets);
+            fileShortStats->Read(filein, fLegacy, numBuckets);
+            fileLongStats->Read(filein, fLegacy, numBuckets);
 
             // Fee estimates file parsed correctly
             // Copy buckets from file and refresh our bucketmap
@@ -972,6 +1100,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            nEstimatesGeneration++;
         }
     }
     catch (const std::exception& e) {
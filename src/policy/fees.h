@@ -11,6 +11,7 @@
 #include <random.h>
 #include <sync.h>
 
+#include <limits>
 #include <map>
 #include <memory>
 #include <string>
@@ -220,8 +221,9 @@ public:
     /** Write estimation data to a file */
     bool Write(CAutoFile& fileout) const;
 
-    /** Read estimation data from a file */
-    bool Read(CAutoFile& filein);
+    /** Read estimation data from a file, or from a file in the format
+     *  written before the flat layout if fLegacy */
+    bool Read(CAutoFile& filein, bool fLegacy = false);
 
     /** Empty mempool transactions on shutdown to record failure to confirm for txs still in mempool */
     void FlushUnconfirmed(CTxMemPool& pool);
@@ -253,6 +255,21 @@ private:
     unsigned int trackedTxs;
     unsigned int untrackedTxs;
 
+    /** Changes whenever an estimate could change */
+    uint64_t nEstimatesGeneration;
+
+    struct CachedEstimate
+    {
+        uint64_t generation;
+        CFeeRate feeRate;
+        FeeCalculation feeCalc;
+        CachedEstimate() : generation(std::numeric_limits<uint64_t>::max()) {}
+    };
+
+    /** estimateSmartFee results by target, for non-conservative and
+     *  conservative estimates */
+    mutable std::vector<CachedEstimate> smartFeeCache[2];
+
     std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
@@ -261,6 +278,8 @@ private:
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
 
+    /** Helper for estimateSmartFee */
+    CFeeRate estimateSmartFeeUncached(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
     /** Helper for estimateSmartFee */
     double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
     /** Helper for estimateSmartFee */
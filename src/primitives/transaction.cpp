@@ -82,16 +82,54 @@ uint256 CTransaction::GetWitnessHash() const
     return SerializeHash(*this, SER_GETHASH, 0);
 }
 
+std::shared_ptr<const CKevaTxOps> CTransaction::ParseKevaOps() const
+{
+    std::shared_ptr<CKevaTxOps> ops;
+    for (uint32_t i = 0; i < vout.size(); i++) {
+        const CScript& script = vout[i].scriptPubKey;
+        // Keva scripts start with their operation, skip everything else without parsing.
+        if (script.empty() || script[0] < OP_KEVA_NAMESPACE || script[0] > OP_KEVA_DELETE) {
+            continue;
+        }
+        CKevaScript op(script);
+        if (!op.isKevaOp()) {
+            continue;
+        }
+        if (!ops) {
+            ops = std::make_shared<CKevaTxOps>();
+        }
+        ops->emplace_back(i, std::move(op));
+    }
+    return ops;
+}
+
+const CKevaTxOps& CTransaction::GetKevaOps() const
+{
+    static const CKevaTxOps noKevaOps;
+    return kevaOps ? *kevaOps : noKevaOps;
+}
+
+const CKevaScript* CTransaction::GetKevaOp(uint32_t n) const
+{
+    for (const auto& op : GetKevaOps()) {
+        if (op.first == n) {
+            return &op.second;
+        }
+    }
+    return nullptr;
+}
+
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash() {}
-CTransaction::CTransaction(const CMutableTransaction &tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
-CTransaction::CTransaction(CMutableTransaction &&tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
+CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash(), kevaOps() {}
+CTransaction::CTransaction(const CMutableTransaction &tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash(ComputeHash()), kevaOps(ParseKevaOps()) {}
+CTransaction::CTransaction(CMutableTransaction &&tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash(ComputeHash()), kevaOps(ParseKevaOps()) {}
 
 CAmount CTransaction::GetValueOut(bool fExcludeKeva) const
 {
     CAmount nValueOut = 0;
-    for (const auto& tx_out : vout) {
-        if (!fExcludeKeva || !CKevaScript::isKevaScript(tx_out.scriptPubKey)) {
+    for (uint32_t i = 0; i < vout.size(); i++) {
+        const CTxOut& tx_out = vout[i];
+        if (!fExcludeKeva || !GetKevaOp(i)) {
             nValueOut += tx_out.nValue;
         }
         if (!MoneyRange(tx_out.nValue) || !MoneyRange(nValueOut))
@@ -12,8 +12,17 @@
 #include <serialize.h>
 #include <uint256.h>
 
+#include <memory>
+#include <utility>
+#include <vector>
+
+class CKevaScript;
+
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
 
+/** The keva operations in the outputs of a transaction, with the index of their output. */
+typedef std::vector<std::pair<uint32_t, CKevaScript>> CKevaTxOps;
+
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
 class COutPoint
 {
@@ -287,8 +296,11 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    /** Memory only. Keva operations in vout, parsed once and shared by all copies; null if there are none. */
+    const std::shared_ptr<const CKevaTxOps> kevaOps;
 
     uint256 ComputeHash() const;
+    std::shared_ptr<const CKevaTxOps> ParseKevaOps() const;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -319,6 +331,15 @@ public:
     // Compute a hash that includes both transaction and witness data
     uint256 GetWitnessHash() const;
 
+    /** The keva operations in the outputs, in output order. Empty for most transactions. */
+    const CKevaTxOps& GetKevaOps() const;
+    /** The keva operation of output n, or nullptr if that output is no keva script. */
+    const CKevaScript* GetKevaOp(uint32_t n) const;
+    bool HasKevaOps() const
+    {
+        return static_cast<bool>(kevaOps);
+    }
+
     // Return sum of txouts.
     CAmount GetValueOut(bool fExcludeKeva = false) const;
     // GetValueIn() is a method on CCoinsViewCache, because
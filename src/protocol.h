@@ -237,6 +237,34 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a 4-byte version number and an 8-byte salt.
+ * Indicates that a node is willing to relay transactions by set
+ * reconciliation. Sent by both sides after "verack".
+ * @since protocol version 70016
+ */
+extern const char *SENDRECON;
+/**
+ * Contains the 2-byte size of the sender's reconciliation set.
+ * Requests a "sketch" of the receiver's set. Only sent by the side that
+ * opened the connection.
+ * @since protocol version 70016
+ */
+extern const char *REQRECON;
+/**
+ * Contains a sketch of the short ids of the transactions the sender would
+ * have announced since the last reconciliation. Sent in response to
+ * "reqrecon".
+ * @since protocol version 70016
+ */
+extern const char *SKETCH;
+/**
+ * Contains a 1-byte success flag and the short ids of the transactions the
+ * sender is missing, which the receiver then announces. On failure, the
+ * receiver announces its whole set.
+ * @since protocol version 70016
+ */
+extern const char *RECONCILDIFF;
 };
 
 /* Get a vector of all valid message types (see above) */
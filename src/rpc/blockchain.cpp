@@ -5,7 +5,9 @@
 
 #include <rpc/blockchain.h>
 
+#include <addressindex.h>
 #include <amount.h>
+#include <base58.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -17,6 +19,7 @@
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
+#include <script/standard.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -1166,29 +1169,78 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "With the default \"hash_serialized_2\" hash type, the whole set is scanned, which may take some time.\n"
+            "With -coinstatsindex, the \"muhash\" hash type is also available.  Its statistics are kept up to\n"
+            "date as blocks are connected and disconnected, so it returns immediately and can also report\n"
+            "them as of an earlier block of the active chain.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"   (string, optional, default=\"hash_serialized_2\") Either \"hash_serialized_2\" or \"muhash\"\n"
+            "2. height        (numeric, optional) Return the statistics after the block at this height (\"muhash\" only)\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) The hash of the block at the tip of the chain\n"
-            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (\"hash_serialized_2\" only)\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"muhash\": \"hash\",      (string) The rolling hash of the set (\"muhash\" only)\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (\"hash_serialized_2\" only)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not for past heights)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\" 1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
     UniValue ret(UniValue::VOBJ);
 
+    const std::string hashType = request.params[0].isNull() ? "hash_serialized_2" : request.params[0].get_str();
+    if (hashType == "muhash") {
+        if (!fCoinStatsIndex)
+            throw JSONRPCError(RPC_MISC_ERROR, "UTXO set statistics are not maintained, restart with -coinstatsindex");
+        LOCK(cs_main);
+
+        if (!request.params[1].isNull()) {
+            const int nHeight = request.params[1].get_int();
+            if (nHeight < 0 || nHeight > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+            CBlockCoinsStats blockStats;
+            const CBlockIndex* pindex = chainActive[nHeight];
+            if (!pblocktree->ReadBlockCoinsStats(nHeight, blockStats) || blockStats.hashBlock != pindex->GetBlockHash())
+                throw JSONRPCError(RPC_MISC_ERROR, "No UTXO set statistics for this block");
+
+            ret.push_back(Pair("height", (int64_t)nHeight));
+            ret.push_back(Pair("bestblock", blockStats.hashBlock.GetHex()));
+            ret.push_back(Pair("txouts", blockStats.nTransactionOutputs));
+            ret.push_back(Pair("bogosize", blockStats.nBogoSize));
+            ret.push_back(Pair("muhash", blockStats.hashMuHash.GetHex()));
+            ret.push_back(Pair("total_amount", ValueFromAmount(blockStats.nTotalAmount)));
+            return ret;
+        }
+
+        CCoinsSetStats stats;
+        if (!pcoinsTip->GetCoinsSetStats(stats))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set statistics");
+        ret.push_back(Pair("height", (int64_t)chainActive.Height()));
+        ret.push_back(Pair("bestblock", pcoinsTip->GetBestBlock().GetHex()));
+        ret.push_back(Pair("txouts", stats.nTransactionOutputs));
+        ret.push_back(Pair("bogosize", stats.nBogoSize));
+        ret.push_back(Pair("muhash", stats.GetHash().GetHex()));
+        ret.push_back(Pair("disk_size", (uint64_t)pcoinsdbview->EstimateSize()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        return ret;
+    }
+    if (hashType != "hash_serialized_2")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash type");
+    if (!request.params[1].isNull())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Past heights are only supported with the \"muhash\" hash type");
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview.get(), stats)) {
@@ -1286,6 +1338,185 @@ UniValue gettxout(const JSONRPCRequest& request)
     return ret;
 }
 
+/** Decode an address argument to the hash it is indexed under. */
+static uint160 AddressIndexHashFromParam(const UniValue& param)
+{
+    const CTxDestination dest = DecodeDestination(param.get_str());
+    if (!IsValidDestination(dest))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    return GetAddressIndexHash(GetScriptForDestination(dest));
+}
+
+/** Parse the optional "from" and "nb" paging arguments at the given position. */
+static void PagingFromParams(const JSONRPCRequest& request, size_t pos, size_t& from, size_t& nb)
+{
+    from = 0;
+    nb = 0;
+    if (request.params.size() > pos) {
+        const int n = request.params[pos].get_int();
+        if (n < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "'from' should be non-negative");
+        from = n;
+    }
+    if (request.params.size() > pos + 1) {
+        const int n = request.params[pos + 1].get_int();
+        if (n < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "'nb' should be non-negative");
+        nb = n;
+    }
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getaddressutxos \"address\" ( from nb )\n"
+            "\nReturns the confirmed unspent outputs paying to an address, including keva outputs.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"  (string, required) The address\n"
+            "2. from       (numeric, optional, default=0) Skip this many outputs\n"
+            "3. nb         (numeric, optional, default=0) Return at most this many outputs; 0 means all\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",         (string) The transaction id\n"
+            "    \"vout\" : n,              (numeric) The output number\n"
+            "    \"amount\" : x.xxx,        (numeric) The output value in " + CURRENCY_UNIT + "\n"
+            "    \"scriptPubKey\" : \"hex\",  (string) The output script\n"
+            "    \"height\" : n             (numeric) The height of the block containing the output\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+            + HelpExampleCli("getaddressutxos", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\" 100 100")
+            + HelpExampleRpc("getaddressutxos", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+        );
+
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VNUM, UniValue::VNUM});
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "-addressindex is not enabled");
+
+    const uint160 hashScript = AddressIndexHashFromParam(request.params[0]);
+    size_t from, nb;
+    PagingFromParams(request, 1, from, nb);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > entries;
+    if (!pblocktree->ReadAddressUnspentIndex(hashScript, from, nb, entries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& entry : entries) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", entry.first.outpoint.hash.GetHex()));
+        obj.push_back(Pair("vout", (int)entry.first.outpoint.n));
+        obj.push_back(Pair("amount", ValueFromAmount(entry.second.nValue)));
+        obj.push_back(Pair("scriptPubKey", HexStr(entry.second.scriptPubKey.begin(), entry.second.scriptPubKey.end())));
+        obj.push_back(Pair("height", entry.second.nHeight));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getaddresshistory(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getaddresshistory \"address\" ( from nb )\n"
+            "\nReturns the confirmed outputs paying to an address, including keva outputs, and the\n"
+            "inputs spending them, ordered by height.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"  (string, required) The address\n"
+            "2. from       (numeric, optional, default=0) Skip this many entries\n"
+            "3. nb         (numeric, optional, default=0) Return at most this many entries; 0 means all\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",         (string) The transaction id\n"
+            "    \"index\" : n,             (numeric) The input number if spending, otherwise the output number\n"
+            "    \"spending\" : true|false, (boolean) Whether this is an input spending an output of the address\n"
+            "    \"height\" : n,            (numeric) The height of the block containing the transaction\n"
+            "    \"amount\" : x.xxx         (numeric) The value in " + CURRENCY_UNIT + ", negative if spending\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresshistory", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+            + HelpExampleCli("getaddresshistory", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\" 100 100")
+            + HelpExampleRpc("getaddresshistory", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+        );
+
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VNUM, UniValue::VNUM});
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "-addressindex is not enabled");
+
+    const uint160 hashScript = AddressIndexHashFromParam(request.params[0]);
+    size_t from, nb;
+    PagingFromParams(request, 1, from, nb);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > entries;
+    if (!pblocktree->ReadAddressIndex(hashScript, from, nb, entries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& entry : entries) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", entry.first.txid.GetHex()));
+        obj.push_back(Pair("index", (int)entry.first.nIndex));
+        obj.push_back(Pair("spending", entry.first.fSpending));
+        obj.push_back(Pair("height", entry.first.nHeight));
+        obj.push_back(Pair("amount", ValueFromAmount(entry.second)));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getspentinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw std::runtime_error(
+            "getspentinfo \"txid\" n\n"
+            "\nReturns the confirmed input spending an output.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"txid\"  (string, required) The transaction id\n"
+            "2. n       (numeric, required) The output number\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hash\",  (string) The id of the spending transaction\n"
+            "  \"index\" : n,      (numeric) The input number\n"
+            "  \"height\" : n      (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "\"txid\" 1")
+            + HelpExampleRpc("getspentinfo", "\"txid\", 1")
+        );
+
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VNUM});
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "-addressindex is not enabled");
+
+    const uint256 txid = ParseHashV(request.params[0], "txid");
+    const int n = request.params[1].get_int();
+    if (n < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid output number");
+
+    CSpentIndexValue value;
+    if (!pblocktree->ReadSpentIndex(COutPoint(txid, n), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Output is unspent or unknown");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("txid", value.txid.GetHex()));
+    ret.push_back(Pair("index", (int)value.nInput));
+    ret.push_back(Pair("height", value.nHeight));
+    return ret;
+}
+
 UniValue verifychain(const JSONRPCRequest& request)
 {
     int nCheckLevel = gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL);
@@ -1941,7 +2172,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type","height"} },
+    { "blockchain",         "getaddressutxos",        &getaddressutxos,        {"address","from","nb"} },
+    { "blockchain",         "getaddresshistory",      &getaddresshistory,      {"address","from","nb"} },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           {"txid","n"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -100,6 +100,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "fundrawtransaction", 2, "iswitness" },
     { "gettxout", 1, "n" },
     { "gettxout", 2, "include_mempool" },
+    { "gettxoutsetinfo", 1, "height" },
+    { "getaddressutxos", 1, "from" },
+    { "getaddressutxos", 2, "nb" },
+    { "getaddresshistory", 1, "from" },
+    { "getaddresshistory", 2, "nb" },
+    { "getspentinfo", 1, "n" },
     { "gettxoutproof", 0, "txids" },
     { "lockunspent", 0, "unlock" },
     { "lockunspent", 1, "transactions" },
@@ -144,6 +150,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "rescanblockchain", 0, "start_height"},
     { "rescanblockchain", 1, "stop_height"},
     { "getblockheaderbyheight", 0, "height"},
+    { "keva_history", 2, "from"},
+    { "keva_history", 3, "nb"},
+    { "keva_list_address_namespaces", 1, "from"},
+    { "keva_list_address_namespaces", 2, "nb"},
+    { "keva_search_namespaces", 2, "from"},
+    { "keva_search_namespaces", 3, "nb"},
 };
 
 class CRPCConvertTable
@@ -12,6 +12,7 @@
 #include <consensus/validation.h>
 #include <consensus/merkle.h>
 #include <core_io.h>
+#include <crypto/pow-memory.h>
 #include <init.h>
 #include <validation.h>
 #include <miner.h>
@@ -194,6 +195,19 @@ UniValue generatetoaddress(const JSONRPCRequest& request)
     return generateBlocks(coinbaseScript, nGenerate, nMaxTries, false);
 }
 
+static UniValue PoWMemoryToJSON(enum pow_mem_kind kind)
+{
+    struct pow_mem_stats stats;
+    pow_mem_get_stats(kind, &stats);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("regions",      stats.regions));
+    obj.push_back(Pair("hugepages",    stats.huge_regions));
+    obj.push_back(Pair("bytes",        stats.bytes));
+    obj.push_back(Pair("hugebytes",    stats.huge_bytes));
+    return obj;
+}
+
 UniValue getmininginfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -209,6 +223,17 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"powmemory\": {             (json object) memory held for proof-of-work hashing\n"
+            "    \"largepages\": true|false, (boolean) whether huge pages are requested (see -largepages)\n"
+            "    \"cn_scratchpads\": {       (json object) CryptoNight scratchpads, including reserved ones\n"
+            "      \"regions\": n,           (numeric) number of allocated regions\n"
+            "      \"hugepages\": n,         (numeric) how many of them are backed by huge pages\n"
+            "      \"bytes\": n,             (numeric) total size in bytes\n"
+            "      \"hugebytes\": n          (numeric) size in bytes backed by huge pages\n"
+            "    },\n"
+            "    \"randomx_cache\": {...},   (json object) RandomX caches, same fields\n"
+            "    \"randomx_dataset\": {...}  (json object) RandomX mining dataset, same fields\n"
+            "  },\n"
             "  \"warnings\": \"...\"          (string) any network and blockchain warnings\n"
             "  \"errors\": \"...\"            (string) DEPRECATED. Same as warnings. Only shown when kevacoind is started with -deprecatedrpc=getmininginfo\n"
             "}\n"
@@ -228,6 +253,12 @@ UniValue getmininginfo(const JSONRPCRequest& request)
     obj.push_back(Pair("networkhashps",    getnetworkhashps(request)));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
+    UniValue powmemory(UniValue::VOBJ);
+    powmemory.push_back(Pair("largepages",      (bool)pow_mem_large_pages_enabled()));
+    powmemory.push_back(Pair("cn_scratchpads",  PoWMemoryToJSON(POW_MEM_CN_SCRATCHPAD)));
+    powmemory.push_back(Pair("randomx_cache",   PoWMemoryToJSON(POW_MEM_RX_CACHE)));
+    powmemory.push_back(Pair("randomx_dataset", PoWMemoryToJSON(POW_MEM_RX_DATASET)));
+    obj.push_back(Pair("powmemory",        powmemory));
     if (IsDeprecatedRPCEnabled("getmininginfo")) {
         obj.push_back(Pair("errors",       GetWarnings("statusbar")));
     } else {
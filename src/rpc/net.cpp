@@ -65,6 +65,23 @@ UniValue ping(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue ProcessingStatsToJSON(const CMsgProcessingStats& stats, bool fHistogram)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", stats.nCount));
+    obj.push_back(Pair("time", stats.nTime));
+    obj.push_back(Pair("cs_main_time", stats.nLockTime));
+    obj.push_back(Pair("max_time", stats.nMaxTime));
+    if (fHistogram) {
+        UniValue histogram(UniValue::VARR);
+        for (uint64_t nBucket : stats.vHistogram) {
+            histogram.push_back(nBucket);
+        }
+        obj.push_back(Pair("histogram", histogram));
+    }
+    return obj;
+}
+
 UniValue getpeerinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -101,6 +118,7 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"txreconciliation\": true|false, (boolean) Whether transactions are relayed to the peer by set reconciliation\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -109,6 +127,19 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"bytesrecv_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"proctime\": n,            (numeric) Microseconds the message handler spent on messages from the peer\n"
+            "    \"proctime_cs_main\": n,    (numeric) Of which cs_main was held\n"
+            "    \"sendtime\": n,            (numeric) Microseconds the message handler spent on sending messages to the peer\n"
+            "    \"sendtime_cs_main\": n,    (numeric) Of which cs_main was held\n"
+            "    \"proctime_per_msg\": {\n"
+            "       \"addr\": {             (json object) The processing time aggregated by message type\n"
+            "         \"count\": n,         (numeric) Number of messages processed\n"
+            "         \"time\": n,          (numeric) Total processing time in microseconds\n"
+            "         \"cs_main_time\": n,  (numeric) Of which cs_main was held\n"
+            "         \"max_time\": n       (numeric) Longest processing time of a single message\n"
+            "       },\n"
+            "       ...                     (\"*getdata-queued*\" counts the later passes over queued getdata requests)\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -167,6 +198,7 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("txreconciliation", statestats.fTxReconciliation));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -184,6 +216,19 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        int64_t nProcTime = 0, nProcLockTime = 0;
+        UniValue procPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdProcessing::value_type &i : stats.mapProcessingPerMsgCmd) {
+            nProcTime += i.second.nTime;
+            nProcLockTime += i.second.nLockTime;
+            procPerMsgCmd.push_back(Pair(i.first, ProcessingStatsToJSON(i.second, false)));
+        }
+        obj.push_back(Pair("proctime", nProcTime));
+        obj.push_back(Pair("proctime_cs_main", nProcLockTime));
+        obj.push_back(Pair("sendtime", stats.sendProcessing.nTime));
+        obj.push_back(Pair("sendtime_cs_main", stats.sendProcessing.nLockTime));
+        obj.push_back(Pair("proctime_per_msg", procPerMsgCmd));
+
         ret.push_back(obj);
     }
 
@@ -367,6 +412,36 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"compactblocks\":\n"
+            "  {\n"
+            "    \"blocks\": n,                (numeric) Compact blocks downloaded\n"
+            "    \"reconstructed\": n,         (numeric) Of these, blocks reconstructed without a round trip\n"
+            "    \"roundtrips\": n,            (numeric) Blocks for which missing transactions were requested\n"
+            "    \"failed\": n,                (numeric) Blocks for which the full block was requested instead\n"
+            "    \"hitrate\": x.xxx,           (numeric) Fraction of blocks reconstructed without a round trip\n"
+            "    \"tx_prefilled\": n,          (numeric) Transactions prefilled by the sender\n"
+            "    \"tx_mempool\": n,            (numeric) Transactions found in the mempool\n"
+            "    \"tx_extra\": n,              (numeric) Transactions found in the extra pool of orphan, rejected and replaced transactions\n"
+            "    \"tx_requested\": n,          (numeric) Transactions requested from the sender\n"
+            "    \"extrapool_size\": n,        (numeric) Current number of transactions in the extra pool\n"
+            "    \"extrapool_bytes\": n        (numeric) Current memory usage of the extra pool\n"
+            "  },\n"
+            "  \"msgprocessing\":\n"
+            "  {\n"
+            "    \"histogram_bounds\": [ n, ... ], (array) Upper bounds in microseconds of the histogram buckets but the last\n"
+            "    \"sendmessages\": {...},      (json object) Time spent on sending messages to all peers, as below\n"
+            "    \"per_msg\":\n"
+            "    {\n"
+            "      \"addr\": {                 (json object) Time spent on received messages of this type, for all peers\n"
+            "        \"count\": n,             (numeric) Number of messages processed\n"
+            "        \"time\": n,              (numeric) Total processing time in microseconds\n"
+            "        \"cs_main_time\": n,      (numeric) Of which cs_main was held\n"
+            "        \"max_time\": n,          (numeric) Longest processing time of a single message\n"
+            "        \"histogram\": [ n, ... ] (array) Number of messages by processing time\n"
+            "      },\n"
+            "      ...                       (\"*getdata-queued*\" counts the later passes over queued getdata requests)\n"
+            "    }\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -389,6 +464,39 @@ UniValue getnettotals(const JSONRPCRequest& request)
     outboundLimit.push_back(Pair("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft()));
     outboundLimit.push_back(Pair("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle()));
     obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    CCompactBlockStats cmpctStats;
+    GetCompactBlockStats(cmpctStats);
+    UniValue cmpct(UniValue::VOBJ);
+    cmpct.push_back(Pair("blocks", cmpctStats.nBlocks));
+    cmpct.push_back(Pair("reconstructed", cmpctStats.nReconstructed));
+    cmpct.push_back(Pair("roundtrips", cmpctStats.nRoundTrips));
+    cmpct.push_back(Pair("failed", cmpctStats.nFailed));
+    cmpct.push_back(Pair("hitrate", cmpctStats.nBlocks ? (double)cmpctStats.nReconstructed / cmpctStats.nBlocks : 0.0));
+    cmpct.push_back(Pair("tx_prefilled", cmpctStats.nTxPrefilled));
+    cmpct.push_back(Pair("tx_mempool", cmpctStats.nTxMempool));
+    cmpct.push_back(Pair("tx_extra", cmpctStats.nTxExtra));
+    cmpct.push_back(Pair("tx_requested", cmpctStats.nTxRequested));
+    cmpct.push_back(Pair("extrapool_size", (uint64_t)cmpctStats.nExtraPoolTxs));
+    cmpct.push_back(Pair("extrapool_bytes", (uint64_t)cmpctStats.nExtraPoolBytes));
+    obj.push_back(Pair("compactblocks", cmpct));
+
+    mapMsgCmdProcessing mapProcessingPerMsgCmd;
+    CMsgProcessingStats sendProcessing;
+    GetMessageProcessingStats(mapProcessingPerMsgCmd, sendProcessing);
+    UniValue msgProcessing(UniValue::VOBJ);
+    UniValue bounds(UniValue::VARR);
+    for (int64_t nBound : MSG_PROCESSING_HISTOGRAM_BOUNDS) {
+        bounds.push_back(nBound);
+    }
+    msgProcessing.push_back(Pair("histogram_bounds", bounds));
+    msgProcessing.push_back(Pair("sendmessages", ProcessingStatsToJSON(sendProcessing, true)));
+    UniValue perMsgCmd(UniValue::VOBJ);
+    for (const mapMsgCmdProcessing::value_type &i : mapProcessingPerMsgCmd) {
+        perMsgCmd.push_back(Pair(i.first, ProcessingStatsToJSON(i.second, true)));
+    }
+    msgProcessing.push_back(Pair("per_msg", perMsgCmd));
+    obj.push_back(Pair("msgprocessing", msgProcessing));
     return obj;
 }
 
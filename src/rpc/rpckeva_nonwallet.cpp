@@ -6,17 +6,21 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "base58.h"
 #include "coins.h"
 #include "init.h"
 #include "keva/common.h"
 #include "keva/main.h"
+#include "keva/registry.h"
 #include "primitives/transaction.h"
 #include "random.h"
 #include "rpc/mining.h"
 #include "rpc/safemode.h"
 #include "rpc/server.h"
 #include "script/keva.h"
+#include "script/standard.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "validation.h"
@@ -293,11 +297,303 @@ UniValue keva_filter(const JSONRPCRequest& request)
   return keys;
 }
 
+UniValue keva_history(const JSONRPCRequest& request)
+{
+  if (request.fHelp || request.params.size() < 2 || request.params.size() > 4)
+    throw std::runtime_error(
+        "keva_history \"namespace\" \"key\" (\"from\" (\"nb\"))\n"
+        "\nList the values the key has had, oldest first.  The last entry is the\n"
+        "key's current value unless the key has been deleted.\n"
+        "Requires -kevahistory.\n"
+        "\nArguments:\n"
+        "1. \"namespace\"   (string, required) namespace Id\n"
+        "2. \"key\"         (string, required) the key to look up\n"
+        "3. \"from\"        (numeric, optional, default=0) return from this position onward; index starts at 0\n"
+        "4. \"nb\"          (numeric, optional, default=0) return only \"nb\" entries; 0 means all\n"
+        "\nResult:\n"
+        "[\n"
+        + getKevaInfoHelp ("  ", ",") +
+        "  ...\n"
+        "]\n"
+        "\nExamples:\n"
+        + HelpExampleCli ("keva_history", "\"namespace_id\" \"key\"")
+        + HelpExampleCli ("keva_history", "\"namespace_id\" \"key\" 10 10")
+        + HelpExampleRpc ("keva_history", "\"namespace_id\", \"key\"")
+      );
+
+  RPCTypeCheck(request.params, {
+                  UniValue::VSTR, UniValue::VSTR, UniValue::VNUM, UniValue::VNUM
+               });
+
+  if (!fNameHistory)
+    throw JSONRPCError(RPC_MISC_ERROR, "-kevahistory is not enabled");
+
+  ObserveSafeMode();
+
+  const std::string namespaceStr = request.params[0].get_str();
+  valtype nameSpace;
+  if (!DecodeKevaNamespace(namespaceStr, Params(), nameSpace)) {
+    throw JSONRPCError (RPC_INVALID_PARAMETER, "invalid namespace id");
+  }
+
+  const valtype key = ValtypeFromString(request.params[1].get_str());
+  if (key.size() > MAX_KEY_LENGTH)
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "the key is too long");
+
+  int from(0), nb(0);
+  if (request.params.size() >= 3)
+    from = request.params[2].get_int();
+  if (from < 0)
+    throw JSONRPCError (RPC_INVALID_PARAMETER, "'from' should be non-negative");
+
+  if (request.params.size() >= 4)
+    nb = request.params[3].get_int();
+  if (nb < 0)
+    throw JSONRPCError (RPC_INVALID_PARAMETER, "'nb' should be non-negative");
+
+  CKevaData data;
+  CNameHistory history;
+  bool haveData;
+  {
+    LOCK (cs_main);
+    haveData = pcoinsTip->GetName(nameSpace, key, data);
+    pcoinsTip->GetNameHistory(nameSpace, key, history);
+  }
+
+  const std::vector<CKevaData>& entries = history.getData();
+  const size_t total = entries.size() + (haveData ? 1 : 0);
+  size_t end = total;
+  if (nb > 0)
+    end = std::min<size_t>(end, static_cast<size_t>(from) + nb);
+
+  UniValue res(UniValue::VARR);
+  for (size_t i = from; i < end; ++i) {
+    if (i < entries.size())
+      res.push_back(getKevaInfo(key, entries[i]));
+    else
+      res.push_back(getKevaInfo(key, data));
+  }
+
+  return res;
+}
+
+UniValue keva_setinfo(const JSONRPCRequest& request)
+{
+  if (request.fHelp || request.params.size() != 0)
+    throw std::runtime_error(
+        "keva_setinfo\n"
+        "\nReturn statistics about the keva state and a commitment to it.\n"
+        "This is maintained incrementally and does not scan the database.\n"
+        "\nResult:\n"
+        "{\n"
+        "  \"height\": n,           (numeric) the current block height\n"
+        "  \"bestblock\": \"hex\",    (string) the best block hash\n"
+        "  \"keys\": n,             (numeric) the number of keys, including namespace entries\n"
+        "  \"value_bytes\": n,      (numeric) the total size of all values\n"
+        "  \"keva_coins\": n,       (numeric) the number of unspent keva outputs\n"
+        "  \"commitment\": \"hex\",   (string) the rolling hash of all keys and keva outputs\n"
+        "}\n"
+        "\nExamples:\n"
+        + HelpExampleCli ("keva_setinfo", "")
+        + HelpExampleRpc ("keva_setinfo", "")
+      );
+
+  LOCK (cs_main);
+
+  CKevaSetInfo info;
+  if (!pcoinsTip->GetKevaSetInfo(info))
+    throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the keva set summary");
+
+  UniValue res(UniValue::VOBJ);
+  res.pushKV("height", chainActive.Height());
+  res.pushKV("bestblock", pcoinsTip->GetBestBlock().GetHex());
+  res.pushKV("keys", info.nKeys);
+  res.pushKV("value_bytes", info.nValueBytes);
+  res.pushKV("keva_coins", info.nCoins);
+  res.pushKV("commitment", info.getCommitment().GetHex());
+  return res;
+}
+
+UniValue keva_list_address_namespaces(const JSONRPCRequest& request)
+{
+  if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+    throw std::runtime_error(
+        "keva_list_address_namespaces \"address\" (\"from\" (\"nb\"))\n"
+        "\nList the namespaces whose current keva output pays to the address.\n"
+        "Requires -addressindex.\n"
+        "\nArguments:\n"
+        "1. \"address\"     (string, required) the address\n"
+        "2. \"from\"        (numeric, optional, default=0) return from this position onward; index starts at 0\n"
+        "3. \"nb\"          (numeric, optional, default=0) return only \"nb\" entries; 0 means all\n"
+        "\nResult:\n"
+        "[\n"
+        "  {\n"
+        "    \"namespaceId\": xxxxx,   (string) the namespace id\n"
+        "    \"displayName\": xxxxx,   (string) the display name of the namespace\n"
+        "    \"txid\": xxxxx,          (string) the txid of the namespace's keva output\n"
+        "    \"vout\": n,              (numeric) the output number\n"
+        "    \"height\": n             (numeric) the height of the keva output\n"
+        "  },\n"
+        "  ...\n"
+        "]\n"
+        "\nExamples:\n"
+        + HelpExampleCli ("keva_list_address_namespaces", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+        + HelpExampleCli ("keva_list_address_namespaces", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\" 10 10")
+        + HelpExampleRpc ("keva_list_address_namespaces", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+      );
+
+  RPCTypeCheck(request.params, {
+                  UniValue::VSTR, UniValue::VNUM, UniValue::VNUM
+               });
+
+  if (!fAddressIndex)
+    throw JSONRPCError(RPC_MISC_ERROR, "-addressindex is not enabled");
+
+  ObserveSafeMode();
+
+  const CTxDestination dest = DecodeDestination(request.params[0].get_str());
+  if (!IsValidDestination(dest))
+    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+  const uint160 hashScript = GetAddressIndexHash(GetScriptForDestination(dest));
+
+  int from(0), nb(0);
+  if (request.params.size() >= 2)
+    from = request.params[1].get_int();
+  if (from < 0)
+    throw JSONRPCError (RPC_INVALID_PARAMETER, "'from' should be non-negative");
+
+  if (request.params.size() >= 3)
+    nb = request.params[2].get_int();
+  if (nb < 0)
+    throw JSONRPCError (RPC_INVALID_PARAMETER, "'nb' should be non-negative");
+
+  /* The index is read under cs_main, so that it matches the keva data
+     looked up below.  Only keva outputs are collected (and paged over)
+     while iterating the database.  */
+  LOCK (cs_main);
+  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > entries;
+  if (!pblocktree->ReadAddressKevaUnspentIndex(hashScript, from, nb, entries))
+    throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+
+  UniValue res(UniValue::VARR);
+  for (const auto& entry : entries) {
+    const CKevaScript kevaOp(entry.second.scriptPubKey);
+    const valtype& nameSpace = kevaOp.getOpNamespace();
+    CKevaData data;
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("namespaceId", EncodeBase58Check(nameSpace));
+    if (pcoinsTip->GetNamespace(nameSpace, data))
+      obj.pushKV("displayName", ValtypeToString(data.getValue()));
+    obj.pushKV("txid", entry.first.outpoint.hash.GetHex());
+    obj.pushKV("vout", static_cast<int>(entry.first.outpoint.n));
+    obj.pushKV("height", entry.second.nHeight);
+    res.push_back(obj);
+  }
+
+  return res;
+}
+
+UniValue keva_search_namespaces(const JSONRPCRequest& request)
+{
+  if (request.fHelp || request.params.size() < 1 || request.params.size() > 4)
+    throw std::runtime_error(
+        "keva_search_namespaces \"query\" (\"mode\" (\"from\" (\"nb\")))\n"
+        "\nSearch the namespace registry.  Display names are matched case-insensitively,\n"
+        "and only their first " + std::to_string(MAX_REGISTRY_SEARCH_LENGTH) + " bytes are indexed for substring searches.\n"
+        "Requires -kevaregistry.\n"
+        "\nArguments:\n"
+        "1. \"query\"       (string, required) the text to search for, or the owner address\n"
+        "2. \"mode\"        (string, optional, default=\"prefix\") \"prefix\" for display names starting with\n"
+        "                   the query (an empty query lists all namespaces), \"substring\" for display names\n"
+        "                   containing it (at least 3 bytes), or \"owner\" for the namespaces owned by an address\n"
+        "3. \"from\"        (numeric, optional, default=0) return from this position onward; index starts at 0\n"
+        "4. \"nb\"          (numeric, optional, default=0) return only \"nb\" entries; 0 means all\n"
+        "\nResult:\n"
+        "[\n"
+        "  {\n"
+        "    \"namespaceId\": xxxxx,   (string) the namespace id\n"
+        "    \"displayName\": xxxxx,   (string) the display name of the namespace\n"
+        "    \"height\": n,            (numeric) the height at which the namespace was registered\n"
+        "    \"owner\": xxxxx          (string) the address the namespace's keva output pays to\n"
+        "  },\n"
+        "  ...\n"
+        "]\n"
+        "\nExamples:\n"
+        + HelpExampleCli ("keva_search_namespaces", "\"news\"")
+        + HelpExampleCli ("keva_search_namespaces", "\"blog\" \"substring\" 0 10")
+        + HelpExampleRpc ("keva_search_namespaces", "\"news\"")
+      );
+
+  RPCTypeCheck(request.params, {
+                  UniValue::VSTR, UniValue::VSTR, UniValue::VNUM, UniValue::VNUM
+               });
+
+  if (!fKevaRegistry)
+    throw JSONRPCError(RPC_MISC_ERROR, "-kevaregistry is not enabled");
+
+  ObserveSafeMode();
+
+  const std::string query = request.params[0].get_str();
+  const std::string mode = request.params.size() >= 2 ? request.params[1].get_str() : "prefix";
+
+  int from(0), nb(0);
+  if (request.params.size() >= 3)
+    from = request.params[2].get_int();
+  if (from < 0)
+    throw JSONRPCError (RPC_INVALID_PARAMETER, "'from' should be non-negative");
+
+  if (request.params.size() >= 4)
+    nb = request.params[3].get_int();
+  if (nb < 0)
+    throw JSONRPCError (RPC_INVALID_PARAMETER, "'nb' should be non-negative");
+
+  std::vector<valtype> namespaces;
+  bool ok;
+  if (mode == "prefix") {
+    ok = pblocktree->SearchKevaRegistryPrefix(ValtypeFromString(query), from, nb, namespaces);
+  } else if (mode == "substring") {
+    if (query.size() < 3)
+      throw JSONRPCError(RPC_INVALID_PARAMETER, "the query should be at least 3 bytes long");
+    ok = pblocktree->SearchKevaRegistrySubstring(ValtypeFromString(query), from, nb, namespaces);
+  } else if (mode == "owner") {
+    const CTxDestination dest = DecodeDestination(query);
+    if (!IsValidDestination(dest))
+      throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    ok = pblocktree->SearchKevaRegistryOwner(GetScriptForDestination(dest), from, nb, namespaces);
+  } else {
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "unknown search mode");
+  }
+  if (!ok)
+    throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the namespace registry");
+
+  UniValue res(UniValue::VARR);
+  for (const valtype& nameSpace : namespaces) {
+    CKevaRegistryEntry entry;
+    if (!pblocktree->ReadKevaRegistryEntry(nameSpace, entry))
+      continue;
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("namespaceId", EncodeBase58Check(nameSpace));
+    obj.pushKV("displayName", ValtypeToString(entry.displayName));
+    obj.pushKV("height", entry.nHeight);
+    CTxDestination dest;
+    if (ExtractDestination(entry.owner, dest))
+      obj.pushKV("owner", EncodeDestination(dest));
+    res.push_back(obj);
+  }
+
+  return res;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "kevacoin",           "keva_get",              &keva_get,              {"namespace", "key"} },
-    { "kevacoin",           "keva_filter",           &keva_filter,           {"namespace", "regexp", "from", "nb", "stat"} }
+    { "kevacoin",           "keva_filter",           &keva_filter,           {"namespace", "regexp", "from", "nb", "stat"} },
+    { "kevacoin",           "keva_history",          &keva_history,          {"namespace", "key", "from", "nb"} },
+    { "kevacoin",           "keva_setinfo",          &keva_setinfo,          {} },
+    { "kevacoin",           "keva_list_address_namespaces", &keva_list_address_namespaces, {"address", "from", "nb"} },
+    { "kevacoin",           "keva_search_namespaces", &keva_search_namespaces, {"query", "mode", "from", "nb"} }
 };
 
 void RegisterKevaRPCCommands(CRPCTable &t)
@@ -8,11 +8,12 @@
 
 #include <script/keva.h>
 #include <hash.h>
+#include <memusage.h>
 
 const std::string CKevaScript::KEVA_DISPLAY_NAME_KEY = "_KEVA_NS_";
 
-CKevaScript::CKevaScript (const CScript& script)
-  : op(OP_NOP), address(script)
+CKevaScriptView::CKevaScriptView (const CScript& script)
+  : op(OP_NOP), address(script.data(), script.size())
 {
   opcodetype nameOp;
   CScript::const_iterator pc = script.begin();
@@ -20,11 +21,13 @@ CKevaScript::CKevaScript (const CScript& script)
     return;
   }
 
+  /* Record where the pushed data is instead of copying it.  A push
+     opcode is followed by up to four bytes holding the data size.  */
+  unsigned nArgs = 0;
   opcodetype opcode;
   while (true) {
-    valtype vch;
-
-    if (!script.GetOp(pc, opcode, vch)) {
+    const CScript::const_iterator pcOp = pc;
+    if (!script.GetOp(pc, opcode)) {
       return;
     }
     if (opcode == OP_DROP || opcode == OP_2DROP || opcode == OP_NOP) {
@@ -34,7 +37,14 @@ CKevaScript::CKevaScript (const CScript& script)
       return;
     }
 
-    args.push_back (vch);
+    if (nArgs < MAX_ARGS) {
+      const unsigned nSizeBytes = opcode < OP_PUSHDATA1 ? 0
+                                    : opcode == OP_PUSHDATA1 ? 1
+                                    : opcode == OP_PUSHDATA2 ? 2 : 4;
+      args[nArgs] = Span<const unsigned char>(script.data() + (pcOp - script.begin()) + 1 + nSizeBytes,
+                                              script.data() + (pc - script.begin()));
+    }
+    ++nArgs;
   }
 
   // Move the pc to after any DROP or NOP.
@@ -50,19 +60,19 @@ CKevaScript::CKevaScript (const CScript& script)
      op and address members, if everything is valid.  */
   switch (nameOp) {
     case OP_KEVA_PUT:
-      if (args.size() != 3) {
+      if (nArgs != 3) {
         return;
       }
       break;
 
     case OP_KEVA_DELETE:
-      if (args.size() != 2) {
+      if (nArgs != 2) {
         return;
       }
       break;
 
     case OP_KEVA_NAMESPACE:
-      if (args.size() != 2) {
+      if (nArgs != 2) {
         return;
       }
       break;
@@ -72,7 +82,33 @@ CKevaScript::CKevaScript (const CScript& script)
   }
 
   op = nameOp;
-  address = CScript(pc, script.end());
+  address = Span<const unsigned char>(script.data() + (pc - script.begin()), script.data() + script.size());
+}
+
+CKevaScript::CKevaScript (const CScript& script)
+  : op(OP_NOP)
+{
+  const CKevaScriptView view(script);
+  if (!view.isKevaOp()) {
+    address = script;
+    return;
+  }
+
+  for (unsigned i = 0; i < view.getArgCount(); ++i) {
+    const Span<const unsigned char> arg = view.getArg(i);
+    args.emplace_back(arg.begin(), arg.end());
+  }
+  op = view.getKevaOp();
+  address = view.getAddress();
+}
+
+size_t
+CKevaScript::DynamicMemoryUsage() const
+{
+  size_t usage = memusage::DynamicUsage(address) + memusage::DynamicUsage(args);
+  for (const valtype& arg : args)
+    usage += memusage::DynamicUsage(arg);
+  return usage;
 }
 
 CScript
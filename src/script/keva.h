@@ -8,9 +8,129 @@
 #include <uint256.h>
 #include <chainparams.h>
 #include <script/script.h>
+#include <span.h>
 
 class uint160;
 
+/**
+ * A non-owning view of a keva script.  It classifies a script the same way
+ * as CKevaScript, but only records where the operation's arguments and the
+ * address are in the script's bytes, so that it never allocates.  The view
+ * must not outlive the script it was created from.
+ */
+class CKevaScriptView
+{
+
+public:
+
+  /** Maximum number of arguments of a keva operation.  */
+  static const unsigned MAX_ARGS = 3;
+
+private:
+
+  /** The type of operation.  OP_NOP if no (valid) keva op.  */
+  opcodetype op;
+
+  /** The non-keva part, i. e., the address.  */
+  Span<const unsigned char> address;
+
+  /** The operation arguments.  */
+  Span<const unsigned char> args[MAX_ARGS];
+
+public:
+
+  inline CKevaScriptView()
+    : op(OP_NOP)
+  {}
+
+  /**
+   * Parse a script and determine whether it is a valid keva script.
+   * @param script The ordinary script to parse.
+   */
+  explicit CKevaScriptView(const CScript& script);
+
+  inline bool isKevaOp() const
+  {
+    return op != OP_NOP;
+  }
+
+  /**
+   * Return the keva operation.  Do not call if this is not a keva script.
+   * @return The keva operation opcode.
+   */
+  inline opcodetype getKevaOp() const
+  {
+    assert(isKevaOp());
+    return op;
+  }
+
+  inline bool isNamespaceRegistration() const
+  {
+    return getKevaOp() == OP_KEVA_NAMESPACE;
+  }
+
+  inline bool isAnyUpdate() const
+  {
+    return getKevaOp() != OP_KEVA_NAMESPACE;
+  }
+
+  inline bool isDelete() const
+  {
+    return op == OP_KEVA_DELETE;
+  }
+
+  /** Number of arguments of the operation, 2 or 3.  */
+  inline unsigned getArgCount() const
+  {
+    return getKevaOp() == OP_KEVA_PUT ? 3 : 2;
+  }
+
+  inline Span<const unsigned char> getArg(unsigned i) const
+  {
+    assert(i < getArgCount());
+    return args[i];
+  }
+
+  inline Span<const unsigned char> getOpNamespace() const
+  {
+    return getArg(0);
+  }
+
+  inline Span<const unsigned char> getOpNamespaceDisplayName() const
+  {
+    assert(isNamespaceRegistration());
+    return args[1];
+  }
+
+  inline Span<const unsigned char> getOpKey() const
+  {
+    assert(isAnyUpdate());
+    return args[1];
+  }
+
+  inline Span<const unsigned char> getOpValue() const
+  {
+    assert(getKevaOp() == OP_KEVA_PUT);
+    return args[2];
+  }
+
+  /**
+   * Return the bytes of the non-keva script, i. e., the address.  This is
+   * the whole script if it is no keva op, as for CKevaScript.
+   */
+  inline Span<const unsigned char> getAddressBytes() const
+  {
+    return address;
+  }
+
+  /** Return a copy of the address script.  This allocates.  */
+  inline CScript getAddress() const
+  {
+    return CScript(address.begin(), address.end());
+  }
+
+};
+
 /**
  * A script parsed for keva operations.  This can be initialised
  * from a "standard" script, and will then determine if this is
@@ -53,6 +173,9 @@ public:
    */
   explicit CKevaScript(const CScript& script);
 
+  /** Heap memory owned by the parsed script.  */
+  size_t DynamicMemoryUsage() const;
+
   /**
    * Return whether this is a (valid) name script.
    * @return True iff this is a name operation.
@@ -242,7 +365,7 @@ public:
   static inline bool
   isKevaScript (const CScript& script)
   {
-    const CKevaScript op(script);
+    const CKevaScriptView op(script);
     return op.isKevaOp();
   }
 
@@ -216,7 +216,10 @@ bool CScript::IsPayToScriptHash(bool allowKeva) const
     }
 
     // Strip off a keva prefix if present.
-    const CKevaScript kevaOp(*this);
+    const CKevaScriptView kevaOp(*this);
+    if (!kevaOp.isKevaOp()) {
+        return IsPayToScriptHash(false);
+    }
     return kevaOp.getAddress().IsPayToScriptHash(false);
 }
 
@@ -230,7 +233,10 @@ bool CScript::IsPayToWitnessScriptHash(bool allowKeva) const
     }
 
     // Strip off a keva prefix if present.
-    const CKevaScript kevaOp(*this);
+    const CKevaScriptView kevaOp(*this);
+    if (!kevaOp.isKevaOp()) {
+        return IsPayToWitnessScriptHash(false);
+    }
     return kevaOp.getAddress().IsPayToWitnessScriptHash(false);
 }
 
@@ -55,8 +55,9 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::v
     vSolutionsRet.clear();
 
     // If we have a keva script, strip the prefix
-    const CKevaScript kevaOp(scriptPubKey);
-    const CScript& script1 = kevaOp.getAddress();
+    const CKevaScriptView kevaOp(scriptPubKey);
+    const CScript kevaAddress = kevaOp.isKevaOp() ? kevaOp.getAddress() : CScript();
+    const CScript& script1 = kevaOp.isKevaOp() ? kevaAddress : scriptPubKey;
 
     // Shortcut for pay-to-script-hash, which are more constrained than the other types:
     // it is always OP_HASH160 20 [20 byte hash] OP_EQUAL
@@ -0,0 +1,50 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPAN_H
+#define BITCOIN_SPAN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+/** A Span is an object that can refer to a contiguous sequence of objects.
+ *
+ * It implements a subset of C++20's std::span. A Span does not own the
+ * objects it refers to, so it must not outlive them.
+ */
+template<typename C>
+class Span
+{
+    C* m_data;
+    std::size_t m_size;
+
+public:
+    constexpr Span() noexcept : m_data(nullptr), m_size(0) {}
+    constexpr Span(C* data, std::size_t size) noexcept : m_data(data), m_size(size) {}
+    constexpr Span(C* data, C* end) noexcept : m_data(data), m_size(end - data) {}
+
+    /** Implicit conversion of spans between compatible types, such as Span<T> to Span<const T>. */
+    template <typename O, typename std::enable_if<std::is_convertible<O (*)[], C (*)[]>::value, int>::type = 0>
+    constexpr Span(const Span<O>& other) noexcept : m_data(other.data()), m_size(other.size()) {}
+
+    constexpr C* data() const noexcept { return m_data; }
+    constexpr C* begin() const noexcept { return m_data; }
+    constexpr C* end() const noexcept { return m_data + m_size; }
+    constexpr std::size_t size() const noexcept { return m_size; }
+    constexpr bool empty() const noexcept { return m_size == 0; }
+    constexpr C& operator[](std::size_t pos) const noexcept { return m_data[pos]; }
+
+    friend bool operator==(const Span& a, const Span& b) { return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin()); }
+    friend bool operator!=(const Span& a, const Span& b) { return !(a == b); }
+};
+
+/** Create a span to a container exposing data() and size(). */
+template<typename V>
+constexpr Span<typename std::remove_pointer<decltype(std::declval<V&>().data())>::type> MakeSpan(V& v)
+{
+    return Span<typename std::remove_pointer<decltype(std::declval<V&>().data())>::type>(v.data(), v.size());
+}
+
+#endif // BITCOIN_SPAN_H
@@ -11,6 +11,40 @@
 
 #include <stdio.h>
 
+std::atomic<const void*> g_profiled_lock{nullptr};
+
+#ifdef HAVE_THREAD_LOCAL
+struct LockHoldState {
+    int nDepth = 0;
+    int64_t nAcquired = 0;
+    int64_t nTotal = 0;
+};
+static thread_local LockHoldState g_lock_hold;
+
+void ProfiledLockAcquired()
+{
+    // Only the outermost acquisition of the recursive lock counts.
+    if (g_lock_hold.nDepth++ == 0)
+        g_lock_hold.nAcquired = GetTimeMicros();
+}
+
+void ProfiledLockReleased()
+{
+    // The lock may have been held already when profiling was enabled.
+    if (g_lock_hold.nDepth > 0 && --g_lock_hold.nDepth == 0)
+        g_lock_hold.nTotal += GetTimeMicros() - g_lock_hold.nAcquired;
+}
+
+int64_t GetLockHoldTime()
+{
+    return g_lock_hold.nTotal + (g_lock_hold.nDepth > 0 ? GetTimeMicros() - g_lock_hold.nAcquired : 0);
+}
+#else
+void ProfiledLockAcquired() {}
+void ProfiledLockReleased() {}
+int64_t GetLockHoldTime() { return 0; }
+#endif /* HAVE_THREAD_LOCAL */
+
 #ifdef DEBUG_LOCKCONTENTION
 #if !defined(HAVE_THREAD_LOCAL)
 static_assert(false, "thread_local is not supported");
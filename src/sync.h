@@ -8,7 +8,9 @@
 
 #include <threadsafety.h>
 
+#include <atomic>
 #include <condition_variable>
+#include <stdint.h>
 #include <thread>
 #include <mutex>
 
@@ -87,6 +89,20 @@ void static inline DeleteLock(void* cs) {}
 #define AssertLockHeld(cs) AssertLockHeldInternal(#cs, __FILE__, __LINE__, &cs)
 #define AssertLockNotHeld(cs) AssertLockNotHeldInternal(#cs, __FILE__, __LINE__, &cs)
 
+/**
+ * The critical section whose hold times are measured, if any. Only one
+ * critical section (cs_main) is profiled, so that the check on every lock
+ * stays a single pointer comparison.
+ */
+extern std::atomic<const void*> g_profiled_lock;
+void ProfiledLockAcquired();
+void ProfiledLockReleased();
+/**
+ * Total time in microseconds the calling thread has held g_profiled_lock,
+ * including the current hold. Always 0 without thread_local support.
+ */
+int64_t GetLockHoldTime();
+
 /**
  * Wrapped mutex: supports recursive locking, but no waiting
  * TODO: We should move away from using the recursive lock by default.
@@ -97,6 +113,29 @@ public:
     ~CCriticalSection() {
         DeleteLock((void*)this);
     }
+
+    void lock() EXCLUSIVE_LOCK_FUNCTION()
+    {
+        AnnotatedMixin<std::recursive_mutex>::lock();
+        if (g_profiled_lock.load(std::memory_order_relaxed) == this)
+            ProfiledLockAcquired();
+    }
+
+    void unlock() UNLOCK_FUNCTION()
+    {
+        if (g_profiled_lock.load(std::memory_order_relaxed) == this)
+            ProfiledLockReleased();
+        AnnotatedMixin<std::recursive_mutex>::unlock();
+    }
+
+    bool try_lock() EXCLUSIVE_TRYLOCK_FUNCTION(true)
+    {
+        if (!AnnotatedMixin<std::recursive_mutex>::try_lock())
+            return false;
+        if (g_profiled_lock.load(std::memory_order_relaxed) == this)
+            ProfiledLockAcquired();
+        return true;
+    }
 };
 
 /** Wrapped mutex: supports waiting but not recursive locking */
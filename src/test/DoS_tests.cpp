@@ -23,13 +23,16 @@
 // Tests these internal-to-net_processing.cpp methods:
 extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphanUsage);
 struct COrphanTx {
     CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    size_t nUsage;
+    size_t list_pos;
 };
-extern std::map<uint256, COrphanTx> mapOrphanTransactions;
+extern std::unordered_map<uint256, COrphanTx, SaltedTxidHasher> mapOrphanTransactions;
+extern size_t nOrphanTxUsage;
 
 CService ip(uint32_t i)
 {
@@ -293,11 +296,8 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
 
 CTransactionRef RandomOrphan()
 {
-    std::map<uint256, COrphanTx>::iterator it;
     LOCK(cs_main);
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
+    auto it = std::next(mapOrphanTransactions.begin(), InsecureRandRange(mapOrphanTransactions.size()));
     return it->second.tx;
 }
 
@@ -374,12 +374,99 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     }
 
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
+    const size_t nMaxUsage = std::numeric_limits<size_t>::max();
+    LimitOrphanTxSize(40, nMaxUsage);
     BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
+    LimitOrphanTxSize(10, nMaxUsage);
     BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
+    BOOST_CHECK(nOrphanTxUsage > 0);
+    LimitOrphanTxSize(10, nOrphanTxUsage - 1);
+    BOOST_CHECK(mapOrphanTransactions.size() < 10);
+    LimitOrphanTxSize(0, nMaxUsage);
     BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(nOrphanTxUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_peer_quota)
+{
+    // A single peer may only use its share of the orphan pool.
+    const unsigned int nPeerMax = std::min(DEFAULT_MAX_ORPHAN_TRANSACTIONS, std::max(DEFAULT_MAX_ORPHAN_TRANSACTIONS * MAX_PEER_ORPHAN_SHARE / 100, MIN_PEER_ORPHAN_TRANSACTIONS));
+    for (unsigned int i = 0; i < nPeerMax + 10; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+
+        BOOST_CHECK_EQUAL(AddOrphanTx(MakeTransactionRef(tx), 0), i < nPeerMax);
+        // ... while other peers are not affected by it.
+        tx.vout[0].nValue = 2*CENT;
+        BOOST_CHECK(AddOrphanTx(MakeTransactionRef(tx), 1 + i));
+    }
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 2 * nPeerMax + 10);
+    EraseOrphansFor(0);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), nPeerMax + 10);
+    LimitOrphanTxSize(0, 0);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(nOrphanTxUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_peer_chain)
+{
+    // A chain as deep as the ancestor limit, relayed by one peer before its
+    // missing parent, is kept whole. Anything deeper could never enter the
+    // mempool.
+    uint256 hashPrev = InsecureRand256();
+    for (unsigned int i = 0; i < DEFAULT_ANCESTOR_LIMIT + 5; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = hashPrev;
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        tx.vout[0].scriptPubKey << OP_TRUE;
+        hashPrev = tx.GetHash();
+
+        BOOST_CHECK_EQUAL(AddOrphanTx(MakeTransactionRef(tx), 0), i < DEFAULT_ANCESTOR_LIMIT);
+    }
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), DEFAULT_ANCESTOR_LIMIT);
+    EraseOrphansFor(0);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(nOrphanTxUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_small_pool)
+{
+    // A peer never gets more than the whole pool.
+    gArgs.ForceSetArg("-maxorphantx", "10");
+    for (unsigned int i = 0; i < 20; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+
+        BOOST_CHECK_EQUAL(AddOrphanTx(MakeTransactionRef(tx), 0), i < 10);
+    }
+    gArgs.ForceSetArg("-maxorphantx", std::to_string(DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 10U);
+    EraseOrphansFor(0);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(nOrphanTxUsage, 0U);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
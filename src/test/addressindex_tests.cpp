@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addressindex.h>
+#include <primitives/block.h>
+#include <script/keva.h>
+#include <script/standard.h>
+#include <txdb.h>
+#include <undo.h>
+#include <utilstrencodings.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(const std::vector<COutPoint>& inputs, const std::vector<CTxOut>& outputs)
+{
+    CMutableTransaction mtx;
+    for (const COutPoint& prevout : inputs)
+        mtx.vin.push_back(CTxIn(prevout));
+    mtx.vout = outputs;
+    return MakeTransactionRef(std::move(mtx));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    const CScript script = GetScriptForDestination(CKeyID(uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"))));
+    const CScript other = GetScriptForDestination(CKeyID(uint160(ParseHex("1112131415161718191a1b1c1d1e1f2021222324"))));
+    const valtype nameSpace(20, 'n');
+    const CScript kevaScript = CKevaScript::buildKevaNamespace(script, nameSpace, valtype(1, 'd'));
+
+    // Keva outputs are indexed under the address they pay to.
+    const uint160 hashScript = GetAddressIndexHash(script);
+    BOOST_CHECK(GetAddressIndexHash(kevaScript) == hashScript);
+    BOOST_CHECK(GetAddressIndexHash(other) != hashScript);
+
+    // Block 1: a coinbase paying to the address and a keva output, and a
+    // transaction spending the first output in the same block.
+    CBlock block1;
+    const CTransactionRef coinbase = MakeTx({COutPoint()}, {CTxOut(50 * COIN, script), CTxOut(COIN, kevaScript)});
+    const COutPoint out0(coinbase->GetHash(), 0), out1(coinbase->GetHash(), 1);
+    const CTransactionRef spend = MakeTx({out0}, {CTxOut(20 * COIN, other), CTxOut(30 * COIN, script)});
+    block1.vtx = {coinbase, spend};
+    CBlockUndo undo1;
+    undo1.vtxundo.resize(1);
+    undo1.vtxundo[0].vprevout.emplace_back(coinbase->vout[0], 10, true);
+
+    // Block 2: spend the keva output.
+    CBlock block2;
+    const CTransactionRef coinbase2 = MakeTx({COutPoint()}, {CTxOut(50 * COIN, other)});
+    const CTransactionRef spendKeva = MakeTx({out1}, {CTxOut(COIN, other)});
+    block2.vtx = {coinbase2, spendKeva};
+    CBlockUndo undo2;
+    undo2.vtxundo.resize(1);
+    undo2.vtxundo[0].vprevout.emplace_back(coinbase->vout[1], 10, true);
+
+    CAddressIndexUpdate update;
+    BuildAddressIndexUpdate(block1, undo1, 10, true, update);
+    BOOST_CHECK(db.UpdateAddressIndex(update));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashScript, 0, 0, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 2U);
+    for (const auto& entry : unspent) {
+        BOOST_CHECK(entry.first.outpoint == out1 || entry.first.outpoint == COutPoint(spend->GetHash(), 1));
+        BOOST_CHECK_EQUAL(entry.second.nHeight, 10);
+    }
+    unspent.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashScript, 1, 1, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 1U);
+    // Only the keva output is read (and paged over) by the keva variant.
+    unspent.clear();
+    BOOST_CHECK(db.ReadAddressKevaUnspentIndex(hashScript, 0, 0, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 1U);
+    BOOST_CHECK(unspent[0].first.outpoint == out1);
+    unspent.clear();
+    BOOST_CHECK(db.ReadAddressKevaUnspentIndex(hashScript, 1, 0, unspent));
+    BOOST_CHECK(unspent.empty());
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > history;
+    BOOST_CHECK(db.ReadAddressIndex(hashScript, 0, 0, history));
+    BOOST_CHECK_EQUAL(history.size(), 4U);
+    CAmount balance = 0;
+    for (const auto& entry : history)
+        balance += entry.second;
+    BOOST_CHECK_EQUAL(balance, 31 * COIN);
+
+    CSpentIndexValue spent;
+    BOOST_CHECK(db.ReadSpentIndex(out0, spent));
+    BOOST_CHECK(spent.txid == spend->GetHash());
+    BOOST_CHECK_EQUAL(spent.nInput, 0U);
+    BOOST_CHECK_EQUAL(spent.nHeight, 10);
+
+    update = CAddressIndexUpdate();
+    BuildAddressIndexUpdate(block2, undo2, 11, true, update);
+    BOOST_CHECK(db.UpdateAddressIndex(update));
+    unspent.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashScript, 0, 0, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 1U);
+    history.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashScript, 0, 0, history));
+    BOOST_CHECK_EQUAL(history.size(), 5U);
+    BOOST_CHECK_EQUAL(history.back().first.nHeight, 11);
+    BOOST_CHECK(history.back().first.fSpending);
+
+    // Disconnecting block 2 restores the keva output from the undo data.
+    update = CAddressIndexUpdate();
+    BuildAddressIndexUpdate(block2, undo2, 11, false, update);
+    BOOST_CHECK(db.UpdateAddressIndex(update));
+    unspent.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashScript, 0, 0, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 2U);
+    bool fFoundKeva = false;
+    for (const auto& entry : unspent) {
+        if (entry.first.outpoint == out1) {
+            fFoundKeva = true;
+            BOOST_CHECK(entry.second.scriptPubKey == kevaScript);
+            BOOST_CHECK_EQUAL(entry.second.nValue, COIN);
+        }
+    }
+    BOOST_CHECK(fFoundKeva);
+    BOOST_CHECK(!db.ReadSpentIndex(out1, spent));
+
+    // Disconnecting block 1 leaves nothing, including the output created
+    // and spent within the block.
+    update = CAddressIndexUpdate();
+    BuildAddressIndexUpdate(block1, undo1, 10, false, update);
+    BOOST_CHECK(db.UpdateAddressIndex(update));
+    unspent.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashScript, 0, 0, unspent));
+    BOOST_CHECK(unspent.empty());
+    history.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashScript, 0, 0, history));
+    BOOST_CHECK(history.empty());
+    BOOST_CHECK(!db.ReadSpentIndex(out0, spent));
+    BOOST_CHECK(db.ReadAddressUnspentIndex(GetAddressIndexHash(other), 0, 0, unspent));
+    BOOST_CHECK(unspent.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
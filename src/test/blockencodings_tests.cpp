@@ -5,13 +5,17 @@
 #include <blockencodings.h>
 #include <consensus/merkle.h>
 #include <chainparams.h>
+#include <core_memusage.h>
+#include <net_processing.h>
 #include <random.h>
 
 #include <test/test_bitcoin.h>
 
 #include <boost/test/unit_test.hpp>
 
-std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+std::deque<std::pair<uint256, CTransactionRef>> extra_txn;
+
+extern void AddToCompactExtraTransactions(const CTransactionRef& tx);
 
 struct RegtestingSetup : public TestingSetup {
     RegtestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
@@ -31,7 +35,7 @@ static CBlock BuildBlockTestCase() {
     block.vtx[0] = MakeTransactionRef(tx);
     block.nVersion = 1;
     block.hashPrevBlock = InsecureRand256();
-    block.nBits = 0x1e0ffff0;
+    block.nBits = 0x207fffff;
 
     tx.vin[0].prevout.hash = InsecureRand256();
     tx.vin[0].prevout.n = 0;
@@ -289,13 +293,13 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     block.vtx[0] = MakeTransactionRef(std::move(coinbase));
     block.nVersion = 1;
     block.hashPrevBlock = InsecureRand256();
-    block.nBits = 0x1e0ffff0;
+    block.nBits = 0x207fffff;
 
     bool mutated;
     block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
     assert(!mutated);
     block.cnHeader.major_version = Params().GetConsensus().GetCryptonoteMajorVersion(block.nNonce);
-    block.cnHeader.prev_id = block.GetOriginalHash();
+    block.cnHeader.prev_id = block.GetOriginalBlockHash();
     while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, Params().GetConsensus())) ++block.cnHeader.nonce;
 
     // Test simple header round-trip with only coinbase
@@ -321,6 +325,126 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+// Exposes what a compact block sends in full and as short ids
+class PrefilledShortIDs : public CBlockHeaderAndShortTxIDs {
+public:
+    using CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs;
+    using CBlockHeaderAndShortTxIDs::shorttxids;
+    using CBlockHeaderAndShortTxIDs::prefilledtxn;
+};
+
+BOOST_AUTO_TEST_CASE(PrefillRoundTripTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    CBlock block;
+    block.vtx.resize(6);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        block.vtx[i] = MakeTransactionRef(tx);
+        tx.vin[0].prevout.hash = InsecureRand256();
+    }
+    block.nVersion = 1;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    block.cnHeader.major_version = Params().GetConsensus().GetCryptonoteMajorVersion(block.nNonce);
+    block.cnHeader.prev_id = block.GetOriginalBlockHash();
+    while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, Params().GetConsensus())) ++block.cnHeader.nonce;
+
+    // Transaction 1 is in the mempool and 3 only in the extra pool, 4 has to
+    // be requested. The coinbase and the second 2 are prefilled already.
+    pool.addUnchecked(block.vtx[1]->GetHash(), entry.FromTx(*block.vtx[1]));
+    std::deque<std::pair<uint256, CTransactionRef>> extra;
+    extra.emplace_back(block.vtx[3]->GetWitnessHash(), block.vtx[3]);
+
+    // Indexes already handled are skipped, the others are sent as the gap to
+    // the previous prefilled one.
+    PrefilledShortIDs shortIDs(block, true, {0, 2, 2, 5});
+    BOOST_CHECK_EQUAL(shortIDs.shorttxids.size(), 3);
+    BOOST_REQUIRE_EQUAL(shortIDs.prefilledtxn.size(), 3);
+    BOOST_CHECK_EQUAL(shortIDs.prefilledtxn[0].index, 0);
+    BOOST_CHECK_EQUAL(shortIDs.prefilledtxn[1].index, 1);
+    BOOST_CHECK_EQUAL(shortIDs.prefilledtxn[2].index, 2);
+    BOOST_CHECK(shortIDs.prefilledtxn[1].tx->GetHash() == block.vtx[2]->GetHash());
+    BOOST_CHECK(shortIDs.prefilledtxn[2].tx->GetHash() == block.vtx[5]->GetHash());
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(partialBlock.GetPrefilledCount(), 3);
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 1);
+    BOOST_CHECK_EQUAL(partialBlock.GetExtraCount(), 1);
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK_EQUAL(partialBlock.IsTxAvailable(i), i != 4);
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {block.vtx[4]}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetPoWHash().ToString(), block2.GetPoWHash().ToString());
+    BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block2, &mutated).ToString());
+    BOOST_CHECK(!mutated);
+}
+
+BOOST_AUTO_TEST_CASE(PrefillIndexGapTest)
+{
+    // Prefilled indexes are sent as the uint16_t gap to the previous one, so
+    // a transaction further out is sent as a short id instead.
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    CBlock block;
+    block.vtx.assign(2 + std::numeric_limits<uint16_t>::max() + 1, MakeTransactionRef(tx));
+
+    PrefilledShortIDs fits(block, false, {block.vtx.size() - 2});
+    BOOST_REQUIRE_EQUAL(fits.prefilledtxn.size(), 2);
+    BOOST_CHECK_EQUAL(fits.prefilledtxn[1].index, std::numeric_limits<uint16_t>::max());
+    BOOST_CHECK_EQUAL(fits.shorttxids.size(), block.vtx.size() - 2);
+
+    PrefilledShortIDs gap(block, false, {block.vtx.size() - 1});
+    BOOST_CHECK_EQUAL(gap.prefilledtxn.size(), 1);
+    BOOST_CHECK_EQUAL(gap.shorttxids.size(), block.vtx.size() - 1);
+}
+
+BOOST_AUTO_TEST_CASE(ExtraPoolSizeTest)
+{
+    // The pool is bounded by the memory of its transactions
+    gArgs.ForceSetArg("-blockreconstructionextratxnsize", "1");
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey.resize(300000);
+    const size_t tx_bytes = RecursiveDynamicUsage(MakeTransactionRef(tx));
+    for (int i = 0; i < 5; i++) {
+        tx.vin[0].prevout.hash = InsecureRand256();
+        AddToCompactExtraTransactions(MakeTransactionRef(tx));
+    }
+    CCompactBlockStats stats;
+    GetCompactBlockStats(stats);
+    BOOST_CHECK_EQUAL(stats.nExtraPoolTxs, 3);
+    BOOST_CHECK_EQUAL(stats.nExtraPoolBytes, 3 * tx_bytes);
+
+    // A transaction larger than the whole pool is not kept
+    tx.vout[0].scriptPubKey.resize(1000001);
+    AddToCompactExtraTransactions(MakeTransactionRef(tx));
+    GetCompactBlockStats(stats);
+    BOOST_CHECK_EQUAL(stats.nExtraPoolTxs, 3);
+    gArgs.ForceSetArg("-blockreconstructionextratxnsize", std::to_string(DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN_SIZE));
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
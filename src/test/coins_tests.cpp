@@ -4,6 +4,8 @@
 
 #include <coins.h>
 #include <script/standard.h>
+#include <streams.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <utilstrencodings.h>
@@ -52,7 +54,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CKevaCache &names) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CKevaCache &names, const CCoinsSetStats &stats) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -588,7 +590,7 @@ void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
     CCoinsMap map;
     InsertCoinsMapEntry(map, value, flags);
-    view.BatchWrite(map, {}, {});
+    view.BatchWrite(map, {}, {}, {});
 }
 
 class SingleEntryCacheTest
@@ -855,4 +857,91 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_set_stats)
+{
+    const bool fOldCoinStatsIndex = fCoinStatsIndex;
+    fCoinStatsIndex = true;
+
+    CCoinsViewDB base(1 << 20, true);
+    BOOST_CHECK(base.InitCoinsSetStats());
+    CCoinsSetStats stats;
+    BOOST_CHECK(base.GetCoinsSetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 0);
+
+    std::map<COutPoint, Coin> expected;
+    {
+        CCoinsViewCache cache(&base);
+        CCoinsViewCache child(&cache);
+        for (int i = 0; i < 20; i++) {
+            const COutPoint outpoint(InsecureRand256(), InsecureRandRange(4));
+            const Coin coin(CTxOut(InsecureRandRange(1000) + 1, CScript() << ToByteVector(InsecureRand256())), 1 + i, false);
+            expected[outpoint] = coin;
+            (i % 2 ? cache : child).AddCoin(outpoint, Coin(coin), false);
+        }
+
+        // Spend coins that live in the parent and in the child cache.
+        auto it = expected.begin();
+        for (int i = 0; i < 6; i++) {
+            BOOST_CHECK(child.SpendCoin(it->first));
+            it = expected.erase(it);
+        }
+
+        child.Flush();
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.GetCoinsSetStats(stats));
+        BOOST_CHECK_EQUAL(stats.nTransactionOutputs, (int64_t)expected.size());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Overwrite a coin that only exists in the database.
+    {
+        CCoinsViewCache cache(&base);
+        const COutPoint outpoint = expected.begin()->first;
+        const Coin coin(CTxOut(5000, CScript() << OP_TRUE), 100, true);
+        expected[outpoint] = coin;
+        cache.AddCoin(outpoint, Coin(coin), true);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoinsSetStats computed;
+    for (const auto& entry : expected)
+        computed.AddCoin(entry.first, entry.second);
+
+    BOOST_CHECK(base.GetCoinsSetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, computed.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, computed.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, computed.nTotalAmount);
+    BOOST_CHECK(stats.GetHash() == computed.GetHash());
+
+    // A round trip through serialization keeps the set hash.
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << stats;
+    CCoinsSetStats stats2;
+    ss >> stats2;
+    BOOST_CHECK(stats2.GetHash() == computed.GetHash());
+
+    // Without -coinstatsindex, the totals are dropped and no longer kept.
+    fCoinStatsIndex = false;
+    BOOST_CHECK(base.InitCoinsSetStats());
+    BOOST_CHECK(!base.GetCoinsSetStats(stats));
+    {
+        CCoinsViewCache cache(&base);
+        cache.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(1000, CScript() << OP_TRUE), 200, false), false);
+        BOOST_CHECK(!cache.GetCoinsSetStats(stats));
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Turning it on again recomputes them from the coins.
+    fCoinStatsIndex = true;
+    BOOST_CHECK(base.InitCoinsSetStats());
+    BOOST_CHECK(base.GetCoinsSetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, computed.nTransactionOutputs + 1);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, computed.nTotalAmount + 1000);
+
+    fCoinStatsIndex = fOldCoinStatsIndex;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,8 @@
 #include <crypto/sha512.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
+#include <hash.h>
 #include <random.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
@@ -20,6 +22,12 @@
 #include <openssl/aes.h>
 #include <openssl/evp.h>
 
+extern "C" void keccakf(uint64_t st[25], int rounds);
+extern "C" void keccakf_generic(uint64_t st[25], int rounds);
+extern "C" void keccakf_x4(uint64_t st[4][25], int rounds);
+extern "C" void cn_fast_hash(const void *data, size_t length, char *hash);
+extern "C" void cn_fast_hash_x4(const void *data, size_t length, char *hash);
+
 BOOST_FIXTURE_TEST_SUITE(crypto_tests, BasicTestingSetup)
 
 template<typename Hasher, typename In, typename Out>
@@ -524,6 +532,79 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+static void TestKeccak256(const std::string &in, const std::string &hexout)
+{
+    std::vector<unsigned char> out = ParseHex(hexout);
+    std::vector<unsigned char> hash(32);
+    cn_fast_hash(in.data(), in.size(), (char*)hash.data());
+    BOOST_CHECK(hash == out);
+}
+
+BOOST_AUTO_TEST_CASE(keccak256_testvectors)
+{
+    TestKeccak256("", "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470");
+    TestKeccak256("abc", "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45");
+    TestKeccak256("The quick brown fox jumps over the lazy dog",
+                  "4d741b6f1eb29cb2a9b9911c82f56fa8d73b04959d3d9d222895df6c0b28aa15");
+    TestKeccak256(std::string(135, 'a'), "34367dc248bbd832f4e3e69dfaac2f92638bd0bbd18f2912ba4ef454919cf446");
+    TestKeccak256(std::string(136, 'a'), "a6c4d403279fe3e0af03729caada8374b5ca54d8065329a3ebcaeb4b60aa386e");
+    TestKeccak256(std::string(1000, 'a'), "b6a4ac1f51884d71f30fa397a5e155de3099e11fc0edef5d08b646e621e19de9");
+}
+
+BOOST_AUTO_TEST_CASE(keccakf_consistency)
+{
+    for (int rounds = 0; rounds <= 24; ++rounds) {
+        uint64_t st1[25], st2[25], st4[4][25];
+        for (int i = 0; i < 25; ++i) {
+            st1[i] = st2[i] = InsecureRandBits(64);
+            for (int k = 0; k < 4; ++k) {
+                st4[k][i] = InsecureRandBits(64);
+            }
+        }
+        // The unrolled permutation must match the reference loop for any round count.
+        keccakf_generic(st1, rounds);
+        keccakf(st2, rounds);
+        BOOST_CHECK(memcmp(st1, st2, sizeof(st1)) == 0);
+
+        uint64_t ref[4][25];
+        memcpy(ref, st4, sizeof(ref));
+        for (int k = 0; k < 4; ++k) {
+            keccakf_generic(ref[k], rounds);
+        }
+        keccakf_x4(st4, rounds);
+        BOOST_CHECK(memcmp(ref, st4, sizeof(ref)) == 0);
+    }
+
+    for (size_t len = 0; len <= 300; len += 7) {
+        std::vector<unsigned char> in(4 * len);
+        for (size_t i = 0; i < in.size(); ++i) {
+            in[i] = InsecureRandBits(8);
+        }
+        unsigned char out1[4 * 32], out4[4 * 32];
+        for (int k = 0; k < 4; ++k) {
+            cn_fast_hash(in.data() + k * len, len, (char*)out1 + 32 * k);
+        }
+        cn_fast_hash_x4(in.data(), len, (char*)out4);
+        BOOST_CHECK(memcmp(out1, out4, sizeof(out1)) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
@@ -546,4 +627,56 @@ BOOST_AUTO_TEST_CASE(countbits_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    unsigned char a[32], b[32], c[32];
+    for (int i = 0; i < 32; ++i) {
+        a[i] = i;
+        b[i] = 32 + i;
+        c[i] = 64 + i;
+    }
+
+    // The hash depends on the set of elements, not on the order of insertion.
+    unsigned char out1[32], out2[32], out3[32];
+    MuHash3072().Insert(a, 32).Insert(b, 32).Insert(c, 32).Finalize(out1);
+    MuHash3072().Insert(c, 32).Insert(a, 32).Insert(b, 32).Finalize(out2);
+    BOOST_CHECK(memcmp(out1, out2, 32) == 0);
+    MuHash3072().Insert(a, 32).Insert(b, 32).Finalize(out3);
+    BOOST_CHECK(memcmp(out1, out3, 32) != 0);
+
+    // Removing an element, before or after adding it, gives the smaller set.
+    MuHash3072().Remove(c, 32).Insert(a, 32).Insert(c, 32).Insert(b, 32).Finalize(out2);
+    BOOST_CHECK(memcmp(out2, out3, 32) == 0);
+
+    // Sets can be combined and split again.
+    MuHash3072 ab, cset, abc;
+    ab.Insert(a, 32).Insert(b, 32);
+    cset.Insert(c, 32);
+    abc = ab;
+    abc *= cset;
+    abc.Finalize(out2);
+    BOOST_CHECK(memcmp(out1, out2, 32) == 0);
+    abc /= cset;
+    abc.Finalize(out2);
+    BOOST_CHECK(memcmp(out2, out3, 32) == 0);
+
+    // The state survives a round trip through its serialization.
+    unsigned char state[MuHash3072::SERIALIZED_SIZE];
+    MuHash3072 restored;
+    ab.Remove(c, 32);
+    ab.ToBytes(state);
+    BOOST_CHECK(restored.FromBytes(state));
+    restored.Insert(c, 32).Insert(c, 32).Finalize(out2);
+    BOOST_CHECK(memcmp(out1, out2, 32) == 0);
+    memset(state, 0xff, sizeof(state));
+    BOOST_CHECK(!restored.FromBytes(state));
+    memset(state, 0, sizeof(state));
+    BOOST_CHECK(!restored.FromBytes(state));
+
+    // The empty set always hashes to the same value.
+    MuHash3072().Finalize(out1);
+    MuHash3072().Insert(a, 32).Remove(a, 32).Finalize(out2);
+    BOOST_CHECK(memcmp(out1, out2, 32) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,57 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <flatset.h>
+#include <memusage.h>
+
+#include <test/test_bitcoin.h>
+
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatset_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(flatset_matches_set)
+{
+    flatset<int> fs;
+    std::set<int> s;
+
+    for (int i = 0; i < 1000; i++) {
+        int key = InsecureRandRange(200);
+        if (InsecureRandBool()) {
+            BOOST_CHECK(fs.insert(key).second == s.insert(key).second);
+        } else {
+            BOOST_CHECK_EQUAL(fs.erase(key), s.erase(key));
+        }
+        BOOST_CHECK_EQUAL(fs.size(), s.size());
+        BOOST_CHECK_EQUAL(fs.count(key), s.count(key));
+        BOOST_CHECK(std::equal(fs.begin(), fs.end(), s.begin()));
+    }
+
+    BOOST_CHECK(flatset<int>(s.begin(), s.end()) == fs);
+    fs.clear();
+    BOOST_CHECK(fs.empty());
+    BOOST_CHECK_EQUAL(fs.capacity(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(flatset_memory)
+{
+    flatset<int64_t> fs;
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(fs), 0);
+
+    for (int64_t i = 0; i < 64; i++)
+        fs.insert(i);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(fs), memusage::MallocUsage(fs.capacity() * sizeof(int64_t)));
+
+    // Draining the set gives its allocation back
+    size_t nCapacity = fs.capacity();
+    for (int64_t i = 0; i < 60; i++)
+        fs.erase(i);
+    BOOST_CHECK(fs.capacity() < nCapacity);
+    BOOST_CHECK(fs.find(62) != fs.end());
+    BOOST_CHECK(fs.find(0) == fs.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,17 +7,21 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <base58.h>
+#include <checkqueue.h>
 #include <coins.h>
 #include <chain.h>
 #include <consensus/validation.h>
 #include <keva/main.h>
+#include <keva/registry.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <script/keva.h>
+#include <script/standard.h>
 #include <txdb.h>
 #include <txmempool.h>
 #include <undo.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/test_bitcoin.h>
 
@@ -91,6 +95,157 @@ BOOST_AUTO_TEST_CASE(keva_scripts)
   BOOST_CHECK(opKevaPut.getOpValue() == value);
 }
 
+BOOST_AUTO_TEST_CASE(keva_script_view)
+{
+  const CScript addr = getTestAddress();
+  const CKevaScriptView viewNone(addr);
+  BOOST_CHECK(!viewNone.isKevaOp());
+  BOOST_CHECK(viewNone.getAddress() == addr);
+
+  const valtype nameSpace = ValtypeFromString ("namespace-string");
+  const valtype key = ValtypeFromString ("key");
+  /* A value long enough to need OP_PUSHDATA2.  */
+  const valtype value(300, 'x');
+
+  const CScript scriptPut = CKevaScript::buildKevaPut(addr, nameSpace, key, value);
+  const CKevaScriptView viewPut(scriptPut);
+  BOOST_CHECK(viewPut.isKevaOp());
+  BOOST_CHECK(viewPut.getKevaOp() == OP_KEVA_PUT);
+  BOOST_CHECK(viewPut.isAnyUpdate());
+  BOOST_CHECK(!viewPut.isDelete());
+  BOOST_CHECK(viewPut.getOpNamespace() == MakeSpan(nameSpace));
+  BOOST_CHECK(viewPut.getOpKey() == MakeSpan(key));
+  BOOST_CHECK(viewPut.getOpValue() == MakeSpan(value));
+  BOOST_CHECK(viewPut.getAddress() == addr);
+  /* The view points into the script instead of copying it.  */
+  BOOST_CHECK(viewPut.getOpValue().begin() >= scriptPut.data());
+  BOOST_CHECK(viewPut.getAddressBytes().end() == scriptPut.data() + scriptPut.size());
+
+  const CScript scriptDelete = CKevaScript::buildKevaDelete(addr, nameSpace, key);
+  const CKevaScriptView viewDelete(scriptDelete);
+  BOOST_CHECK(viewDelete.isDelete());
+  BOOST_CHECK_EQUAL(viewDelete.getArgCount(), 2U);
+
+  const valtype displayName = ValtypeFromString ("display name");
+  const CScript scriptNamespace = CKevaScript::buildKevaNamespace(addr, nameSpace, displayName);
+  const CKevaScriptView viewNamespace(scriptNamespace);
+  BOOST_CHECK(viewNamespace.isNamespaceRegistration());
+  BOOST_CHECK(viewNamespace.getOpNamespaceDisplayName() == MakeSpan(displayName));
+
+  /* Scripts with a wrong number of arguments are no keva ops.  */
+  CScript scriptBad;
+  scriptBad << OP_KEVA_PUT << nameSpace << key << OP_2DROP;
+  scriptBad += addr;
+  BOOST_CHECK(!CKevaScriptView(scriptBad).isKevaOp());
+  BOOST_CHECK(!CKevaScript::isKevaScript(scriptBad));
+  BOOST_CHECK(CKevaScript(scriptBad).getAddress() == scriptBad);
+}
+
+BOOST_AUTO_TEST_CASE(keva_tx_ops)
+{
+  const CScript addr = getTestAddress();
+  const valtype nameSpace = ValtypeFromString ("namespace-string");
+  const valtype key = ValtypeFromString ("key");
+  const valtype value = ValtypeFromString ("value");
+
+  CMutableTransaction mtx;
+  mtx.SetKevacoin();
+  mtx.vout.push_back(CTxOut(COIN, addr));
+  mtx.vout.push_back(CTxOut(KEVA_LOCKED_AMOUNT, CKevaScript::buildKevaPut(addr, nameSpace, key, value)));
+  const CTransaction tx(mtx);
+
+  /* The keva operation is parsed when the transaction is built, and
+     shared by its copies.  */
+  BOOST_CHECK(tx.HasKevaOps());
+  BOOST_CHECK_EQUAL(tx.GetKevaOps().size(), 1U);
+  BOOST_CHECK(tx.GetKevaOp(0) == nullptr);
+  const CKevaScript* op = tx.GetKevaOp(1);
+  BOOST_REQUIRE(op != nullptr);
+  BOOST_CHECK(op->getKevaOp() == OP_KEVA_PUT);
+  BOOST_CHECK(op->getOpKey() == key);
+  BOOST_CHECK(op->getOpValue() == value);
+  BOOST_CHECK(op->getAddress() == addr);
+  const CTransaction copy(tx);
+  BOOST_CHECK(copy.GetKevaOp(1) == op);
+  BOOST_CHECK_EQUAL(tx.GetValueOut(true), COIN);
+
+  CMutableTransaction mtxPlain;
+  mtxPlain.vout.push_back(CTxOut(COIN, addr));
+  BOOST_CHECK(!CTransaction(mtxPlain).HasKevaOps());
+  BOOST_CHECK(CTransaction(mtxPlain).GetKevaOps().empty());
+}
+
+BOOST_AUTO_TEST_CASE(keva_check)
+{
+  const CScript addr = getTestAddress();
+  const valtype nameSpace = ValtypeFromString ("namespace-string");
+  const valtype otherSpace = ValtypeFromString ("other-namespace");
+  const valtype key = ValtypeFromString ("key");
+  const valtype value = ValtypeFromString ("value");
+
+  CCoinsView dummyView;
+  CCoinsViewCache view(&dummyView);
+  const COutPoint inCoin(InsecureRand256(), 0);
+  view.AddCoin(inCoin, Coin(CTxOut(COIN, addr), 1, false), false);
+  const COutPoint inKeva(InsecureRand256(), 0);
+  view.AddCoin(inKeva, Coin(CTxOut(KEVA_LOCKED_AMOUNT, CKevaScript::buildKevaNamespace(addr, nameSpace, value)), 1, false), false);
+
+  /* Plain transactions need no check.  */
+  CMutableTransaction mtx;
+  mtx.vin.push_back(CTxIn(inCoin));
+  mtx.vout.push_back(CTxOut(COIN, addr));
+  CValidationState state;
+  BOOST_CHECK(!CKevaCheck(CTransaction(mtx), 100, view).isNeeded());
+
+  /* The check only keeps the keva input, so it stays valid after the
+     coins have been spent, as when running on a script check thread.  */
+  mtx.vin.push_back(CTxIn(inKeva));
+  mtx.vout.push_back(CTxOut(KEVA_LOCKED_AMOUNT, CKevaScript::buildKevaPut(addr, nameSpace, key, value)));
+  mtx.SetKevacoin();
+  const CTransaction tx(mtx);
+  CKevaCheck check(tx, 100, view);
+  BOOST_CHECK(check.isNeeded());
+  CCoinsViewCache spent(&view);
+  spent.SpendCoin(inKeva);
+  BOOST_CHECK(!CheckKevaTransaction(tx, 100, spent, state, 0));
+
+  /* The namespace has to match the one of the input.  */
+  mtx.vout[1] = CTxOut(KEVA_LOCKED_AMOUNT, CKevaScript::buildKevaPut(addr, otherSpace, key, value));
+  const CTransaction txOther(mtx);
+  CKevaCheck checkOther(txOther, 100, view);
+  BOOST_CHECK(!checkOther.check(state));
+  BOOST_CHECK(state.IsInvalid());
+
+  /* On a script check queue, the checks pass or fail the batch they are
+     part of.  */
+  boost::thread_group threadGroup;
+  CCheckQueue<CScriptCheck> queue(128);
+  for (int i = 0; i < 2; ++i)
+    threadGroup.create_thread(boost::bind(&CCheckQueue<CScriptCheck>::Thread, boost::ref(queue)));
+  {
+    CCheckQueueControl<CScriptCheck> control(&queue);
+    std::vector<CScriptCheck> vChecks;
+    vChecks.emplace_back(check);
+    control.Add(vChecks);
+    BOOST_CHECK(control.Wait());
+  }
+  {
+    CCheckQueueControl<CScriptCheck> control(&queue);
+    std::vector<CScriptCheck> vChecks;
+    vChecks.emplace_back(check);
+    vChecks.emplace_back(checkOther);
+    control.Add(vChecks);
+    BOOST_CHECK(!control.Wait());
+  }
+  threadGroup.interrupt_all();
+  threadGroup.join_all();
+
+  /* Updates need a keva input.  */
+  mtx.vout[1] = CTxOut(KEVA_LOCKED_AMOUNT, CKevaScript::buildKevaPut(addr, nameSpace, key, value));
+  mtx.vin.pop_back();
+  BOOST_CHECK(!CheckKevaTransaction(CTransaction(mtx), 100, view, state, 0));
+}
+
 #if 0
 /* ************************************************************************** */
 
@@ -734,7 +889,7 @@ BOOST_AUTO_TEST_CASE(keva_updates_undo)
   mtx.SetKevacoin();
   mtx.vout.push_back(CTxOut(COIN, scrNew));
   pindex.nHeight = 100;
-  ApplyKevaTransaction(mtx, pindex, view, undo, kevaNotifier);
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
   BOOST_CHECK(!view.GetName(nameSpace, key1, data));
   BOOST_CHECK(view.GetNamespace(nameSpace, data));
   BOOST_CHECK(undo.vkevaundo.size() == 1);
@@ -742,7 +897,7 @@ BOOST_AUTO_TEST_CASE(keva_updates_undo)
   mtx.vout.clear();
   mtx.vout.push_back(CTxOut(COIN, scr1_1));
   pindex.nHeight = 200;
-  ApplyKevaTransaction(mtx, pindex, view, undo, kevaNotifier);
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
   BOOST_CHECK(view.GetName(nameSpace, key1, data));
   BOOST_CHECK(data.getHeight() == 200);
   BOOST_CHECK(data.getValue() == value1_old);
@@ -753,7 +908,7 @@ BOOST_AUTO_TEST_CASE(keva_updates_undo)
   mtx.vout.clear();
   mtx.vout.push_back(CTxOut(COIN, scr1_2));
   pindex.nHeight = 300;
-  ApplyKevaTransaction(mtx, pindex, view, undo, kevaNotifier);
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
   BOOST_CHECK(view.GetName(nameSpace, key1, data));
   BOOST_CHECK(data.getHeight() == 300);
   BOOST_CHECK(data.getValue() == value1_new);
@@ -779,6 +934,192 @@ BOOST_AUTO_TEST_CASE(keva_updates_undo)
   BOOST_CHECK(undo.vkevaundo.empty());
 }
 
+BOOST_AUTO_TEST_CASE(keva_undo_compact)
+{
+  const valtype nameSpace = ValtypeFromString ("database-test-namespace");
+  const valtype key1 = ValtypeFromString ("key1");
+  const valtype key2 = ValtypeFromString ("key2");
+  const valtype key3 = ValtypeFromString ("key3");
+  const CScript addr = getTestAddress();
+
+  const bool fOldHistory = fNameHistory;
+  fNameHistory = false;
+
+  CCoinsView dummyView;
+  CCoinsViewCache view(&dummyView);
+  CBlockUndo undo;
+  CKevaData data;
+  CKevaNotifier kevaNotifier(nullptr);
+
+  CBlockIndex pindex;
+  pindex.nHeight = 100;
+  CMutableTransaction mtx;
+  mtx.SetKevacoin();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key1, ValtypeFromString ("old"))));
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  undo.vkevaundo.clear();
+
+  /* A block that changes key1 several times, creates key2 and creates
+     key3 only to delete it again.  */
+  pindex.nHeight = 101;
+  mtx.vout[0] = CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key3, ValtypeFromString ("temp")));
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  mtx.vout[0] = CTxOut(COIN, CKevaScript::buildKevaDelete(addr, nameSpace, key3));
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  const char* values[] = {"a", "b", "c"};
+  for (const char* value : values) {
+    mtx.vout[0] = CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key1, ValtypeFromString (value)));
+    ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  }
+  mtx.vout[0] = CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key2, ValtypeFromString ("new")));
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  mtx.vout[0] = CTxOut(COIN, CKevaScript::buildKevaDelete(addr, nameSpace, key1));
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  BOOST_CHECK_EQUAL(undo.vkevaundo.size(), 7U);
+
+  /* Only the state from before the block is kept.  */
+  const size_t fullSize = ::GetSerializeSize(undo, SER_DISK, CLIENT_VERSION);
+  CompactKevaUndo(undo.vkevaundo);
+  BOOST_REQUIRE_EQUAL(undo.vkevaundo.size(), 3U);
+  BOOST_CHECK(undo.vkevaundo[0].getKey() == key3);
+  BOOST_CHECK(undo.vkevaundo[1].getKey() == key1);
+  BOOST_CHECK(undo.vkevaundo[2].getKey() == key2);
+
+  /* The compact format stores the namespace only once.  */
+  CDataStream ss(SER_DISK, CLIENT_VERSION | SERIALIZE_BLOCK_UNDO_KEVA_COMPACT);
+  ss << undo;
+  BOOST_CHECK_LT(ss.size(), ::GetSerializeSize(undo, SER_DISK, CLIENT_VERSION));
+  BOOST_CHECK_LT(ss.size(), fullSize);
+  CBlockUndo read;
+  ss >> read;
+  BOOST_CHECK(ss.empty());
+  BOOST_REQUIRE_EQUAL(read.vkevaundo.size(), 3U);
+
+  for (auto it = read.vkevaundo.rbegin(); it != read.vkevaundo.rend(); ++it) {
+    BOOST_CHECK(it->getNamespace() == nameSpace);
+    it->apply(view);
+  }
+  BOOST_CHECK(view.GetName(nameSpace, key1, data));
+  BOOST_CHECK(data.getValue() == ValtypeFromString ("old"));
+  BOOST_CHECK_EQUAL(data.getHeight(), 100U);
+  BOOST_CHECK(!view.GetName(nameSpace, key2, data));
+  BOOST_CHECK(!view.GetName(nameSpace, key3, data));
+
+  /* Records referring to a missing namespace are rejected.  */
+  CDataStream bad(SER_DISK, CLIENT_VERSION | SERIALIZE_BLOCK_UNDO_KEVA_COMPACT);
+  bad << std::vector<CTxUndo>() << std::vector<valtype>() << COMPACTSIZE(uint64_t(1)) << VARINT(uint64_t(0));
+  BOOST_CHECK_THROW(bad >> read, std::ios_base::failure);
+
+  fNameHistory = fOldHistory;
+}
+
+BOOST_AUTO_TEST_CASE(keva_undo_compact_history)
+{
+  const valtype nameSpace = ValtypeFromString ("database-test-namespace");
+  const valtype key = ValtypeFromString ("key");
+  const CScript addr = getTestAddress();
+
+  const bool fOldHistory = fNameHistory;
+  fNameHistory = true;
+
+  CCoinsViewCache view(pcoinsdbview.get());
+  CBlockUndo undo;
+  CKevaData data;
+  CNameHistory history;
+  CKevaNotifier kevaNotifier(nullptr);
+
+  CBlockIndex pindex;
+  pindex.nHeight = 100;
+  CMutableTransaction mtx;
+  mtx.SetKevacoin();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key, ValtypeFromString ("old"))));
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  undo.vkevaundo.clear();
+
+  /* Each update in the block pushes onto the history, so every undo
+     record is needed to roll it back.  */
+  pindex.nHeight = 101;
+  const char* values[] = {"a", "b", "c"};
+  for (const char* value : values) {
+    mtx.vout[0] = CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key, ValtypeFromString (value)));
+    ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  }
+  BOOST_CHECK(view.GetNameHistory(nameSpace, key, history));
+  BOOST_CHECK_EQUAL(history.getData().size(), 3U);
+
+  CompactKevaUndo(undo.vkevaundo);
+  BOOST_REQUIRE_EQUAL(undo.vkevaundo.size(), 3U);
+  for (auto it = undo.vkevaundo.rbegin(); it != undo.vkevaundo.rend(); ++it) {
+    it->apply(view);
+  }
+  BOOST_CHECK(view.GetName(nameSpace, key, data));
+  BOOST_CHECK(data.getValue() == ValtypeFromString ("old"));
+  BOOST_CHECK(!view.GetNameHistory(nameSpace, key, history) || history.empty());
+
+  fNameHistory = fOldHistory;
+}
+
+/* ************************************************************************** */
+
+namespace
+{
+
+class KevaListener : public CValidationInterface
+{
+public:
+  unsigned nUpdates = 0;
+  valtype lastKey;
+  valtype lastValue;
+
+  bool WantsKevaNotifications() const override { return true; }
+
+  void KevaUpdated(const CTransactionRef& ptx, const CBlockIndex& pindex,
+                   const valtype& nameSpace, const valtype& key, const valtype& value) override
+  {
+    ++nUpdates;
+    lastKey = key;
+    lastValue = value;
+  }
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(keva_notifier)
+{
+  const valtype nameSpace = ValtypeFromString ("database-test-namespace");
+  const valtype key = ValtypeFromString ("key");
+  const valtype value = ValtypeFromString ("value");
+
+  CMutableTransaction mtx;
+  mtx.SetKevacoin();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaPut(getTestAddress(), nameSpace, key, value)));
+  const CTransactionRef ptx = MakeTransactionRef(mtx);
+
+  CCoinsView dummyView;
+  CCoinsViewCache view(&dummyView);
+  CBlockUndo undo;
+  CBlockIndex pindex;
+  pindex.nHeight = 100;
+
+  /* None of the listeners registered by the test setup wants keva
+     notifications, so the notifier is disabled.  */
+  BOOST_CHECK(!GetMainSignals().HasKevaListeners());
+  BOOST_CHECK(!CKevaNotifier(&GetMainSignals()).isEnabled());
+  BOOST_CHECK(!CKevaNotifier(nullptr).isEnabled());
+
+  KevaListener listener;
+  RegisterValidationInterface(&listener);
+  CKevaNotifier kevaNotifier(&GetMainSignals());
+  BOOST_CHECK(kevaNotifier.isEnabled());
+  ApplyKevaTransaction(ptx, pindex, view, undo, kevaNotifier);
+  BOOST_CHECK_EQUAL(listener.nUpdates, 1U);
+  BOOST_CHECK(listener.lastKey == key);
+  BOOST_CHECK(listener.lastValue == value);
+  UnregisterValidationInterface(&listener);
+
+  BOOST_CHECK(!GetMainSignals().HasKevaListeners());
+}
+
 /* ************************************************************************** */
 
 BOOST_AUTO_TEST_CASE(keva_mempool)
@@ -949,4 +1290,266 @@ BOOST_AUTO_TEST_CASE(keva_mempool)
 
 /* ************************************************************************** */
 
+BOOST_AUTO_TEST_CASE(keva_history)
+{
+  const valtype nameSpace = ValtypeFromString ("history-test-namespace");
+  const valtype displayName = ValtypeFromString ("display name");
+  const valtype key = ValtypeFromString ("key");
+  const valtype value1 = ValtypeFromString ("value_1");
+  const valtype value2 = ValtypeFromString ("value_2");
+  const CScript addr = getTestAddress();
+
+  const bool fOldHistory = fNameHistory;
+  fNameHistory = true;
+
+  CCoinsViewCache view(pcoinsdbview.get());
+  CBlockUndo undo;
+  CKevaData data;
+  CNameHistory history;
+  CKevaNotifier kevaNotifier(NULL);
+
+  CBlockIndex pindex = CBlockIndex();
+  CMutableTransaction mtx;
+  mtx.SetKevacoin();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaNamespace(addr, nameSpace, displayName)));
+  pindex.nHeight = 100;
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+
+  /* A new key has no history.  */
+  mtx.vout.clear();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key, value1)));
+  pindex.nHeight = 200;
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  BOOST_CHECK(!view.GetNameHistory(nameSpace, key, history));
+  BOOST_CHECK(view.GetName(nameSpace, key, data));
+  const CKevaData data1 = data;
+
+  /* Updates and deletes push the old value.  Write the changes through
+     to the database to make sure the history is persisted.  */
+  mtx.vout.clear();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key, value2)));
+  pindex.nHeight = 300;
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  BOOST_CHECK(view.GetName(nameSpace, key, data));
+  const CKevaData data2 = data;
+
+  mtx.vout.clear();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaDelete(addr, nameSpace, key)));
+  pindex.nHeight = 400;
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  BOOST_CHECK(!view.GetName(nameSpace, key, data));
+
+  view.SetBestBlock(InsecureRand256());
+  BOOST_CHECK(view.Flush());
+  BOOST_CHECK(pcoinsdbview->GetNameHistory(nameSpace, key, history));
+  BOOST_CHECK(history.getData().size() == 2);
+  BOOST_CHECK(history.getData()[0] == data1);
+  BOOST_CHECK(history.getData()[1] == data2);
+
+  /* Undoing pops the history again, down to an empty one.  */
+  BOOST_CHECK(undo.vkevaundo.size() == 4);
+  undo.vkevaundo.back().apply(view);
+  undo.vkevaundo.pop_back();
+  BOOST_CHECK(view.GetName(nameSpace, key, data));
+  BOOST_CHECK(data == data2);
+  BOOST_CHECK(view.GetNameHistory(nameSpace, key, history));
+  BOOST_CHECK(history.getData().size() == 1);
+
+  undo.vkevaundo.back().apply(view);
+  undo.vkevaundo.pop_back();
+  BOOST_CHECK(view.GetName(nameSpace, key, data));
+  BOOST_CHECK(data == data1);
+  BOOST_CHECK(view.GetNameHistory(nameSpace, key, history));
+  BOOST_CHECK(history.empty());
+
+  undo.vkevaundo.back().apply(view);
+  undo.vkevaundo.pop_back();
+  BOOST_CHECK(!view.GetName(nameSpace, key, data));
+
+  BOOST_CHECK(view.Flush());
+  BOOST_CHECK(!pcoinsdbview->GetNameHistory(nameSpace, key, history));
+
+  fNameHistory = fOldHistory;
+}
+
+/* ************************************************************************** */
+
+BOOST_AUTO_TEST_CASE(keva_setinfo)
+{
+  const valtype nameSpace = ValtypeFromString ("setinfo-test-namespace");
+  const valtype displayName = ValtypeFromString ("display name");
+  const valtype key = ValtypeFromString ("key");
+  const valtype value1 = ValtypeFromString ("value_1");
+  const valtype value2 = ValtypeFromString ("value_22");
+  const CScript addr = getTestAddress();
+
+  CKevaSetInfo initial, info, computed;
+  BOOST_CHECK(pcoinsdbview->GetKevaSetInfo(initial));
+  BOOST_CHECK(pcoinsdbview->ComputeKevaSetInfo(computed));
+  BOOST_CHECK(initial.getCommitment() == computed.getCommitment());
+
+  CCoinsViewCache view(pcoinsdbview.get());
+  CBlockUndo undo;
+  CKevaNotifier kevaNotifier(NULL);
+
+  CBlockIndex pindex = CBlockIndex();
+  CMutableTransaction mtx;
+  mtx.SetKevacoin();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaNamespace(addr, nameSpace, displayName)));
+  pindex.nHeight = 100;
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  const COutPoint coin1(InsecureRand256(), 0);
+  view.AddCoin(coin1, Coin(mtx.vout[0], 100, false), false);
+
+  mtx.vout.clear();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key, value1)));
+  pindex.nHeight = 200;
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+
+  mtx.vout.clear();
+  mtx.vout.push_back(CTxOut(COIN, CKevaScript::buildKevaPut(addr, nameSpace, key, value2)));
+  pindex.nHeight = 300;
+  ApplyKevaTransaction(MakeTransactionRef(mtx), pindex, view, undo, kevaNotifier);
+  const COutPoint coin2(InsecureRand256(), 0);
+  view.AddCoin(coin2, Coin(mtx.vout[0], 300, false), false);
+  BOOST_CHECK(view.SpendCoin(coin1));
+
+  /* The cache reports the changes on top of the database.  */
+  BOOST_CHECK(view.GetKevaSetInfo(info));
+  BOOST_CHECK_EQUAL(info.nKeys, initial.nKeys + 2);
+  BOOST_CHECK_EQUAL(info.nValueBytes, initial.nValueBytes + displayName.size() + value2.size());
+  BOOST_CHECK_EQUAL(info.nCoins, initial.nCoins + 1);
+  const uint256 commitment = info.getCommitment();
+  BOOST_CHECK(commitment != initial.getCommitment());
+
+  /* After a flush, the stored summary matches a full scan.  */
+  view.SetBestBlock(InsecureRand256());
+  BOOST_CHECK(view.Flush());
+  BOOST_CHECK(pcoinsdbview->GetKevaSetInfo(info));
+  BOOST_CHECK(info.getCommitment() == commitment);
+  BOOST_CHECK(pcoinsdbview->ComputeKevaSetInfo(computed));
+  BOOST_CHECK(computed.getCommitment() == commitment);
+  BOOST_CHECK_EQUAL(computed.nKeys, info.nKeys);
+  BOOST_CHECK_EQUAL(computed.nValueBytes, info.nValueBytes);
+  BOOST_CHECK_EQUAL(computed.nCoins, info.nCoins);
+  BOOST_CHECK(pcoinsdbview->ValidateKevaDB());
+
+  /* Undoing everything and spending the other coin restores the initial
+     commitment.  */
+  while (!undo.vkevaundo.empty()) {
+    undo.vkevaundo.back().apply(view);
+    undo.vkevaundo.pop_back();
+  }
+  BOOST_CHECK(view.SpendCoin(coin2));
+  BOOST_CHECK(view.GetKevaSetInfo(info));
+  BOOST_CHECK(info.getCommitment() == initial.getCommitment());
+  BOOST_CHECK(view.Flush());
+  BOOST_CHECK(pcoinsdbview->GetKevaSetInfo(info));
+  BOOST_CHECK(info.getCommitment() == initial.getCommitment());
+  BOOST_CHECK_EQUAL(info.nKeys, initial.nKeys);
+  BOOST_CHECK_EQUAL(info.nValueBytes, initial.nValueBytes);
+  BOOST_CHECK_EQUAL(info.nCoins, initial.nCoins);
+}
+
+/* ************************************************************************** */
+
+BOOST_AUTO_TEST_CASE (keva_registry)
+{
+  BOOST_CHECK (NormalizeRegistryName (ValtypeFromString ("My Blog-42"))
+                == ValtypeFromString ("my blog-42"));
+  const std::set<valtype> trigrams = GetRegistryTrigrams (ValtypeFromString ("abcd"));
+  BOOST_CHECK_EQUAL (trigrams.size (), 2);
+  BOOST_CHECK (trigrams.count (ValtypeFromString ("abc")) == 1);
+  BOOST_CHECK (trigrams.count (ValtypeFromString ("bcd")) == 1);
+  BOOST_CHECK (GetRegistryTrigrams (ValtypeFromString ("ab")).empty ());
+  BOOST_CHECK_EQUAL (GetRegistryTrigrams (valtype (200, 'a')).size (), 1);
+
+  CBlockTreeDB db(1 << 20, true);
+  const CScript owner1 = GetScriptForDestination (CKeyID (uint160 (ParseHex ("0102030405060708090a0b0c0d0e0f1011121314"))));
+  const CScript owner2 = GetScriptForDestination (CKeyID (uint160 (ParseHex ("1112131415161718191a1b1c1d1e1f2021222324"))));
+  const valtype ns1(20, 'a');
+  const valtype ns2(20, 'b');
+
+  CKevaRegistryUpdate update;
+  update.changed[ns1].displayName = ValtypeFromString ("Daily News");
+  update.changed[ns1].nHeight = 10;
+  update.changed[ns1].owner = owner1;
+  update.changed[ns2].displayName = ValtypeFromString ("Weekly news digest");
+  update.changed[ns2].nHeight = 11;
+  update.changed[ns2].owner = owner1;
+  BOOST_CHECK (db.UpdateKevaRegistry (update));
+
+  CKevaRegistryEntry entry;
+  BOOST_CHECK (db.ReadKevaRegistryEntry (ns1, entry));
+  BOOST_CHECK_EQUAL (entry.nHeight, 10);
+  BOOST_CHECK (entry.owner == owner1);
+
+  std::vector<valtype> res;
+  BOOST_CHECK (db.SearchKevaRegistryPrefix (ValtypeFromString ("daily"), 0, 0, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns1}));
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistryPrefix (valtype (), 0, 0, res));
+  BOOST_CHECK_EQUAL (res.size (), 2);
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistryPrefix (valtype (), 1, 1, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns2}));
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistrySubstring (ValtypeFromString ("NEWS"), 0, 0, res));
+  BOOST_CHECK_EQUAL (res.size (), 2);
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistrySubstring (ValtypeFromString ("news dig"), 0, 0, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns2}));
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistrySubstring (ValtypeFromString ("NEWS"), 1, 1, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns2}));
+  /* Both names contain "ly " and "new", but only one has all trigrams.  */
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistrySubstring (ValtypeFromString ("ily new"), 0, 0, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns1}));
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistrySubstring (ValtypeFromString ("news daily"), 0, 0, res));
+  BOOST_CHECK (res.empty ());
+  BOOST_CHECK (!db.SearchKevaRegistrySubstring (ValtypeFromString ("ne"), 0, 0, res));
+  BOOST_CHECK (db.SearchKevaRegistryOwner (owner1, 0, 0, res));
+  BOOST_CHECK_EQUAL (res.size (), 2);
+
+  /* Renaming and transferring a namespace replaces its index entries.  */
+  update = CKevaRegistryUpdate ();
+  update.changed[ns2].displayName = ValtypeFromString ("Monthly");
+  update.changed[ns2].nHeight = 11;
+  update.changed[ns2].owner = owner2;
+  BOOST_CHECK (db.UpdateKevaRegistry (update));
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistrySubstring (ValtypeFromString ("news"), 0, 0, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns1}));
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistryOwner (owner2, 0, 0, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns2}));
+
+  update = CKevaRegistryUpdate ();
+  update.erased.insert (ns1);
+  BOOST_CHECK (db.UpdateKevaRegistry (update));
+  BOOST_CHECK (!db.ReadKevaRegistryEntry (ns1, entry));
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistryOwner (owner1, 0, 0, res));
+  BOOST_CHECK (res.empty ());
+  BOOST_CHECK (db.SearchKevaRegistryPrefix (valtype (), 0, 0, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns2}));
+
+  /* A name key is followed by the namespace, which starts with '5' for real
+     namespaces.  A longer query must not match it.  */
+  valtype ns3(20, 'c');
+  ns3[0] = '5';
+  update = CKevaRegistryUpdate ();
+  update.changed[ns3].displayName = ValtypeFromString ("Foo");
+  update.changed[ns3].nHeight = 12;
+  update.changed[ns3].owner = owner1;
+  BOOST_CHECK (db.UpdateKevaRegistry (update));
+  res.clear ();
+  BOOST_CHECK (db.SearchKevaRegistryPrefix (ValtypeFromString ("foo5"), 0, 0, res));
+  BOOST_CHECK (res.empty ());
+  BOOST_CHECK (db.SearchKevaRegistryPrefix (ValtypeFromString ("foo"), 0, 0, res));
+  BOOST_CHECK (res == std::vector<valtype> ({ns3}));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
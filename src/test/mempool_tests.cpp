@@ -2,9 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparamsbase.h>
+#include <consensus/validation.h>
+#include <key.h>
 #include <policy/policy.h>
+#include <script/interpreter.h>
 #include <txmempool.h>
 #include <util.h>
+#include <validation.h>
 
 #include <test/test_bitcoin.h>
 
@@ -12,6 +17,10 @@
 #include <list>
 #include <vector>
 
+struct RegtestingSetup : public TestingSetup {
+    RegtestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
 BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
 
 BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
@@ -571,4 +580,62 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_FIXTURE_TEST_CASE(MempoolLoadTest, RegtestingSetup)
+{
+    // Regtest enforces P2SH from the genesis block on, which the script
+    // flags for the next block need.  The fixture runs script check threads,
+    // so LoadMempool verifies the scripts on them before accepting the
+    // transactions one by one.
+    BOOST_CHECK(nScriptCheckThreads > 1);
+
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    const CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    auto spend = [&](const COutPoint& prevout, CAmount nValue, const CKey& signKey) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = nValue;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(signKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return MakeTransactionRef(tx);
+    };
+
+    const COutPoint coin1(InsecureRand256(), 0);
+    const COutPoint coin2(InsecureRand256(), 0);
+    {
+        LOCK(cs_main);
+        pcoinsTip->AddCoin(coin1, Coin(CTxOut(10 * COIN, scriptPubKey), 1, false), false);
+        pcoinsTip->AddCoin(coin2, Coin(CTxOut(10 * COIN, scriptPubKey), 1, false), false);
+    }
+
+    // The child spends an output that is only in mempool.dat, and the last
+    // transaction carries a signature by the wrong key.
+    CTransactionRef parent = spend(coin1, 9 * COIN, key);
+    CTransactionRef child = spend(COutPoint(parent->GetHash(), 0), 8 * COIN, key);
+    CTransactionRef invalid = spend(coin2, 9 * COIN, otherKey);
+
+    TestMemPoolEntryHelper entry;
+    entry.Fee(COIN).Time(GetTime());
+    mempool.addUnchecked(parent->GetHash(), entry.FromTx(*parent));
+    mempool.addUnchecked(child->GetHash(), entry.FromTx(*child));
+    mempool.addUnchecked(invalid->GetHash(), entry.FromTx(*invalid));
+    BOOST_CHECK(DumpMempool());
+
+    mempool.clear();
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+    BOOST_CHECK(mempool.exists(parent->GetHash()));
+    BOOST_CHECK(mempool.exists(child->GetHash()));
+    BOOST_CHECK(!mempool.exists(invalid->GetHash()));
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,10 +8,13 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <keva/common.h>
+#include <keva/main.h>
 #include <validation.h>
 #include <miner.h>
 #include <policy/policy.h>
 #include <pubkey.h>
+#include <script/keva.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -47,6 +50,29 @@ static BlockAssembler AssemblerForTest(const CChainParams& params) {
     return BlockAssembler(params, options);
 }
 
+// Assemble a template through the given cache and check that it selects the
+// same transactions as a full rebuild.
+static std::unique_ptr<CBlockTemplate> CheckIncrementalTemplate(const CChainParams& chainparams, const CScript& scriptPubKey, BlockTemplateCache& cache, size_t nBlockMaxWeight = MAX_BLOCK_WEIGHT)
+{
+    BlockAssembler::Options options;
+    options.nBlockMaxWeight = nBlockMaxWeight;
+    options.blockMinFeeRate = blockMinFeeRate;
+    options.templateCache = &cache;
+
+    std::unique_ptr<CBlockTemplate> incremental = BlockAssembler(chainparams, options).CreateNewBlock(scriptPubKey);
+    options.templateCache = nullptr;
+    std::unique_ptr<CBlockTemplate> full = BlockAssembler(chainparams, options).CreateNewBlock(scriptPubKey);
+
+    std::set<uint256> incrementalTxs, fullTxs;
+    for (size_t i = 1; i < incremental->block.vtx.size(); ++i)
+        incrementalTxs.insert(incremental->block.vtx[i]->GetHash());
+    for (size_t i = 1; i < full->block.vtx.size(); ++i)
+        fullTxs.insert(full->block.vtx[i]->GetHash());
+    BOOST_CHECK(incrementalTxs == fullTxs);
+    BOOST_CHECK_EQUAL(incremental->vTxFees[0], full->vTxFees[0]);
+    return incremental;
+}
+
 static
 struct {
     unsigned char extranonce;
@@ -530,4 +556,184 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+// Add an anyone-can-spend coin of the given value to the UTXO set
+static COutPoint AddTestCoin(CAmount nValue)
+{
+    COutPoint outpoint(InsecureRand256(), 0);
+    LOCK(cs_main);
+    pcoinsTip->AddCoin(outpoint, Coin(CTxOut(nValue, CScript() << OP_TRUE), chainActive.Height(), false), false);
+    return outpoint;
+}
+
+// Spend prevout, worth nValue, to an anyone-can-spend output and add the
+// transaction to the mempool with the given fee
+static CTransactionRef AddTestSpend(const COutPoint& prevout, CAmount nValue, CAmount nFee)
+{
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prevout);
+    tx.vout.emplace_back(nValue - nFee, CScript() << OP_TRUE);
+    mempool.addUnchecked(tx.GetHash(), entry.Fee(nFee).Time(GetTime()).FromTx(tx));
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(CreateNewBlock_incremental)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    BlockTemplateCache cache(mempool);
+
+    // The first template fills the cache
+    std::unique_ptr<CBlockTemplate> pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+
+    CTransactionRef txLow = AddTestSpend(AddTestCoin(COIN), COIN, 10000);
+    pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+
+    // A higher feerate transaction arriving later is appended to the cached
+    // selection, where a full rebuild would put it first.
+    CTransactionRef txHigh = AddTestSpend(AddTestCoin(COIN), COIN, 100000);
+    pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txLow->GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == txHigh->GetHash());
+
+    // Children of selected transactions, and removal of unselected ones
+    CTransactionRef txChild = AddTestSpend(COutPoint(txLow->GetHash(), 0), txLow->vout[0].nValue, 20000);
+    CTransactionRef txGone = AddTestSpend(AddTestCoin(COIN), COIN, 20000);
+    mempool.removeRecursive(*txGone);
+    pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == txChild->GetHash());
+
+    // A package below the minimum feerate is left out until a child pays
+    // for it, and is then picked up as the descendant package of that tx.
+    CTransactionRef txFree = AddTestSpend(AddTestCoin(COIN), COIN, 0);
+    CTransactionRef txFreeChild = AddTestSpend(COutPoint(txFree->GetHash(), 0), txFree->vout[0].nValue, 0);
+    pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    CMutableTransaction txBump;
+    txBump.vin.emplace_back(COutPoint(txFreeChild->GetHash(), 0));
+    txBump.vin.emplace_back(AddTestCoin(COIN));
+    txBump.vout.emplace_back(txFree->vout[0].nValue + COIN - 50000, CScript() << OP_TRUE);
+    mempool.addUnchecked(txBump.GetHash(), TestMemPoolEntryHelper().Fee(50000).Time(GetTime()).FromTx(txBump));
+    pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 7);
+
+    // Changes that are not tracked incrementally force a full rebuild,
+    // which orders by feerate again.
+    mempool.PrioritiseTransaction(txChild->GetHash(), 1000000);
+    pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txLow->GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == txChild->GetHash());
+
+    // Removing a selected transaction invalidates the cache
+    mempool.removeRecursive(*txLow);
+    pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txHigh->GetHash());
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(CreateNewBlock_incremental_full)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    BlockTemplateCache cache(mempool);
+
+    // Room for exactly two of the equally sized test spends
+    CTransactionRef txLow = AddTestSpend(AddTestCoin(COIN), COIN, 10000);
+    const size_t nBlockMaxWeight = 4000 + 2 * GetTransactionWeight(*txLow) + 4;
+    CTransactionRef txMid = AddTestSpend(AddTestCoin(COIN), COIN, 20000);
+    std::unique_ptr<CBlockTemplate> pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache, nBlockMaxWeight);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+
+    // A better package that no longer fits into the cached selection
+    // displaces the worst selected one, as in a full rebuild.
+    CTransactionRef txHigh = AddTestSpend(AddTestCoin(COIN), COIN, 100000);
+    pblocktemplate = CheckIncrementalTemplate(chainparams, scriptPubKey, cache, nBlockMaxWeight);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txHigh->GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == txMid->GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -120000);
+
+    mempool.clear();
+}
+
+// Register a namespace funded by prevout, worth nValue, and put nPuts values
+// into it, one transaction per operation, each spending the namespace output
+// and the change of the previous one. The transactions are added to the
+// mempool in chain order.
+static std::vector<CTransactionRef> AddTestKevaChain(const COutPoint& prevout, CAmount nValue, int nPuts, CAmount nRegisterFee, CAmount nPutFee)
+{
+    TestMemPoolEntryHelper entry;
+    const CScript scriptPubKey = CScript() << OP_TRUE;
+    std::vector<CTransactionRef> chain;
+
+    valtype nameSpace = ToByteVector(Hash160(ToByteVector(prevout.hash)));
+    const std::vector<unsigned char>& prefix = Params().Base58Prefix(CChainParams::KEVA_NAMESPACE);
+    nameSpace.insert(nameSpace.begin(), prefix.begin(), prefix.end());
+
+    CMutableTransaction tx;
+    tx.nVersion = CTransaction::KEVACOIN_VERSION;
+    tx.vin.emplace_back(prevout);
+    tx.vout.emplace_back(KEVA_LOCKED_AMOUNT, CKevaScript::buildKevaNamespace(scriptPubKey, nameSpace, ValtypeFromString("chain")));
+    tx.vout.emplace_back(nValue - KEVA_LOCKED_AMOUNT - nRegisterFee, scriptPubKey);
+    mempool.addUnchecked(tx.GetHash(), entry.Fee(nRegisterFee).Time(GetTime()).FromTx(tx));
+    chain.push_back(MakeTransactionRef(tx));
+
+    for (int i = 0; i < nPuts; ++i) {
+        const CTransaction& prev = *chain.back();
+        tx.vin.clear();
+        tx.vin.emplace_back(prev.GetHash(), 0);
+        tx.vin.emplace_back(prev.GetHash(), 1);
+        tx.vout[0].scriptPubKey = CKevaScript::buildKevaPut(scriptPubKey, nameSpace, ValtypeFromString("key"), ValtypeFromString(std::to_string(i)));
+        tx.vout[1].nValue = prev.vout[1].nValue - nPutFee;
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(nPutFee).Time(GetTime()).FromTx(tx));
+        chain.push_back(MakeTransactionRef(tx));
+    }
+    return chain;
+}
+
+BOOST_AUTO_TEST_CASE(CreateNewBlock_keva_chains)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+
+    // A cheap registration followed by well-paying updates, and some
+    // unrelated transactions in between by feerate.
+    std::vector<CTransactionRef> chain = AddTestKevaChain(AddTestCoin(COIN), COIN, 10, 1000, 100000);
+    std::vector<CTransactionRef> others;
+    for (int i = 1; i <= 3; ++i)
+        others.push_back(AddTestSpend(AddTestCoin(COIN), COIN, 2000 * i));
+
+    // The whole chain goes in as one unit, in chain order
+    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1 + chain.size() + others.size());
+    size_t nFirst = 1;
+    while (nFirst < pblocktemplate->block.vtx.size() && pblocktemplate->block.vtx[nFirst]->GetHash() != chain[0]->GetHash())
+        ++nFirst;
+    BOOST_CHECK(nFirst + chain.size() <= pblocktemplate->block.vtx.size());
+    for (size_t i = 0; i < chain.size() && nFirst + i < pblocktemplate->block.vtx.size(); ++i)
+        BOOST_CHECK(pblocktemplate->block.vtx[nFirst + i]->GetHash() == chain[i]->GetHash());
+
+    // With room for only part of the chain, the part that fits is still
+    // taken, and what does not fit does not crowd out other transactions.
+    BlockAssembler::Options options;
+    options.blockMinFeeRate = blockMinFeeRate;
+    options.nBlockMaxWeight = 4000 + WITNESS_SCALE_FACTOR * (::GetSerializeSize(*chain[0], SER_NETWORK, PROTOCOL_VERSION) +
+                                                            ::GetSerializeSize(*chain[1], SER_NETWORK, PROTOCOL_VERSION) +
+                                                            ::GetSerializeSize(*others[2], SER_NETWORK, PROTOCOL_VERSION)) + 1;
+    pblocktemplate = BlockAssembler(chainparams, options).CreateNewBlock(scriptPubKey);
+    std::set<uint256> selected;
+    for (size_t i = 1; i < pblocktemplate->block.vtx.size(); ++i)
+        selected.insert(pblocktemplate->block.vtx[i]->GetHash());
+    BOOST_CHECK_EQUAL(selected.size(), 3);
+    BOOST_CHECK(selected.count(chain[0]->GetHash()));
+    BOOST_CHECK(selected.count(chain[1]->GetHash()));
+    BOOST_CHECK(selected.count(others[2]->GetHash()));
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -187,4 +187,47 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(msg_processing_stats)
+{
+    CMsgProcessingStats stats;
+    stats.Add(50, 0);
+    stats.Add(5000, 2000);
+    stats.Add(2000000, 1000000);
+    BOOST_CHECK_EQUAL(stats.nCount, 3U);
+    BOOST_CHECK_EQUAL(stats.nTime, 2005050);
+    BOOST_CHECK_EQUAL(stats.nLockTime, 1002000);
+    BOOST_CHECK_EQUAL(stats.nMaxTime, 2000000);
+    BOOST_CHECK_EQUAL(stats.vHistogram[0], 1U);
+    BOOST_CHECK_EQUAL(stats.vHistogram[2], 1U);
+    BOOST_CHECK_EQUAL(stats.vHistogram[MSG_PROCESSING_HISTOGRAM_SIZE - 1], 1U);
+}
+
+BOOST_AUTO_TEST_CASE(lock_hold_time)
+{
+    CCriticalSection cs;
+    const void* prev_profiled_lock = g_profiled_lock.exchange(&cs);
+    const int64_t nStart = GetLockHoldTime();
+    {
+        LOCK(cs);
+        {
+            // Recursive acquisitions are only counted once.
+            LOCK(cs);
+            MilliSleep(2);
+        }
+        MilliSleep(2);
+    }
+    const int64_t nHeld = GetLockHoldTime() - nStart;
+#ifdef HAVE_THREAD_LOCAL
+    BOOST_CHECK(nHeld >= 4000);
+#endif
+    // Other locks are not counted.
+    CCriticalSection cs_other;
+    {
+        LOCK(cs_other);
+        MilliSleep(2);
+    }
+    BOOST_CHECK_EQUAL(GetLockHoldTime() - nStart, nHeld);
+    g_profiled_lock = prev_profiled_lock;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
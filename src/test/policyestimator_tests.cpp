@@ -2,8 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <clientversion.h>
+#include <fs.h>
 #include <policy/policy.h>
 #include <policy/fees.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <util.h>
@@ -179,4 +182,91 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimates_persist)
+{
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0LL;
+
+    // Higher feerates get into blocks more often, as above
+    std::vector<CTransactionRef> block;
+    std::vector<uint256> txHashes[10];
+    int blocknum = 0;
+    while (blocknum < 100) {
+        for (int j = 0; j < 10; j++) {
+            for (int k = 0; k < 4; k++) {
+                tx.vin[0].prevout.n = 10000*blocknum+100*j+k;
+                uint256 hash = tx.GetHash();
+                mpool.addUnchecked(hash, entry.Fee(1000 * (j+1)).Time(GetTime()).Height(blocknum).FromTx(tx));
+                txHashes[j].push_back(hash);
+            }
+        }
+        for (int h = 0; h <= blocknum%10; h++) {
+            for (const uint256& hash : txHashes[9-h]) {
+                CTransactionRef ptx = mpool.get(hash);
+                if (ptx)
+                    block.push_back(ptx);
+            }
+            txHashes[9-h].clear();
+        }
+        mpool.removeForBlock(block, ++blocknum);
+        block.clear();
+    }
+
+    // Repeated queries are answered from the cache with the same result
+    std::vector<CFeeRate> estimates;
+    for (int i = 1; i <= 50; i++) {
+        for (bool conservative : {false, true}) {
+            FeeCalculation feeCalc1, feeCalc2;
+            CFeeRate feeRate = feeEst.estimateSmartFee(i, &feeCalc1, conservative);
+            BOOST_CHECK(feeEst.estimateSmartFee(i, &feeCalc2, conservative) == feeRate);
+            BOOST_CHECK_EQUAL(feeCalc1.returnedTarget, feeCalc2.returnedTarget);
+            BOOST_CHECK(feeCalc1.reason == feeCalc2.reason);
+            estimates.push_back(feeRate);
+        }
+    }
+    BOOST_CHECK(estimates[2 * 2] != CFeeRate(0));
+
+    // Evicting transactions from earlier blocks counts them as failures. The
+    // estimates compared below would differ if the cached ones were kept.
+    mpool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(mpool.size(), 0);
+
+    // A written estimator reads back with the same estimates
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    {
+        CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(feeEst.Write(fileout));
+    }
+    CBlockPolicyEstimator feeEst2;
+    {
+        CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(feeEst2.Read(filein));
+    }
+    // A file of a later format is rejected and leaves the estimates alone
+    {
+        CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        fileout << 2 << CLIENT_VERSION;
+    }
+    {
+        CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(!feeEst2.Read(filein));
+    }
+    fs::remove(path);
+    for (int i = 1; i <= 50; i++) {
+        for (bool conservative : {false, true}) {
+            BOOST_CHECK(feeEst.estimateSmartFee(i, nullptr, conservative) == feeEst2.estimateSmartFee(i, nullptr, conservative));
+        }
+    }
+    for (int i = 1; i <= 48; i++) {
+        BOOST_CHECK(feeEst.estimateRawFee(i, 0.85, FeeEstimateHorizon::MED_HALFLIFE) == feeEst2.estimateRawFee(i, 0.85, FeeEstimateHorizon::MED_HALFLIFE));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
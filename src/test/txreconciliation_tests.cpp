@@ -0,0 +1,234 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <txreconciliation.h>
+#include <version.h>
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+static std::vector<uint32_t> RandomIds(size_t count)
+{
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < count; i++) {
+        ids.push_back(InsecureRand32());
+    }
+    return ids;
+}
+
+static std::vector<uint256> RandomTxids(size_t count)
+{
+    std::vector<uint256> txids;
+    for (size_t i = 0; i < count; i++) {
+        txids.push_back(InsecureRand256());
+    }
+    std::sort(txids.begin(), txids.end());
+    return txids;
+}
+
+BOOST_AUTO_TEST_CASE(sketch_decode)
+{
+    const std::vector<uint32_t> common = RandomIds(500);
+    std::vector<uint32_t> only_a = RandomIds(10);
+    std::vector<uint32_t> only_b = RandomIds(5);
+
+    const uint32_t cells = TxReconSketch::EstimateCells(common.size() + only_a.size(), common.size() + only_b.size());
+    TxReconSketch sketch_a(cells), sketch_b(cells);
+    BOOST_CHECK(sketch_a.IsValidSize());
+    for (uint32_t id : common) {
+        sketch_a.Add(id);
+        sketch_b.Add(id);
+    }
+    for (uint32_t id : only_a) sketch_a.Add(id);
+    for (uint32_t id : only_b) sketch_b.Add(id);
+
+    // The sketch survives a round trip through the network encoding.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << sketch_b;
+    BOOST_CHECK_EQUAL(ss.size(), GetSizeOfCompactSize(sketch_b.GetCells()) + sketch_b.GetCells() * 8U);
+    TxReconSketch received;
+    ss >> received;
+
+    BOOST_CHECK(sketch_a.Subtract(received));
+    std::vector<uint32_t> ids_ours, ids_theirs;
+    BOOST_CHECK(sketch_a.Decode(ids_ours, ids_theirs));
+    std::sort(ids_ours.begin(), ids_ours.end());
+    std::sort(ids_theirs.begin(), ids_theirs.end());
+    std::sort(only_a.begin(), only_a.end());
+    std::sort(only_b.begin(), only_b.end());
+    BOOST_CHECK(ids_ours == only_a);
+    BOOST_CHECK(ids_theirs == only_b);
+
+    // Sketches of different sizes cannot be combined.
+    BOOST_CHECK(!sketch_a.Subtract(TxReconSketch(cells + 3)));
+}
+
+BOOST_AUTO_TEST_CASE(sketch_capacity)
+{
+    // A difference much larger than the sketch cannot be decoded.
+    TxReconSketch sketch(30);
+    for (uint32_t id : RandomIds(200)) {
+        sketch.Add(id);
+    }
+    std::vector<uint32_t> ids_ours, ids_theirs;
+    BOOST_CHECK(!sketch.Decode(ids_ours, ids_theirs));
+
+    // An empty sketch carries no information.
+    BOOST_CHECK(!TxReconSketch().Decode(ids_ours, ids_theirs));
+}
+
+BOOST_AUTO_TEST_CASE(tracker_reconciliation)
+{
+    // Node a opened the connection to b, so a requests the sketches.
+    TxReconciliationTracker a, b;
+    const NodeId peer_b = 1, peer_a = 2;
+    BOOST_CHECK(!a.RegisterPeer(peer_b, false, TXRECONCILIATION_VERSION, 0));
+    const uint64_t salt_a = a.PreRegisterPeer(peer_b);
+    const uint64_t salt_b = b.PreRegisterPeer(peer_a);
+    BOOST_CHECK(!a.IsPeerRegistered(peer_b));
+    BOOST_CHECK(a.RegisterPeer(peer_b, false, TXRECONCILIATION_VERSION, salt_b));
+    BOOST_CHECK(b.RegisterPeer(peer_a, true, TXRECONCILIATION_VERSION, salt_a));
+    BOOST_CHECK(a.IsPeerRegistered(peer_b));
+
+    const std::vector<uint256> common = RandomTxids(100);
+    const std::vector<uint256> only_a = RandomTxids(5);
+    const std::vector<uint256> only_b = RandomTxids(7);
+    for (const uint256& txid : common) {
+        BOOST_CHECK(a.AddToSet(peer_b, txid));
+        BOOST_CHECK(b.AddToSet(peer_a, txid));
+    }
+    for (const uint256& txid : only_a) BOOST_CHECK(a.AddToSet(peer_b, txid));
+    for (const uint256& txid : only_b) BOOST_CHECK(b.AddToSet(peer_a, txid));
+
+    // Only the side that opened the connection initiates, once per interval.
+    uint16_t set_size = 0;
+    BOOST_CHECK(!b.InitiateReconciliationRequest(peer_a, 0, set_size));
+    BOOST_CHECK(a.InitiateReconciliationRequest(peer_b, 0, set_size));
+    BOOST_CHECK_EQUAL(set_size, common.size() + only_a.size());
+    BOOST_CHECK(!a.InitiateReconciliationRequest(peer_b, std::numeric_limits<int64_t>::max(), set_size));
+
+    TxReconSketch sketch;
+    BOOST_CHECK(!a.HandleReconciliationRequest(peer_b, set_size, sketch));
+    BOOST_CHECK(b.HandleReconciliationRequest(peer_a, set_size, sketch));
+    BOOST_CHECK(!b.HandleReconciliationRequest(peer_a, set_size, sketch));
+
+    bool success = false;
+    std::vector<uint256> announce_a, announce_b;
+    std::vector<uint32_t> request;
+    BOOST_CHECK(a.HandleSketch(peer_b, sketch, success, announce_a, request));
+    BOOST_CHECK(success);
+    std::sort(announce_a.begin(), announce_a.end());
+    BOOST_CHECK(announce_a == only_a);
+    BOOST_CHECK_EQUAL(request.size(), only_b.size());
+    BOOST_CHECK(!a.HandleSketch(peer_b, sketch, success, announce_a, request));
+
+    BOOST_CHECK(b.HandleReconciliationDifference(peer_a, success, request, announce_b));
+    std::sort(announce_b.begin(), announce_b.end());
+    BOOST_CHECK(announce_b == only_b);
+    BOOST_CHECK(!b.HandleReconciliationDifference(peer_a, success, request, announce_b));
+
+    a.ForgetPeer(peer_b);
+    BOOST_CHECK(!a.IsPeerRegistered(peer_b));
+    BOOST_CHECK(!a.AddToSet(peer_b, common[0]));
+}
+
+BOOST_AUTO_TEST_CASE(tracker_fallback)
+{
+    TxReconciliationTracker a, b;
+    const NodeId peer_b = 1, peer_a = 2;
+    const uint64_t salt_a = a.PreRegisterPeer(peer_b);
+    const uint64_t salt_b = b.PreRegisterPeer(peer_a);
+    BOOST_CHECK(a.RegisterPeer(peer_b, false, TXRECONCILIATION_VERSION, salt_b));
+    BOOST_CHECK(b.RegisterPeer(peer_a, true, TXRECONCILIATION_VERSION, salt_a));
+
+    // A full set makes the caller flood further transactions.
+    const std::vector<uint256> only_b = RandomTxids(MAX_RECON_SET_SIZE);
+    for (const uint256& txid : only_b) BOOST_CHECK(b.AddToSet(peer_a, txid));
+    BOOST_CHECK(!b.AddToSet(peer_a, InsecureRand256()));
+    const std::vector<uint256> only_a = RandomTxids(3);
+    for (const uint256& txid : only_a) BOOST_CHECK(a.AddToSet(peer_b, txid));
+
+    // The difference is too large for a sketch, so both sides announce everything.
+    uint16_t set_size = 0;
+    TxReconSketch sketch;
+    BOOST_CHECK(a.InitiateReconciliationRequest(peer_b, 0, set_size));
+    BOOST_CHECK(b.HandleReconciliationRequest(peer_a, set_size, sketch));
+    BOOST_CHECK_EQUAL(sketch.GetCells(), 0U);
+
+    bool success = true;
+    std::vector<uint256> announce_a, announce_b;
+    std::vector<uint32_t> request;
+    BOOST_CHECK(a.HandleSketch(peer_b, sketch, success, announce_a, request));
+    BOOST_CHECK(!success);
+    BOOST_CHECK(request.empty());
+    std::sort(announce_a.begin(), announce_a.end());
+    BOOST_CHECK(announce_a == only_a);
+
+    // Transactions whose short id collided with another one are left for the
+    // next round, which happens for a few of them at most.
+    BOOST_CHECK(b.HandleReconciliationDifference(peer_a, success, request, announce_b));
+    BOOST_CHECK(announce_b.size() + 3 > only_b.size());
+    for (const uint256& txid : announce_b) {
+        BOOST_CHECK(std::binary_search(only_b.begin(), only_b.end(), txid));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tracker_timeout)
+{
+    TxReconciliationTracker a, b;
+    const NodeId peer_b = 1, peer_a = 2;
+    const uint64_t salt_a = a.PreRegisterPeer(peer_b);
+    const uint64_t salt_b = b.PreRegisterPeer(peer_a);
+    BOOST_CHECK(a.RegisterPeer(peer_b, false, TXRECONCILIATION_VERSION, salt_b));
+    BOOST_CHECK(b.RegisterPeer(peer_a, true, TXRECONCILIATION_VERSION, salt_a));
+
+    std::vector<uint256> only_a = RandomTxids(4);
+    for (const uint256& txid : only_a) BOOST_CHECK(a.AddToSet(peer_b, txid));
+    const std::vector<uint256> only_b = RandomTxids(2);
+    for (const uint256& txid : only_b) BOOST_CHECK(b.AddToSet(peer_a, txid));
+
+    uint16_t set_size = 0;
+    std::vector<uint256> announce_a, announce_b;
+    BOOST_CHECK(a.InitiateReconciliationRequest(peer_b, 0, set_size));
+    BOOST_CHECK(!a.CheckSketchTimeout(peer_b, RECON_SKETCH_TIMEOUT * 1000000 - 1, announce_a));
+    const uint256 txid_late = InsecureRand256();
+    BOOST_CHECK(a.AddToSet(peer_b, txid_late));
+
+    // Without a sketch in time, the set is flooded, and so is everything
+    // after it until the sketch arrives.
+    BOOST_CHECK(a.CheckSketchTimeout(peer_b, RECON_SKETCH_TIMEOUT * 1000000, announce_a));
+    only_a.push_back(txid_late);
+    std::sort(only_a.begin(), only_a.end());
+    std::sort(announce_a.begin(), announce_a.end());
+    BOOST_CHECK(announce_a == only_a);
+    BOOST_CHECK(!a.CheckSketchTimeout(peer_b, std::numeric_limits<int64_t>::max(), announce_a));
+    BOOST_CHECK(!a.AddToSet(peer_b, InsecureRand256()));
+    BOOST_CHECK(!a.InitiateReconciliationRequest(peer_b, std::numeric_limits<int64_t>::max(), set_size));
+
+    // A late sketch ends the round as a failed one, so the peer floods too.
+    TxReconSketch sketch;
+    BOOST_CHECK(b.HandleReconciliationRequest(peer_a, set_size, sketch));
+    bool success = true;
+    std::vector<uint32_t> request;
+    announce_a.clear();
+    BOOST_CHECK(a.HandleSketch(peer_b, sketch, success, announce_a, request));
+    BOOST_CHECK(!success);
+    BOOST_CHECK(announce_a.empty());
+    BOOST_CHECK(request.empty());
+    BOOST_CHECK(b.HandleReconciliationDifference(peer_a, success, request, announce_b));
+    std::sort(announce_b.begin(), announce_b.end());
+    BOOST_CHECK(announce_b == only_b);
+
+    // After that, reconciliation resumes.
+    BOOST_CHECK(a.AddToSet(peer_b, InsecureRand256()));
+    BOOST_CHECK(a.InitiateReconciliationRequest(peer_b, 3600 * 1000000LL, set_size));
+    BOOST_CHECK_EQUAL(set_size, 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
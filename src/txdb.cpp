@@ -11,10 +11,12 @@
 #include <pow.h>
 #include <uint256.h>
 #include <util.h>
+#include <utilmoneystr.h>
 #include <ui_interface.h>
 #include <init.h>
 #include <script/keva.h>
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -22,16 +24,26 @@
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
-static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_NAME = 'n';
+static const char DB_KEVA_HISTORY = 'h';
+static const char DB_KEVA_SETINFO = 'K';
+static const char DB_COINS_STATS = 'S';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_COINS_STATS = 'u';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'U';
+static const char DB_SPENTINDEX = 'p';
+static const char DB_KEVA_REGISTRY = 'r';
+static const char DB_KEVA_REGISTRY_NAME = 'd';
+static const char DB_KEVA_REGISTRY_TRIGRAM = 'g';
+static const char DB_KEVA_REGISTRY_OWNER = 'o';
 
 namespace {
 
@@ -156,11 +168,104 @@ bool CCoinsViewDB::GetName(const valtype &nameSpace, const valtype &key, CKevaDa
     return db.Read(std::make_pair(DB_NAME, std::make_pair(nameSpace, key)), data);
 }
 
+bool CCoinsViewDB::GetNameHistory(const valtype &nameSpace, const valtype &key, CNameHistory &data) const {
+    assert(fNameHistory);
+    return db.Read(std::make_pair(DB_KEVA_HISTORY, std::make_pair(nameSpace, key)), data);
+}
+
+bool CCoinsViewDB::GetKevaSetInfo(CKevaSetInfo &info) const {
+    return db.Read(DB_KEVA_SETINFO, info);
+}
+
+bool CCoinsViewDB::ComputeKevaSetInfo(CKevaSetInfo &info) const {
+    info = CKevaSetInfo();
+
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    pcursor->Seek(std::make_pair(DB_NAME, std::make_pair(valtype(), valtype())));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, std::pair<valtype, valtype>> key;
+        if (!pcursor->GetKey(key) || key.first != DB_NAME)
+            break;
+        CKevaData data;
+        if (!pcursor->GetValue(data))
+            return error("%s: unable to read keva entry", __func__);
+        info.addKey(key.second.first, key.second.second, data);
+    }
+
+    std::unique_ptr<CCoinsViewCursor> pcoins(Cursor());
+    for (; pcoins->Valid(); pcoins->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcoins->GetKey(outpoint) || !pcoins->GetValue(coin))
+            return error("%s: unable to read coin", __func__);
+        if (CKevaScript::isKevaScript(coin.out.scriptPubKey))
+            info.addCoin(outpoint, coin.out, coin.nHeight);
+    }
+
+    return true;
+}
+
+bool CCoinsViewDB::InitKevaSetInfo() {
+    if (db.Exists(DB_KEVA_SETINFO))
+        return true;
+
+    CKevaSetInfo info;
+    LogPrintf("Computing the keva set summary...\n");
+    if (!ComputeKevaSetInfo(info))
+        return false;
+    LogPrintf("Keva set: %d keys, %d value bytes, %d coins\n", info.nKeys, info.nValueBytes, info.nCoins);
+    return db.Write(DB_KEVA_SETINFO, info, true);
+}
+
+bool CCoinsViewDB::ValidateKevaDB() const {
+    CKevaSetInfo stored, computed;
+    if (!GetKevaSetInfo(stored))
+        return error("%s: keva set summary is missing", __func__);
+    if (!ComputeKevaSetInfo(computed))
+        return false;
+
+    if (stored.nKeys != computed.nKeys || stored.nValueBytes != computed.nValueBytes
+            || stored.nCoins != computed.nCoins || stored.getCommitment() != computed.getCommitment()) {
+        return error("%s: keva set summary (%d keys, %d value bytes, %d coins) does not match the database (%d keys, %d value bytes, %d coins)",
+                     __func__, stored.nKeys, stored.nValueBytes, stored.nCoins, computed.nKeys, computed.nValueBytes, computed.nCoins);
+    }
+    return true;
+}
+
+bool CCoinsViewDB::GetCoinsSetStats(CCoinsSetStats &stats) const {
+    if (!fCoinStatsIndex)
+        return false;
+    return db.Read(DB_COINS_STATS, stats);
+}
+
+bool CCoinsViewDB::InitCoinsSetStats() {
+    // Totals left over from an earlier run with -coinstatsindex are out of
+    // date once blocks were connected without it.  Drop them, so that they
+    // are recomputed when the option is turned on again.
+    if (!fCoinStatsIndex)
+        return !db.Exists(DB_COINS_STATS) || db.Erase(DB_COINS_STATS, true);
+    if (db.Exists(DB_COINS_STATS))
+        return true;
+
+    LogPrintf("Computing the UTXO set statistics...\n");
+    CCoinsSetStats stats;
+    std::unique_ptr<CCoinsViewCursor> pcursor(Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin))
+            return error("%s: unable to read coin", __func__);
+        stats.AddCoin(outpoint, coin);
+    }
+    LogPrintf("UTXO set: %d outputs, %s total\n", stats.nTransactionOutputs, FormatMoney(stats.nTotalAmount));
+    return db.Write(DB_COINS_STATS, stats, true);
+}
+
 bool CCoinsViewDB::GetNamesForHeight(unsigned nHeight, std::set<valtype>& names) const {
     return false;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names, const CCoinsSetStats &stats) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -185,6 +290,18 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, con
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
+    // The keva set summary and the UTXO set statistics are only valid
+    // together with the coins and names they describe.  Drop them while
+    // those are being written and write them again in the last batch, so
+    // that an interrupted flush leaves them missing (to be recomputed on
+    // startup) rather than wrong.
+    CKevaSetInfo kevaSetInfo;
+    const bool fHaveKevaSetInfo = GetKevaSetInfo(kevaSetInfo);
+    batch.Erase(DB_KEVA_SETINFO);
+    CCoinsSetStats coinsStats;
+    const bool fHaveCoinsStats = GetCoinsSetStats(coinsStats);
+    batch.Erase(DB_COINS_STATS);
+
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
@@ -212,6 +329,14 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, con
     }
 
     names.writeBatch(batch);
+    if (fHaveKevaSetInfo) {
+        kevaSetInfo.apply(names.getSetInfo());
+        batch.Write(DB_KEVA_SETINFO, kevaSetInfo);
+    }
+    if (fHaveCoinsStats) {
+        coinsStats.Apply(stats);
+        batch.Write(DB_COINS_STATS, coinsStats);
+    }
 
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
@@ -328,19 +453,309 @@ void CKevaCache::writeBatch (CDBBatch& batch) const
     std::pair<valtype, valtype> name = std::make_pair(std::get<0>(*i), std::get<1>(*i));
     batch.Erase(std::make_pair(DB_NAME, name));
   }
+
+  assert(fNameHistory || history.empty());
+  for (const auto& entry : history) {
+    std::pair<valtype, valtype> name = std::make_pair(std::get<0>(entry.first), std::get<1>(entry.first));
+    if (entry.second.empty())
+      batch.Erase(std::make_pair(DB_KEVA_HISTORY, name));
+    else
+      batch.Write(std::make_pair(DB_KEVA_HISTORY, name), entry.second);
+  }
+}
+
+bool CBlockTreeDB::ReadBlockCoinsStats(int nHeight, CBlockCoinsStats &stats) {
+    return Read(std::make_pair(DB_BLOCK_COINS_STATS, nHeight), stats);
+}
+
+bool CBlockTreeDB::WriteBlockCoinsStats(int nHeight, const CBlockCoinsStats &stats) {
+    return Write(std::make_pair(DB_BLOCK_COINS_STATS, nHeight), stats);
+}
+
+bool CBlockTreeDB::UpdateAddressIndex(const CAddressIndexUpdate &update) {
+    CDBBatch batch(*this);
+    for (const auto& entry : update.history) {
+        if (update.fErase)
+            batch.Erase(std::make_pair(DB_ADDRESSINDEX, entry.first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, entry.first), entry.second);
+    }
+    for (const auto& entry : update.unspent) {
+        if (entry.second.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, entry.first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, entry.first), entry.second);
+    }
+    for (const auto& entry : update.spent) {
+        if (entry.second.IsNull())
+            batch.Erase(std::make_pair(DB_SPENTINDEX, entry.first));
+        else
+            batch.Write(std::make_pair(DB_SPENTINDEX, entry.first), entry.second);
+    }
+    return WriteBatch(batch);
+}
+
+/**
+ * Read the entries of one address from an index whose keys start with the
+ * script hash.  With a filter, only the entries it accepts are counted.
+ */
+template<typename Key, typename Value>
+static bool ReadAddressEntries(CDBWrapper &db, char prefix, const uint160 &hashScript, size_t nFrom, size_t nCount, std::vector<std::pair<Key, Value> > &entries, bool (*filter)(const Value&) = nullptr) {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(prefix, hashScript));
+    for (size_t nSkipped = 0; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, Key> key;
+        if (!pcursor->GetKey(key) || key.first != prefix || key.second.hashScript != hashScript)
+            break;
+        if (!filter && nSkipped < nFrom) {
+            nSkipped++;
+            continue;
+        }
+        Value value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read address index entry", __func__);
+        if (filter) {
+            if (!filter(value))
+                continue;
+            if (nSkipped < nFrom) {
+                nSkipped++;
+                continue;
+            }
+        }
+        entries.emplace_back(key.second, value);
+        if (nCount > 0 && entries.size() >= nCount)
+            break;
+    }
+    return true;
+}
+
+static bool IsKevaUnspentEntry(const CAddressUnspentValue &value) {
+    return CKevaScript::isKevaScript(value.scriptPubKey);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160 &hashScript, size_t nFrom, size_t nCount, std::vector<std::pair<CAddressIndexKey, CAmount> > &entries) {
+    return ReadAddressEntries(*this, DB_ADDRESSINDEX, hashScript, nFrom, nCount, entries);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160 &hashScript, size_t nFrom, size_t nCount, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &entries) {
+    return ReadAddressEntries(*this, DB_ADDRESSUNSPENTINDEX, hashScript, nFrom, nCount, entries);
+}
+
+bool CBlockTreeDB::ReadAddressKevaUnspentIndex(const uint160 &hashScript, size_t nFrom, size_t nCount, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &entries) {
+    return ReadAddressEntries(*this, DB_ADDRESSUNSPENTINDEX, hashScript, nFrom, nCount, entries, IsKevaUnspentEntry);
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value) {
+    return Read(std::make_pair(DB_SPENTINDEX, outpoint), value);
+}
+
+bool CBlockTreeDB::ReadKevaRegistryEntry(const valtype &nameSpace, CKevaRegistryEntry &entry) {
+    return Read(std::make_pair(DB_KEVA_REGISTRY, nameSpace), entry);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+namespace {
+
+/**
+ * A key of raw bytes after the prefix character, so that keys can be scanned
+ * by a prefix of the bytes.  Display name keys are the indexed part of the
+ * normalised name, followed by the namespace and its length, which keeps
+ * them unique.
+ */
+struct RawKey {
+    char prefix;
+    valtype data;
+
+    RawKey() : prefix(0) {}
+    RawKey(char prefixIn, const valtype& dataIn) : prefix(prefixIn), data(dataIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << prefix;
+        if (!data.empty())
+            s.write((const char*)data.data(), data.size());
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> prefix;
+        data.assign(s.begin(), s.end());
+        s.ignore(data.size());
+    }
+};
+
+RawKey RegistryNameKey(const valtype& nameSpace, const CKevaRegistryEntry& entry) {
+    valtype data = NormalizeRegistryName(entry.displayName);
+    if (data.size() > MAX_REGISTRY_SEARCH_LENGTH)
+        data.resize(MAX_REGISTRY_SEARCH_LENGTH);
+    data.insert(data.end(), nameSpace.begin(), nameSpace.end());
+    unsigned char len[4];
+    WriteBE32(len, nameSpace.size());
+    data.insert(data.end(), len, len + sizeof(len));
+    return RawKey(DB_KEVA_REGISTRY_NAME, data);
+}
+
+/** Write (or erase) the registry entry of a namespace and its search keys. */
+void WriteRegistryEntry(CDBBatch& batch, const valtype& nameSpace, const CKevaRegistryEntry& entry, bool fErase) {
+    const uint160 hashOwner = Hash160(entry.owner.begin(), entry.owner.end());
+    const auto ownerKey = std::make_pair(DB_KEVA_REGISTRY_OWNER, std::make_pair(hashOwner, nameSpace));
+    if (fErase) {
+        batch.Erase(std::make_pair(DB_KEVA_REGISTRY, nameSpace));
+        batch.Erase(RegistryNameKey(nameSpace, entry));
+        batch.Erase(ownerKey);
+    } else {
+        batch.Write(std::make_pair(DB_KEVA_REGISTRY, nameSpace), entry);
+        batch.Write(RegistryNameKey(nameSpace, entry), nameSpace);
+        batch.Write(ownerKey, nameSpace);
+    }
+    for (const valtype& trigram : GetRegistryTrigrams(NormalizeRegistryName(entry.displayName))) {
+        const auto key = std::make_pair(DB_KEVA_REGISTRY_TRIGRAM, std::make_pair(trigram, nameSpace));
+        if (fErase)
+            batch.Erase(key);
+        else
+            batch.Write(key, nameSpace);
+    }
+}
+
+/** Return whether a namespace's normalised display name matches a query. */
+bool RegistryNameMatches(CBlockTreeDB& db, const valtype& nameSpace, const valtype& query, bool fPrefix) {
+    CKevaRegistryEntry entry;
+    if (!db.ReadKevaRegistryEntry(nameSpace, entry))
+        return false;
+    const valtype name = NormalizeRegistryName(entry.displayName);
+    if (fPrefix)
+        return name.size() >= query.size() && std::equal(query.begin(), query.end(), name.begin());
+    return std::search(name.begin(), name.end(), query.begin(), query.end()) != name.end();
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+/**
+ * Collect the namespaces stored as the values of the keys that start with
+ * the serialised seek key, skipping nFrom and returning at most nCount (if
+ * positive) of those accepted by the filter.
+ */
+template<typename SeekKey, typename Filter>
+bool ScanRegistryIndex(CBlockTreeDB& db, const SeekKey& seek, size_t nFrom, size_t nCount, std::vector<valtype>& namespaces, Filter filter) {
+    CDataStream ssSeek(SER_DISK, CLIENT_VERSION);
+    ssSeek << seek;
+    const std::string prefix(ssSeek.begin(), ssSeek.end());
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(seek);
+    for (size_t nSkipped = 0; pcursor->Valid(); pcursor->Next()) {
+        RawKey key;
+        if (!pcursor->GetKey(key))
+            break;
+        std::string keyBytes(1, key.prefix);
+        keyBytes.append(key.data.begin(), key.data.end());
+        if (keyBytes.compare(0, prefix.size(), prefix) != 0)
+            break;
+        valtype nameSpace;
+        if (!pcursor->GetValue(nameSpace))
+            return error("%s: failed to read registry index entry", __func__);
+        if (!filter(nameSpace))
+            continue;
+        if (nSkipped < nFrom) {
+            nSkipped++;
+            continue;
+        }
+        namespaces.push_back(nameSpace);
+        if (nCount > 0 && namespaces.size() >= nCount)
+            break;
+    }
+    return true;
+}
+
+} // namespace
+
+bool CBlockTreeDB::UpdateKevaRegistry(const CKevaRegistryUpdate &update) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    CKevaRegistryEntry old;
+    for (const valtype& nameSpace : update.erased) {
+        if (ReadKevaRegistryEntry(nameSpace, old))
+            WriteRegistryEntry(batch, nameSpace, old, true);
+    }
+    for (const auto& entry : update.changed) {
+        if (ReadKevaRegistryEntry(entry.first, old))
+            WriteRegistryEntry(batch, entry.first, old, true);
+        WriteRegistryEntry(batch, entry.first, entry.second, false);
+    }
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::SearchKevaRegistryPrefix(const valtype &query, size_t nFrom, size_t nCount, std::vector<valtype> &namespaces) {
+    const valtype normalized = NormalizeRegistryName(query);
+    valtype seek(normalized);
+    if (seek.size() > MAX_REGISTRY_SEARCH_LENGTH)
+        seek.resize(MAX_REGISTRY_SEARCH_LENGTH);
+    // The name in a key runs straight into the namespace, so the seek also
+    // finds shorter names whose namespace starts with the rest of the query.
+    return ScanRegistryIndex(*this, RawKey(DB_KEVA_REGISTRY_NAME, seek), nFrom, nCount, namespaces,
+                             [&](const valtype& nameSpace) { return RegistryNameMatches(*this, nameSpace, normalized, true); });
+}
+
+bool CBlockTreeDB::SearchKevaRegistrySubstring(const valtype &query, size_t nFrom, size_t nCount, std::vector<valtype> &namespaces) {
+    const valtype normalized = NormalizeRegistryName(query);
+    const std::set<valtype> trigrams = GetRegistryTrigrams(normalized);
+    if (trigrams.empty())
+        return false;
+
+    // The candidates are the names containing every trigram of the query.
+    // The posting list of each trigram is sorted by namespace, so they are
+    // intersected by seeking all of them to the current candidate until
+    // they agree, which costs about as much as the shortest list.  The
+    // matches are then checked against the whole query.
+    std::vector<valtype> prefixes;
+    std::vector<std::unique_ptr<CDBIterator>> cursors;
+    for (const valtype& trigram : trigrams) {
+        CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+        ssPrefix << trigram;
+        prefixes.emplace_back(ssPrefix.begin(), ssPrefix.end());
+        cursors.emplace_back(NewIterator());
+    }
+
+    valtype candidate;
+    for (size_t nSkipped = 0; ; ) {
+        bool fAgree = true;
+        for (size_t i = 0; i < cursors.size(); i++) {
+            valtype seek(prefixes[i]);
+            seek.insert(seek.end(), candidate.begin(), candidate.end());
+            cursors[i]->Seek(RawKey(DB_KEVA_REGISTRY_TRIGRAM, seek));
+            RawKey key;
+            if (!cursors[i]->Valid() || !cursors[i]->GetKey(key) || key.prefix != DB_KEVA_REGISTRY_TRIGRAM ||
+                key.data.size() < prefixes[i].size() || !std::equal(prefixes[i].begin(), prefixes[i].end(), key.data.begin()))
+                return true;
+            const valtype suffix(key.data.begin() + prefixes[i].size(), key.data.end());
+            if (suffix != candidate) {
+                candidate = suffix;
+                fAgree = false;
+                break;
+            }
+        }
+        if (!fAgree)
+            continue;
+
+        valtype nameSpace;
+        if (!cursors[0]->GetValue(nameSpace))
+            return error("%s: failed to read registry index entry", __func__);
+        if (RegistryNameMatches(*this, nameSpace, normalized, false)) {
+            if (nSkipped < nFrom) {
+                nSkipped++;
+            } else {
+                namespaces.push_back(nameSpace);
+                if (nCount > 0 && namespaces.size() >= nCount)
+                    return true;
+            }
+        }
+        // The smallest key after the current one.
+        candidate.push_back(0);
+    }
+}
+
+bool CBlockTreeDB::SearchKevaRegistryOwner(const CScript &owner, size_t nFrom, size_t nCount, std::vector<valtype> &namespaces) {
+    const uint160 hashOwner = Hash160(owner.begin(), owner.end());
+    return ScanRegistryIndex(*this, std::make_pair(DB_KEVA_REGISTRY_OWNER, hashOwner), nFrom, nCount, namespaces,
+                             [](const valtype& nameSpace) { return true; });
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -6,9 +6,11 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include <addressindex.h>
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
+#include <keva/registry.h>
 
 #include <map>
 #include <memory>
@@ -30,12 +32,12 @@ static const int64_t nDefaultDbBatchSize = 16 << 20;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
+//! Max memory allocated to tx index DB specific cache (MiB)
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -78,16 +80,54 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     bool GetNamespace(const valtype &nameSpace, CKevaData &data) const override;
     bool GetName(const valtype &nameSpace, const valtype &key, CKevaData &data) const override;
+    bool GetNameHistory(const valtype &nameSpace, const valtype &key, CNameHistory &data) const override;
+    bool GetKevaSetInfo(CKevaSetInfo &info) const override;
+    bool GetCoinsSetStats(CCoinsSetStats &stats) const override;
     bool GetNamesForHeight(unsigned nHeight, std::set<valtype>& names) const override;
     CKevaIterator* IterateKeys(const valtype& nameSpace) const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CKevaCache &names, const CCoinsSetStats &stats) override;
     CCoinsViewCursor *Cursor() const override;
+    bool ValidateKevaDB() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
+    //! Compute the keva set summary by scanning the whole database.
+    bool ComputeKevaSetInfo(CKevaSetInfo &info) const;
+    //! Compute and store the keva set summary if the database has none yet.
+    bool InitKevaSetInfo();
+    //! Compute and store the UTXO set statistics if the database has none yet,
+    //! or drop them when -coinstatsindex is off.
+    bool InitCoinsSetStats();
     size_t EstimateSize() const override;
 };
 
+/** UTXO set statistics after a block, kept for looking up past heights */
+struct CBlockCoinsStats
+{
+    uint256 hashBlock;
+    int64_t nTransactionOutputs;
+    int64_t nBogoSize;
+    CAmount nTotalAmount;
+    uint256 hashMuHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(hashMuHash);
+    }
+
+    CBlockCoinsStats() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    CBlockCoinsStats(const uint256& hashBlockIn, const CCoinsSetStats& stats) :
+        hashBlock(hashBlockIn), nTransactionOutputs(stats.nTransactionOutputs), nBogoSize(stats.nBogoSize),
+        nTotalAmount(stats.nTotalAmount), hashMuHash(stats.GetHash()) {}
+};
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
@@ -124,8 +164,24 @@ public:
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing);
-    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
+    bool ReadBlockCoinsStats(int nHeight, CBlockCoinsStats &stats);
+    bool WriteBlockCoinsStats(int nHeight, const CBlockCoinsStats &stats);
+    bool UpdateAddressIndex(const CAddressIndexUpdate &update);
+    //! Read the history of an address, skipping nFrom entries and returning at most nCount (0 for all).
+    bool ReadAddressIndex(const uint160 &hashScript, size_t nFrom, size_t nCount, std::vector<std::pair<CAddressIndexKey, CAmount> > &entries);
+    //! Read the unspent outputs of an address, skipping nFrom entries and returning at most nCount (0 for all).
+    bool ReadAddressUnspentIndex(const uint160 &hashScript, size_t nFrom, size_t nCount, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &entries);
+    //! Like ReadAddressUnspentIndex, but only for keva outputs, which are also the only ones counted by nFrom and nCount.
+    bool ReadAddressKevaUnspentIndex(const uint160 &hashScript, size_t nFrom, size_t nCount, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &entries);
+    bool ReadSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value);
+    bool ReadKevaRegistryEntry(const valtype &nameSpace, CKevaRegistryEntry &entry);
+    bool UpdateKevaRegistry(const CKevaRegistryUpdate &update);
+    //! Find the namespaces whose display name starts with the query (case-insensitive), skipping nFrom and returning at most nCount (0 for all).
+    bool SearchKevaRegistryPrefix(const valtype &query, size_t nFrom, size_t nCount, std::vector<valtype> &namespaces);
+    //! Find the namespaces whose display name contains the query of at least three bytes (case-insensitive).
+    bool SearchKevaRegistrySubstring(const valtype &query, size_t nFrom, size_t nCount, std::vector<valtype> &namespaces);
+    //! Find the namespaces whose keva output pays to the owner script.
+    bool SearchKevaRegistryOwner(const CScript &owner, size_t nFrom, size_t nCount, std::vector<valtype> &namespaces);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
@@ -15,6 +15,7 @@
 
 #include <amount.h>
 #include <coins.h>
+#include <flatset.h>
 #include <indirectmap.h>
 #include <keva/main.h>
 #include <policy/feerate.h>
@@ -90,8 +91,9 @@ private:
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
-    /* Cache keva operation (if any) performed by this tx.  */
-    CKevaScript kevaOp;
+    /* Keva operation (if any) performed by this tx, pointing into the
+       operations parsed and owned by the transaction.  */
+    const CKevaScript* kevaOp;
 
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
@@ -132,44 +134,46 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
-    inline CKevaScript& GetKevaOp()
+    const CKevaScript& GetKevaOp() const;
+
+    inline bool isKevaOp() const
     {
-        return kevaOp;
+        return kevaOp != nullptr;
     }
 
     inline bool isNamespaceRegistration() const
     {
-        return kevaOp.isKevaOp() && kevaOp.getKevaOp() == OP_KEVA_NAMESPACE;
+        return kevaOp && kevaOp->getKevaOp() == OP_KEVA_NAMESPACE;
     }
 
     inline bool isKeyUpdate() const
     {
-        return kevaOp.isKevaOp() && kevaOp.getKevaOp() == OP_KEVA_PUT;
+        return kevaOp && kevaOp->getKevaOp() == OP_KEVA_PUT;
     }
 
     inline bool isKeyDelete() const
     {
-        return kevaOp.isKevaOp() && kevaOp.getKevaOp() == OP_KEVA_DELETE;
+        return kevaOp && kevaOp->getKevaOp() == OP_KEVA_DELETE;
     }
 
     inline const valtype& getNamespace() const
     {
-        return kevaOp.getOpNamespace();
+        return kevaOp->getOpNamespace();
     }
 
     inline const valtype& getDisplayName() const
     {
-        return kevaOp.getOpNamespaceDisplayName();
+        return kevaOp->getOpNamespaceDisplayName();
     }
 
     inline const valtype& getKey() const
     {
-        return kevaOp.getOpKey();
+        return kevaOp->getOpKey();
     }
 
     inline const valtype& getValue() const
     {
-        return kevaOp.getOpValue();
+        return kevaOp->getOpValue();
     }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
@@ -540,15 +544,18 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    // Direct parents and children are few per entry and mostly iterated, so
+    // they are kept in sorted vectors rather than trees.
+    typedef flatset<txiter, CompareIteratorByHash> linkEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    const linkEntries & GetMemPoolParents(txiter entry) const;
+    const linkEntries & GetMemPoolChildren(txiter entry) const;
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        linkEntries parents;
+        linkEntries children;
     };
 
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
@@ -0,0 +1,296 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <hash.h>
+#include <random.h>
+
+#include <algorithm>
+
+/** Static part of the short id salt, so that ids are not reused across protocols */
+static const std::string RECON_STATIC_SALT = "Tx Relay Salting";
+/** Smallest sketch sent, as very small tables fail to decode too often */
+static const uint32_t MIN_SKETCH_CELLS = 12;
+
+/** Finalizer of MurmurHash3; short ids are already salted, so this only needs to spread the bits. */
+static inline uint32_t Mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline uint16_t CheckSum(uint32_t short_id)
+{
+    return Mix32(short_id ^ 0x5bd1e995) & 0xffff;
+}
+
+TxReconSketch::TxReconSketch(uint32_t cells_in)
+{
+    cells.resize((std::min(cells_in, MAX_SKETCH_CELLS) + NUM_HASHES - 1) / NUM_HASHES * NUM_HASHES);
+}
+
+uint32_t TxReconSketch::EstimateCells(size_t local_size, size_t remote_size)
+{
+    // The sets mostly hold transactions both sides learned from other peers
+    // in the meantime, but some of them will only be known to one side.
+    const size_t diff = std::max(local_size, remote_size) - std::min(local_size, remote_size) +
+                        std::min(local_size, remote_size) / 4 + 1;
+    return std::max<uint64_t>(MIN_SKETCH_CELLS, diff * 3 / 2 + 1);
+}
+
+void TxReconSketch::Toggle(uint32_t short_id, int16_t delta)
+{
+    const uint32_t part = cells.size() / NUM_HASHES;
+    const uint16_t check = CheckSum(short_id);
+    for (uint32_t i = 0; i < NUM_HASHES; i++) {
+        const uint32_t pos = i * part + (((uint64_t)Mix32(short_id + i * 0x9e3779b9) * part) >> 32);
+        Cell& cell = cells[pos];
+        cell.count += delta;
+        cell.key_sum ^= short_id;
+        cell.check_sum ^= check;
+    }
+}
+
+void TxReconSketch::Add(uint32_t short_id)
+{
+    if (cells.empty()) return;
+    Toggle(short_id, 1);
+}
+
+bool TxReconSketch::Subtract(const TxReconSketch& other)
+{
+    if (other.cells.size() != cells.size()) return false;
+    for (size_t i = 0; i < cells.size(); i++) {
+        cells[i].count -= other.cells[i].count;
+        cells[i].key_sum ^= other.cells[i].key_sum;
+        cells[i].check_sum ^= other.cells[i].check_sum;
+    }
+    return true;
+}
+
+bool TxReconSketch::Decode(std::vector<uint32_t>& ids_ours, std::vector<uint32_t>& ids_theirs) const
+{
+    if (cells.empty()) return false;
+    TxReconSketch work(*this);
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (const Cell& cell : work.cells) {
+            if ((cell.count != 1 && cell.count != -1) || CheckSum(cell.key_sum) != cell.check_sum) continue;
+            // A pure cell: it holds exactly one id, which can be removed everywhere.
+            const uint32_t short_id = cell.key_sum;
+            const int16_t count = cell.count;
+            (count > 0 ? ids_ours : ids_theirs).push_back(short_id);
+            if (ids_ours.size() + ids_theirs.size() > work.cells.size()) return false;
+            work.Toggle(short_id, -count);
+            progress = true;
+        }
+    }
+    for (const Cell& cell : work.cells) {
+        if (!cell.IsEmpty()) return false;
+    }
+    return true;
+}
+
+uint32_t TxReconciliationTracker::PeerState::GetShortID(const uint256& txid) const
+{
+    return (uint32_t)SipHashUint256(k0, k1, txid);
+}
+
+std::map<uint32_t, uint256> TxReconciliationTracker::PeerState::MapByShortID(std::vector<uint256>& collisions) const
+{
+    std::map<uint32_t, uint256> result;
+    for (const uint256& txid : local_set) {
+        if (!result.emplace(GetShortID(txid), txid).second) {
+            collisions.push_back(txid);
+        }
+    }
+    return result;
+}
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer)
+{
+    const uint64_t salt = GetRand(std::numeric_limits<uint64_t>::max());
+    LOCK(cs);
+    mapPendingSalts[peer] = salt;
+    return salt;
+}
+
+bool TxReconciliationTracker::RegisterPeer(NodeId peer, bool is_peer_inbound, uint32_t peer_version, uint64_t remote_salt)
+{
+    LOCK(cs);
+    auto it = mapPendingSalts.find(peer);
+    if (it == mapPendingSalts.end() || peer_version < 1) return false;
+
+    PeerState state;
+    state.we_initiate = !is_peer_inbound;
+    const uint256 salt = (CHashWriter(SER_GETHASH, 0) << RECON_STATIC_SALT
+                          << std::min(it->second, remote_salt) << std::max(it->second, remote_salt)).GetHash();
+    state.k0 = salt.GetUint64(0);
+    state.k1 = salt.GetUint64(1);
+    mapPendingSalts.erase(it);
+    mapPeers[peer] = std::move(state);
+    return true;
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer)
+{
+    LOCK(cs);
+    mapPendingSalts.erase(peer);
+    mapPeers.erase(peer);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer) const
+{
+    LOCK(cs);
+    return mapPeers.count(peer);
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer, const uint256& txid)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end() || it->second.sketch_timed_out || it->second.local_set.size() >= MAX_RECON_SET_SIZE) return false;
+    it->second.local_set.insert(txid);
+    return true;
+}
+
+bool TxReconciliationTracker::InitiateReconciliationRequest(NodeId peer, int64_t now, uint16_t& local_set_size)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end()) return false;
+    PeerState& state = it->second;
+    if (!state.we_initiate || state.awaiting_sketch || state.sketch_timed_out || state.next_request > now) return false;
+
+    state.awaiting_sketch = true;
+    state.next_request = PoissonNextSend(now, RECON_REQUEST_INTERVAL);
+    state.sketch_deadline = now + RECON_SKETCH_TIMEOUT * 1000000;
+    local_set_size = std::min<size_t>(state.local_set.size(), std::numeric_limits<uint16_t>::max());
+    return true;
+}
+
+bool TxReconciliationTracker::CheckSketchTimeout(NodeId peer, int64_t now, std::vector<uint256>& txs_to_announce)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end()) return false;
+    PeerState& state = it->second;
+    if (!state.awaiting_sketch || state.sketch_deadline > now) return false;
+
+    // The peer may still answer, and has to be told that the round failed
+    // then, so no new request is sent until it does.
+    state.awaiting_sketch = false;
+    state.sketch_timed_out = true;
+    txs_to_announce.assign(state.local_set.begin(), state.local_set.end());
+    state.local_set.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationRequest(NodeId peer, uint16_t remote_set_size, TxReconSketch& sketch)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end()) return false;
+    PeerState& state = it->second;
+    if (state.we_initiate || state.awaiting_diff) return false;
+
+    // New transactions go into the next round while this one completes.
+    std::vector<uint256> collisions;
+    state.snapshot = state.MapByShortID(collisions);
+    state.local_set.clear();
+    state.local_set.insert(collisions.begin(), collisions.end());
+    state.awaiting_diff = true;
+
+    const uint32_t cells = TxReconSketch::EstimateCells(state.snapshot.size(), remote_set_size);
+    if (cells > MAX_SKETCH_CELLS) {
+        sketch = TxReconSketch();
+        return true;
+    }
+    sketch = TxReconSketch(cells);
+    for (const auto& entry : state.snapshot) {
+        sketch.Add(entry.first);
+    }
+    return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId peer, const TxReconSketch& sketch, bool& success,
+                                           std::vector<uint256>& txs_to_announce, std::vector<uint32_t>& ids_to_request)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end()) return false;
+    PeerState& state = it->second;
+    if (!state.we_initiate || !(state.awaiting_sketch || state.sketch_timed_out) || !sketch.IsValidSize()) return false;
+    const bool timed_out = state.sketch_timed_out;
+    state.awaiting_sketch = false;
+    state.sketch_timed_out = false;
+
+    std::vector<uint256> collisions;
+    const std::map<uint32_t, uint256> local = state.MapByShortID(collisions);
+    state.local_set.clear();
+    txs_to_announce = collisions;
+
+    TxReconSketch diff(sketch.GetCells());
+    for (const auto& entry : local) {
+        diff.Add(entry.first);
+    }
+    std::vector<uint32_t> ids_ours;
+    success = !timed_out && sketch.GetCells() > 0 && diff.Subtract(sketch) && diff.Decode(ids_ours, ids_to_request);
+    if (success) {
+        for (uint32_t short_id : ids_ours) {
+            auto itTx = local.find(short_id);
+            if (itTx == local.end()) {
+                // Decoded an id we never had: the decoding went wrong.
+                success = false;
+                break;
+            }
+            txs_to_announce.push_back(itTx->second);
+        }
+    }
+    if (!success) {
+        // Fall back to announcing everything, the peer does the same.
+        ids_to_request.clear();
+        txs_to_announce.clear();
+        for (const auto& entry : local) {
+            txs_to_announce.push_back(entry.second);
+        }
+        for (const uint256& txid : collisions) {
+            txs_to_announce.push_back(txid);
+        }
+    }
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationDifference(NodeId peer, bool success, const std::vector<uint32_t>& ids_requested,
+                                                             std::vector<uint256>& txs_to_announce)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end()) return false;
+    PeerState& state = it->second;
+    if (state.we_initiate || !state.awaiting_diff || ids_requested.size() > MAX_RECON_SET_SIZE) return false;
+    state.awaiting_diff = false;
+
+    txs_to_announce.clear();
+    if (success) {
+        for (uint32_t short_id : ids_requested) {
+            auto itTx = state.snapshot.find(short_id);
+            if (itTx != state.snapshot.end()) {
+                txs_to_announce.push_back(itTx->second);
+            }
+        }
+    } else {
+        for (const auto& entry : state.snapshot) {
+            txs_to_announce.push_back(entry.second);
+        }
+    }
+    state.snapshot.clear();
+    return true;
+}
@@ -0,0 +1,189 @@
+// Copyright (c) 2018 The Kevacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include <net.h>
+#include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -txreconciliation, whether to relay transactions to peers supporting it by set reconciliation */
+static const bool DEFAULT_TXRECONCILIATION_ENABLE = false;
+/** Version of the reconciliation protocol we speak, exchanged in "sendrecon" */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Average delay between reconciliation requests to each peer we initiate reconciliation with, in seconds */
+static const int64_t RECON_REQUEST_INTERVAL = 4;
+/** Time to wait for the sketch after a reconciliation request before flooding the set instead, in seconds */
+static const int64_t RECON_SKETCH_TIMEOUT = 30;
+/** Maximum number of transactions queued for reconciliation with a peer; any further ones are flooded */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Maximum number of cells in a sketch; larger differences fall back to flooding */
+static const uint32_t MAX_SKETCH_CELLS = 3 * 1024;
+
+/**
+ * An invertible Bloom lookup table over 32-bit short transaction ids.
+ *
+ * Each id is added to one cell in each of NUM_HASHES disjoint parts of the
+ * table. Subtracting the sketch of another set cancels out the ids both sets
+ * have in common, and as long as the table is about 1.5 times larger than
+ * the symmetric difference, the remaining ids can be peeled off one by one.
+ * Decoding therefore depends on the size of the difference only, but as that
+ * is not known in advance, EstimateCells sizes the sketch from the set sizes.
+ */
+class TxReconSketch
+{
+public:
+    static const uint32_t NUM_HASHES = 3;
+
+    struct Cell {
+        int16_t count;
+        uint32_t key_sum;
+        uint16_t check_sum;
+
+        Cell() : count(0), key_sum(0), check_sum(0) {}
+
+        bool IsEmpty() const { return count == 0 && key_sum == 0 && check_sum == 0; }
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(count);
+            READWRITE(key_sum);
+            READWRITE(check_sum);
+        }
+    };
+
+    TxReconSketch() {}
+    /** Create an empty sketch of at least the given number of cells. */
+    explicit TxReconSketch(uint32_t cells);
+
+    /**
+     * Number of cells to reconcile sets of the given sizes with: enough for a
+     * difference of their size difference plus a quarter of the smaller set,
+     * so it grows with the sets. Larger differences fail to decode, and the
+     * transactions are flooded instead.
+     */
+    static uint32_t EstimateCells(size_t local_size, size_t remote_size);
+
+    void Add(uint32_t short_id);
+    /** Subtract another sketch of the same size, cancelling out the ids in both. Returns false on a size mismatch. */
+    bool Subtract(const TxReconSketch& other);
+    /**
+     * Recover the ids of a sketch produced by Subtract. ids_ours receives the ids
+     * only in this set, ids_theirs the ids only in the subtracted one. Returns
+     * false if the difference was too large to decode.
+     */
+    bool Decode(std::vector<uint32_t>& ids_ours, std::vector<uint32_t>& ids_theirs) const;
+
+    uint32_t GetCells() const { return cells.size(); }
+    /** Whether the number of cells is one a sketch can have. */
+    bool IsValidSize() const { return cells.size() <= MAX_SKETCH_CELLS && cells.size() % NUM_HASHES == 0; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(cells);
+    }
+
+private:
+    std::vector<Cell> cells;
+
+    void Toggle(uint32_t short_id, int16_t delta);
+};
+
+/**
+ * Tracks the reconciliation state with each peer that negotiated it.
+ *
+ * Transactions we would announce to such a peer are queued in a set instead.
+ * The side that opened the connection periodically requests a sketch of the
+ * peer's set ("reqrecon"). The peer responds with a "sketch" and moves its set
+ * to a snapshot. We subtract the sketch of our own set, announce the
+ * transactions the peer is missing and ask for the short ids of the ones we are
+ * missing ("reconcildiff"), which the peer then announces. If the sketch cannot
+ * be decoded, both sides announce their full sets instead, as when flooding.
+ * If the sketch does not arrive in time, we flood our set and the transactions
+ * that follow until it does, and then finish the round as a failed one.
+ */
+class TxReconciliationTracker
+{
+private:
+    struct PeerState {
+        /** Whether we request the sketches (we opened the connection) */
+        bool we_initiate;
+        /** Salt for the short ids, derived from both sides' salts */
+        uint64_t k0, k1;
+        /** Transactions to reconcile in the next round */
+        std::set<uint256> local_set;
+        /** Responder: the set the last sketch was built from, until the difference arrives */
+        std::map<uint32_t, uint256> snapshot;
+        bool awaiting_diff = false;
+        /** Initiator: whether a request is outstanding, and when to send the next one (in microseconds) */
+        bool awaiting_sketch = false;
+        int64_t next_request = 0;
+        /** Initiator: when the outstanding request times out, and whether it did (in microseconds) */
+        int64_t sketch_deadline = 0;
+        bool sketch_timed_out = false;
+
+        uint32_t GetShortID(const uint256& txid) const;
+        /** Map the local set by short id. Transactions whose short id collides are returned separately. */
+        std::map<uint32_t, uint256> MapByShortID(std::vector<uint256>& collisions) const;
+    };
+
+    mutable CCriticalSection cs;
+    /** Our salt for each peer we sent "sendrecon" to but did not receive it from yet */
+    std::map<NodeId, uint64_t> mapPendingSalts GUARDED_BY(cs);
+    std::map<NodeId, PeerState> mapPeers GUARDED_BY(cs);
+
+public:
+    /** Generate our salt for a new peer, to be sent to it in "sendrecon". */
+    uint64_t PreRegisterPeer(NodeId peer);
+    /** Complete negotiation after receiving the peer's "sendrecon". Returns false if we did not offer it. */
+    bool RegisterPeer(NodeId peer, bool is_peer_inbound, uint32_t peer_version, uint64_t remote_salt);
+    void ForgetPeer(NodeId peer);
+    bool IsPeerRegistered(NodeId peer) const;
+
+    /** Queue a transaction for reconciliation. Returns false if it has to be flooded instead. */
+    bool AddToSet(NodeId peer, const uint256& txid);
+
+    /** Initiator: whether a request is due at now (in microseconds); fills in the size of our set to send along. */
+    bool InitiateReconciliationRequest(NodeId peer, int64_t now, uint16_t& local_set_size);
+    /**
+     * Initiator: whether the outstanding request timed out at now (in
+     * microseconds). If so, fills in our set, which is to be announced, and
+     * further transactions are flooded until the sketch arrives.
+     */
+    bool CheckSketchTimeout(NodeId peer, int64_t now, std::vector<uint256>& txs_to_announce);
+    /**
+     * Responder: build the sketch of our set for a "reqrecon". An empty sketch
+     * tells the initiator to fall back to flooding. Returns false on a protocol
+     * violation.
+     */
+    bool HandleReconciliationRequest(NodeId peer, uint16_t remote_set_size, TxReconSketch& sketch);
+    /**
+     * Initiator: process the peer's sketch. Fills in the transactions to announce
+     * to the peer and the short ids to ask for in "reconcildiff". A sketch that
+     * arrives after the request timed out always fails. Returns false on a
+     * protocol violation.
+     */
+    bool HandleSketch(NodeId peer, const TxReconSketch& sketch, bool& success,
+                      std::vector<uint256>& txs_to_announce, std::vector<uint32_t>& ids_to_request);
+    /**
+     * Responder: process a "reconcildiff". Fills in the transactions to announce:
+     * the requested ones, or the whole snapshot if reconciliation failed. Returns
+     * false on a protocol violation.
+     */
+    bool HandleReconciliationDifference(NodeId peer, bool success, const std::vector<uint32_t>& ids_requested,
+                                        std::vector<uint256>& txs_to_announce);
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -96,6 +96,13 @@ public:
     }
 };
 
+/**
+ * Serialization flag for CBlockUndo, to store the keva undo records in the
+ * compact format.  Undo data written that way is marked by
+ * BLOCK_KEVA_UNDO_COMPACT in the block index.
+ */
+static const int SERIALIZE_BLOCK_UNDO_KEVA_COMPACT = 0x20000000;
+
 /** Undo information for a CBlock */
 class CBlockUndo
 {
@@ -105,12 +112,24 @@ public:
     /** Stack of operations done to the keva database.  */
     std::vector<CKevaTxUndo> vkevaundo;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        ::Serialize(s, vtxundo);
+        if (s.GetVersion() & SERIALIZE_BLOCK_UNDO_KEVA_COMPACT) {
+            ::Serialize(s, KevaUndoCompactSerializer(&vkevaundo));
+        } else {
+            ::Serialize(s, vkevaundo);
+        }
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(vtxundo);
-        READWRITE(vkevaundo);
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, vtxundo);
+        if (s.GetVersion() & SERIALIZE_BLOCK_UNDO_KEVA_COMPACT) {
+            ::Unserialize(s, REF(KevaUndoCompactDeserializer(&vkevaundo)));
+        } else {
+            ::Unserialize(s, vkevaundo);
+        }
     }
 };
 
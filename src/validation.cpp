@@ -5,6 +5,7 @@
 
 #include <validation.h>
 
+#include <addressindex.h>
 #include <arith_uint256.h>
 #include <chain.h>
 #include <chainparams.h>
@@ -14,9 +15,13 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/hash-ops.h>
+#include <crypto/sha256.h>
 #include <cuckoocache.h>
 #include <hash.h>
+#include <index/txindex.h>
 #include <init.h>
+#include <keva/registry.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -42,6 +47,7 @@
 
 #include <future>
 #include <sstream>
+#include <unordered_map>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -214,7 +220,7 @@ uint256 hashBestBlock;
 int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
-bool fTxIndex = false;
+bool fAddressIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -676,12 +682,9 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         /* If this is a name update (or firstupdate), make sure that the
            existing name entry (if any) is in the dummy cache.  Otherwise
            tx validation done below (in CheckInputs) will not be correct.  */
-        for (const auto& txout : tx.vout)
+        for (const auto& txop : tx.GetKevaOps())
         {
-            const CKevaScript kevaOp(txout.scriptPubKey);
-            if (!kevaOp.isKevaOp()) {
-                continue;
-            }
+            const CKevaScript& kevaOp = txop.second;
             if (kevaOp.isAnyUpdate()) {
                 const valtype& nameSpace = kevaOp.getOpNamespace();
                 const valtype& key = kevaOp.getOpKey();
@@ -1068,28 +1071,8 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut->GetHash() != hash)
-                    return error("%s: txid mismatch", __func__);
-                return true;
-            }
-
-            // transaction not found in index, nothing more can be done
-            return false;
+        if (g_txindex) {
+            return g_txindex->FindTx(hash, hashBlock, txOut);
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -1145,6 +1128,80 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
+namespace {
+/**
+ * Cache of pre-RandomX headers whose CryptoNight proof of work is known to be
+ * valid. A header is checked on header sync, on block receipt, on every disk
+ * read and again in ConnectBlock(); each check costs a full CryptonightR hash.
+ */
+class CPoWCache
+{
+private:
+     //! Entries are SHA256(nonce || block hash)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_powcache;
+
+public:
+    CPoWCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_powcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_powcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CPoWCache powCache;
+} // namespace
+
+void InitPoWCache()
+{
+    size_t nElems = powCache.setup_bytes(POW_CACHE_SIZE);
+    LogPrintf("Using %zu MiB for proof-of-work cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nElems);
+}
+
+/**
+ * Check the proof of work of a block header. The block hash commits to the
+ * whole CryptoNight blob, including nBits and the height, so the outcome for
+ * pre-RandomX headers can be cached by block hash.
+ */
+static bool CheckBlockProofOfWork(const CBlockHeader& block, const Consensus::Params& consensusParams)
+{
+    if (block.cnHeader.major_version >= RX_BLOCK_VERSION)
+        return CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams);
+
+    uint256 entry;
+    powCache.ComputeEntry(entry, block.GetHash());
+    if (powCache.Get(entry))
+        return true;
+    if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+        return false;
+    powCache.Set(entry);
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
@@ -1163,7 +1220,7 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     }
 
     // Check the header
-    if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+    if (!CheckBlockProofOfWork(block, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -1364,6 +1421,10 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    if (pkevaCheck) {
+        CValidationState state;
+        return pkevaCheck->check(state);
+    }
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
@@ -1491,7 +1552,7 @@ namespace {
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION | SERIALIZE_BLOCK_UNDO_KEVA_COMPACT);
     if (fileout.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
@@ -1507,7 +1568,7 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     fileout << blockundo;
 
     // calculate & write checksum
-    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION | SERIALIZE_BLOCK_UNDO_KEVA_COMPACT);
     hasher << hashBlock;
     hasher << blockundo;
     fileout << hasher.GetHash();
@@ -1522,8 +1583,10 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
         return error("%s: no undo data available", __func__);
     }
 
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read; undo data written by older versions has
+    // the keva records in the full format.
+    const int nVersion = CLIENT_VERSION | (pindex->nStatus & BLOCK_KEVA_UNDO_COMPACT ? SERIALIZE_BLOCK_UNDO_KEVA_COMPACT : 0);
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, nVersion);
     if (filein.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
@@ -1695,35 +1758,41 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
         CDiskBlockPos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION | SERIALIZE_BLOCK_UNDO_KEVA_COMPACT) + 40))
             return error("ConnectBlock(): FindUndoPos failed");
         if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
             return AbortNode(state, "Failed to write undo data");
 
         // update nUndoPos in block index
         pindex->nUndoPos = _pos.nPos;
-        pindex->nStatus |= BLOCK_HAVE_UNDO;
+        pindex->nStatus |= BLOCK_HAVE_UNDO | BLOCK_KEVA_UNDO_COMPACT;
         setDirtyBlockIndex.insert(pindex);
     }
 
     return true;
 }
 
-static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
+static bool WriteAddressIndexDataForBlock(const CBlock& block, const CBlockUndo& blockundo, CValidationState& state, const CBlockIndex* pindex, bool fConnect)
 {
-    if (!fTxIndex) return true;
+    if (!fAddressIndex) return true;
 
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
-    for (const CTransactionRef& tx : block.vtx)
-    {
-        vPos.push_back(std::make_pair(tx->GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    CAddressIndexUpdate update;
+    BuildAddressIndexUpdate(block, blockundo, pindex->nHeight, fConnect, update);
+    if (!pblocktree->UpdateAddressIndex(update)) {
+        return AbortNode(state, "Failed to write address index");
     }
 
-    if (!pblocktree->WriteTxIndex(vPos)) {
-        return AbortNode(state, "Failed to write transaction index");
+    return true;
+}
+
+static bool WriteKevaRegistryDataForBlock(const CBlock& block, const CBlockUndo& blockundo, const CCoinsView& view, CValidationState& state, const CBlockIndex* pindex, bool fConnect)
+{
+    if (!fKevaRegistry) return true;
+
+    CKevaRegistryUpdate update;
+    BuildKevaRegistryUpdate(block, blockundo, pindex->nHeight, fConnect, view, *pblocktree, update);
+    if (!pblocktree->UpdateKevaRegistry(update)) {
+        return AbortNode(state, "Failed to write keva namespace registry");
     }
 
     return true;
@@ -1736,6 +1805,42 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Closure verifying the proof of work of one header on a PoW check thread.
+ * Its main effect is filling the PoW cache: headers are still accepted in
+ * order afterwards, and an invalid one gets rejected (and hashed again) there.
+ * Its result only tells the caller to stop hashing further headers.
+ */
+class CPoWCheck
+{
+private:
+    const CBlockHeader *pheader;
+    const Consensus::Params *pconsensusParams;
+
+public:
+    CPoWCheck(): pheader(nullptr), pconsensusParams(nullptr) {}
+    CPoWCheck(const CBlockHeader& header, const Consensus::Params& consensusParams) :
+        pheader(&header), pconsensusParams(&consensusParams) { }
+
+    bool operator()() {
+        return CheckBlockProofOfWork(*pheader, *pconsensusParams);
+    }
+
+    void swap(CPoWCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(pconsensusParams, check.pconsensusParams);
+    }
+};
+
+// Every check is a multi-millisecond CryptonightR hash, so hand them out one
+// at a time.
+static CCheckQueue<CPoWCheck> powcheckqueue(1);
+
+void ThreadPoWCheck() {
+    RenameThread("kevacoin-powcheck");
+    powcheckqueue.Thread();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1956,7 +2061,12 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // The keva rules are consensus rules independent of the scripts, so
+    // they are checked even below the assumed-valid block.  The checks are
+    // collected while connecting and handed to the script check threads in
+    // one batch, so they have to outlive the queue control.
+    std::vector<CKevaCheck> vKevaChecks;
+    CCheckQueueControl<CScriptCheck> control(nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
@@ -1965,6 +2075,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    CKevaNotifier kevaNotifier(fJustCheck ? nullptr : &GetMainSignals());
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -1974,9 +2085,14 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         if (!tx.IsCoinBase())
         {
             CAmount txfee = 0;
-            if (!Consensus::CheckTxInputs(tx, state, view, pindex->nHeight, SCRIPT_VERIFY_KEVA_MEMPOOL, txfee)) {
+            if (!Consensus::CheckTxInputs(tx, state, view, pindex->nHeight, SCRIPT_VERIFY_KEVA_MEMPOOL, txfee, false)) {
                 return error("%s: Consensus::CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
             }
+            // The keva input has to be resolved before UpdateCoins spends it.
+            CKevaCheck kevaCheck(tx, pindex->nHeight, view);
+            if (kevaCheck.isNeeded()) {
+                vKevaChecks.push_back(std::move(kevaCheck));
+            }
             nFees += txfee;
             if (!MoneyRange(nFees)) {
                 return state.DoS(100, error("%s: accumulated fee in the block out of range.", __func__),
@@ -2022,8 +2138,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
-        CKevaNotifier kevaNotifier(&GetMainSignals());
-        ApplyKevaTransaction(tx, *pindex, view, blockundo, kevaNotifier);
+        ApplyKevaTransaction(block.vtx[i], *pindex, view, blockundo, kevaNotifier);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
@@ -2035,7 +2150,26 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                                block.vtx[0]->GetValueOut(), blockReward),
                                REJECT_INVALID, "bad-cb-amount");
 
-    if (!control.Wait())
+    if (nScriptCheckThreads) {
+        std::vector<CScriptCheck> vChecks;
+        vChecks.reserve(vKevaChecks.size());
+        for (const CKevaCheck& kevaCheck : vKevaChecks)
+            vChecks.emplace_back(kevaCheck);
+        control.Add(vChecks);
+    }
+    const bool fChecksPassed = control.Wait();
+    if (!fChecksPassed || !nScriptCheckThreads) {
+        // Without check threads the keva checks run here. After a failure on
+        // the queue they are run again, as a keva rule violation is not
+        // punished like a script failure.
+        for (const CKevaCheck& kevaCheck : vKevaChecks) {
+            if (!kevaCheck.check(state)) {
+                return state.Invalid(error("%s: CheckKevaTransaction on %s failed", __func__, kevaCheck.GetTxHash().ToString()),
+                                     0, "", "Tx invalid for Kevacoin");
+            }
+        }
+    }
+    if (!fChecksPassed)
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
@@ -2043,6 +2177,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     if (fJustCheck)
         return true;
 
+    // Only the state from before the block is needed to disconnect it.
+    CompactKevaUndo(blockundo.vkevaundo);
+
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
 
@@ -2051,7 +2188,10 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (!WriteTxIndexDataForBlock(block, state, pindex))
+    if (!WriteAddressIndexDataForBlock(block, blockundo, state, pindex, true))
+        return false;
+
+    if (!WriteKevaRegistryDataForBlock(block, blockundo, view, state, pindex, true))
         return false;
 
     assert(pindex->phashBlock);
@@ -2290,6 +2430,15 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         bool flushed = view.Flush();
         assert(flushed);
     }
+    if (fAddressIndex || fKevaRegistry) {
+        CBlockUndo blockundo;
+        if (!UndoReadFromDisk(blockundo, pindexDelete))
+            return AbortNode(state, "Failed to read undo data");
+        if (!WriteAddressIndexDataForBlock(block, blockundo, state, pindexDelete, false))
+            return false;
+        if (!WriteKevaRegistryDataForBlock(block, blockundo, *pcoinsTip, state, pindexDelete, false))
+            return false;
+    }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
@@ -2441,6 +2590,14 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     // Update chainActive & related variables.
     chainActive.SetTip(pindexNew);
     UpdateTip(pindexNew, chainparams);
+    CheckNameDB(false);
+
+    // Remember the UTXO set statistics after this block for gettxoutsetinfo.
+    CCoinsSetStats coinsStats;
+    if (fCoinStatsIndex && pcoinsTip->GetCoinsSetStats(coinsStats)) {
+        if (!pblocktree->WriteBlockCoinsStats(pindexNew->nHeight, CBlockCoinsStats(pindexNew->GetBlockHash(), coinsStats)))
+            return AbortNode(state, "Failed to write UTXO set statistics");
+    }
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
@@ -3045,7 +3202,7 @@ static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state,
     }
 
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+    if (fCheckPOW && !CheckBlockProofOfWork(block, consensusParams))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
@@ -3378,6 +3535,38 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+    if (nScriptCheckThreads && headers.size() > 1) {
+        // Verify the CryptoNight proof of work of unknown pre-RandomX headers
+        // in parallel, so the sequential pass below finds them in the cache.
+        // That is only worth it for a batch the sequential pass would get
+        // through: one that connects to a known header and is continuous.
+        std::vector<CPoWCheck> vChecks;
+        {
+            LOCK(cs_main);
+            uint256 hashPrev = headers[0].hashPrevBlock;
+            if (mapBlockIndex.count(hashPrev)) {
+                for (const CBlockHeader& header : headers) {
+                    if (header.hashPrevBlock != hashPrev) {
+                        vChecks.clear();
+                        break;
+                    }
+                    hashPrev = header.GetHash();
+                    if (header.cnHeader.major_version < RX_BLOCK_VERSION && !mapBlockIndex.count(hashPrev))
+                        vChecks.emplace_back(header, chainparams.GetConsensus());
+                }
+            }
+        }
+        // Hash one header per thread at a time and stop at the first invalid
+        // one, so bogus headers cost at most one round more than they would
+        // sequentially.
+        for (size_t i = 0; vChecks.size() > 1 && i < vChecks.size(); i += nScriptCheckThreads) {
+            std::vector<CPoWCheck> vRound(vChecks.begin() + i, vChecks.begin() + std::min(vChecks.size(), i + nScriptCheckThreads));
+            CCheckQueueControl<CPoWCheck> control(&powcheckqueue);
+            control.Add(vRound);
+            if (!control.Wait())
+                break;
+        }
+    }
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
@@ -3577,7 +3766,7 @@ void PruneOneBlockFile(const int fileNumber)
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
-            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~(BLOCK_HAVE_UNDO | BLOCK_KEVA_UNDO_COMPACT);
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -3873,9 +4062,17 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadReindexing(fReindexing);
     if(fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
+    // Check whether we have a keva history index
+    pblocktree->ReadFlag("kevahistory", fNameHistory);
+    LogPrintf("%s: keva history index %s\n", __func__, fNameHistory ? "enabled" : "disabled");
+
+    // Check whether we have an address index
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+
+    // Check whether we have a keva namespace registry
+    pblocktree->ReadFlag("kevaregistry", fKevaRegistry);
+    LogPrintf("%s: keva namespace registry %s\n", __func__, fKevaRegistry ? "enabled" : "disabled");
 
     return true;
 }
@@ -4152,7 +4349,7 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
             // Reduce validity
             pindexIter->nStatus = std::min<unsigned int>(pindexIter->nStatus & BLOCK_VALID_MASK, BLOCK_VALID_TREE) | (pindexIter->nStatus & ~BLOCK_VALID_MASK);
             // Remove have-data flags.
-            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_KEVA_UNDO_COMPACT);
             // Remove storage location.
             pindexIter->nFile = 0;
             pindexIter->nDataPos = 0;
@@ -4260,9 +4457,12 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
+        fNameHistory = gArgs.GetBoolArg("-kevahistory", DEFAULT_KEVA_HISTORY);
+        pblocktree->WriteFlag("kevahistory", fNameHistory);
+        fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+        pblocktree->WriteFlag("addressindex", fAddressIndex);
+        fKevaRegistry = gArgs.GetBoolArg("-kevaregistry", DEFAULT_KEVA_REGISTRY);
+        pblocktree->WriteFlag("kevaregistry", fKevaRegistry);
     }
     return true;
 }
@@ -4632,6 +4832,68 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+/** Number of transactions whose scripts are checked in one batch on load */
+static const size_t MEMPOOL_LOAD_CHECK_BATCH = 1000;
+
+/**
+ * Verify the scripts of transactions about to be loaded into the mempool on
+ * the script check threads, so that the signature cache is warm once they
+ * are accepted one by one. Inputs are resolved from the UTXO set or from
+ * earlier transactions in the list, which DumpMempool writes in topological
+ * order. The outcome does not matter: every transaction is still fully
+ * validated by AcceptToMemoryPool afterwards.
+ */
+static void PreCheckMempoolScripts(const std::vector<CTransactionRef>& vtx)
+{
+    if (!nScriptCheckThreads || vtx.empty())
+        return;
+
+    int64_t nStart = GetTimeMicros();
+    std::unordered_map<uint256, const CTransaction*, SaltedTxidHasher> mapLoaded;
+    for (const CTransactionRef& tx : vtx)
+        mapLoaded.emplace(tx->GetHash(), tx.get());
+
+    size_t nChecked = 0;
+    for (size_t nBatchStart = 0; nBatchStart < vtx.size(); nBatchStart += MEMPOOL_LOAD_CHECK_BATCH) {
+        const size_t nBatchEnd = std::min(vtx.size(), nBatchStart + MEMPOOL_LOAD_CHECK_BATCH);
+        std::vector<PrecomputedTransactionData> txdata;
+        txdata.reserve(nBatchEnd - nBatchStart);
+        std::vector<CScriptCheck> vChecks;
+        {
+            LOCK(cs_main);
+            for (size_t i = nBatchStart; i < nBatchEnd; i++) {
+                const CTransaction& tx = *vtx[i];
+                std::vector<CTxOut> vSpent;
+                for (const CTxIn& txin : tx.vin) {
+                    const Coin& coin = pcoinsTip->AccessCoin(txin.prevout);
+                    if (!coin.IsSpent()) {
+                        vSpent.push_back(coin.out);
+                        continue;
+                    }
+                    auto it = mapLoaded.find(txin.prevout.hash);
+                    if (it == mapLoaded.end() || txin.prevout.n >= it->second->vout.size())
+                        break;
+                    vSpent.push_back(it->second->vout[txin.prevout.n]);
+                }
+                if (vSpent.size() != tx.vin.size())
+                    continue;
+                txdata.emplace_back(tx);
+                for (unsigned int j = 0; j < tx.vin.size(); j++)
+                    vChecks.emplace_back(vSpent[j], tx, j, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, &txdata.back());
+                nChecked++;
+            }
+        }
+
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+
+        if (ShutdownRequested())
+            return;
+    }
+    LogPrint(BCLog::MEMPOOL, "Checked scripts of %u of %u mempool transactions in %.2fms\n", nChecked, vtx.size(), (GetTimeMicros() - nStart) * 0.001);
+}
+
 bool LoadMempool(void)
 {
     const CChainParams& chainparams = Params();
@@ -4657,6 +4919,12 @@ bool LoadMempool(void)
         }
         uint64_t num;
         file >> num;
+
+        // Read everything up front, so that the scripts of the unexpired
+        // transactions can be checked in parallel before they are accepted.
+        std::vector<CTransactionRef> vtx;
+        std::vector<int64_t> vTime, vFeeDelta;
+        std::vector<CTransactionRef> vtxCheck;
         while (num--) {
             CTransactionRef tx;
             int64_t nTime;
@@ -4664,8 +4932,21 @@ bool LoadMempool(void)
             file >> tx;
             file >> nTime;
             file >> nFeeDelta;
+            if (nTime + nExpiryTimeout > nNow)
+                vtxCheck.push_back(tx);
+            vtx.push_back(std::move(tx));
+            vTime.push_back(nTime);
+            vFeeDelta.push_back(nFeeDelta);
+        }
+
+        PreCheckMempoolScripts(vtxCheck);
+        vtxCheck.clear();
+
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const CTransactionRef& tx = vtx[i];
+            const int64_t nTime = vTime[i];
 
-            CAmount amountdelta = nFeeDelta;
+            CAmount amountdelta = vFeeDelta[i];
             if (amountdelta) {
                 mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
@@ -37,6 +37,7 @@ class CChainParams;
 class CCoinsViewDB;
 class CInv;
 class CConnman;
+class CKevaCheck;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
@@ -81,6 +82,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Size of the cache of verified pre-RandomX proof of work, enough for the whole CryptoNight era of the main chain */
+static const size_t POW_CACHE_SIZE = 4 << 20; // 4 MiB
+/** Default for -largepages, back proof-of-work memory with huge pages when available */
+static const bool DEFAULT_LARGE_PAGES = true;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -170,7 +175,7 @@ extern uint256 hashBestBlock;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
+extern bool fAddressIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -274,6 +279,8 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the proof-of-work checking thread */
+void ThreadPoWCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -357,8 +364,10 @@ bool TestLockPointValidity(const LockPoints* lp);
 bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false);
 
 /**
- * Closure representing one script verification
+ * Closure representing one script verification, or the Kevacoin rule check
+ * of one transaction, so that both run on the script check threads.
  * Note that this stores references to the spending transaction 
+ * (or to the keva check, which the caller keeps alive)
  */
 class CScriptCheck
 {
@@ -370,11 +379,14 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    const CKevaCheck *pkevaCheck;
 
 public:
-    CScriptCheck(): ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), pkevaCheck(nullptr) {}
     CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pkevaCheck(nullptr) { }
+    explicit CScriptCheck(const CKevaCheck& kevaCheckIn) :
+        ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr), pkevaCheck(&kevaCheckIn) { }
 
     bool operator()();
 
@@ -386,6 +398,7 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pkevaCheck, check.pkevaCheck);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -394,6 +407,9 @@ public:
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Initializes the cache of verified pre-RandomX proof of work */
+void InitPoWCache();
+
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
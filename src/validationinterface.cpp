@@ -31,9 +31,9 @@ struct MainSignalsInstance {
     boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
 
     /** Keva related */
-    boost::signals2::signal<void (const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace)> KevaNamespaceCreated;
-    boost::signals2::signal<void (const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key, const std::string& value)> KevaUpdated;
-    boost::signals2::signal<void (const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key)> KevaDeleted;
+    boost::signals2::signal<void (const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace)> KevaNamespaceCreated;
+    boost::signals2::signal<void (const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key, const valtype& value)> KevaUpdated;
+    boost::signals2::signal<void (const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key)> KevaDeleted;
 
     // We are not allowed to assume the scheduler only runs in one thread,
     // but must ensure all callbacks happen in-order, so we end up creating
@@ -90,6 +90,9 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.m_internals->NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
 
     /** Keva related */
+    if (!pwalletIn->WantsKevaNotifications()) {
+        return;
+    }
     g_signals.m_internals->KevaNamespaceCreated.connect(boost::bind(&CValidationInterface::KevaNamespaceCreated, pwalletIn, _1, _2, _3));
     g_signals.m_internals->KevaUpdated.connect(boost::bind(&CValidationInterface::KevaUpdated, pwalletIn, _1, _2, _3, _4, _5));
     g_signals.m_internals->KevaDeleted.connect(boost::bind(&CValidationInterface::KevaDeleted, pwalletIn, _1, _2, _3, _4));
@@ -200,14 +203,18 @@ void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared
     m_internals->NewPoWValidBlock(pindex, block);
 }
 
-void CMainSignals::KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace) {
+bool CMainSignals::HasKevaListeners() const {
+    return !m_internals->KevaNamespaceCreated.empty() || !m_internals->KevaUpdated.empty() || !m_internals->KevaDeleted.empty();
+}
+
+void CMainSignals::KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace) {
     m_internals->KevaNamespaceCreated(ptx, pindex, nameSpace);
 }
 
-void CMainSignals::KevaUpdated(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key, const std::string& value) {
+void CMainSignals::KevaUpdated(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key, const valtype& value) {
     m_internals->KevaUpdated(ptx, pindex, nameSpace, key, value);
 }
 
-void CMainSignals::KevaDeleted(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key) {
+void CMainSignals::KevaDeleted(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key) {
     m_internals->KevaDeleted(ptx, pindex, nameSpace, key);
 }
@@ -113,21 +113,30 @@ protected:
 
     /**
      * Keva related interface.
-     * Notifies listeners of a new namespace.
+     * Whether the listener wants the Keva* notifications below. Only
+     * listeners returning true are subscribed to them, so that blocks are
+     * connected without building them when nobody listens.
      */
-    virtual void KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace) {}
+    virtual bool WantsKevaNotifications() const { return false; }
 
     /**
      * Keva related interface.
-     * Notifies listeners of a key creation or update.
+     * Notifies listeners of a new namespace. The arguments are the raw
+     * script data; encoding them is left to the listener.
      */
-    virtual void KevaUpdated(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key, const std::string& value) {}
+    virtual void KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace) {}
 
     /**
      * Keva related interface.
      * Notifies listeners of a key creation or update.
      */
-    virtual void KevaDeleted(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key) {}
+    virtual void KevaUpdated(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key, const valtype& value) {}
+
+    /**
+     * Keva related interface.
+     * Notifies listeners of a key deletion.
+     */
+    virtual void KevaDeleted(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key) {}
 
     /**
      * Notifies listeners that a block which builds directly on our current tip
@@ -175,9 +184,11 @@ public:
     void NewPoWValidBlock(const CBlockIndex *, const std::shared_ptr<const CBlock>&);
 
     /** Keva related */
-    void KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex& pindex, const std::string& nameSpace);
-    void KevaUpdated(const CTransactionRef &ptx, const CBlockIndex& pindex, const std::string& nameSpace, const std::string& key, const std::string& value);
-    void KevaDeleted(const CTransactionRef &ptx, const CBlockIndex& pindex, const std::string& nameSpace, const std::string& key);
+    /** Whether any listener is subscribed to the keva notifications. */
+    bool HasKevaListeners() const;
+    void KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex& pindex, const valtype& nameSpace);
+    void KevaUpdated(const CTransactionRef &ptx, const CBlockIndex& pindex, const valtype& nameSpace, const valtype& key, const valtype& value);
+    void KevaDeleted(const CTransactionRef &ptx, const CBlockIndex& pindex, const valtype& nameSpace, const valtype& key);
 };
 
 CMainSignals& GetMainSignals();
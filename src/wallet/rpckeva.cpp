@@ -140,29 +140,20 @@ UniValue keva_list_namespaces(const JSONRPCRequest& request)
         continue;
       }
 
-      CKevaScript kevaOp;
-      int nOut = -1;
-      for (unsigned i = 0; i < tx.tx->vout.size(); ++i) {
-        const CKevaScript cur(tx.tx->vout[i].scriptPubKey);
-        if (cur.isKevaOp()) {
-          if (nOut != -1) {
-            LogPrintf ("ERROR: wallet contains tx with multiple name outputs");
-          } else {
-            kevaOp = cur;
-            nOut = i;
-          }
-        }
-      }
-
-      if (nOut == -1) {
+      const CKevaTxOps& kevaOps = tx.tx->GetKevaOps();
+      if (kevaOps.empty()) {
         continue;
       }
+      if (kevaOps.size() > 1) {
+        LogPrintf ("ERROR: wallet contains tx with multiple name outputs");
+      }
+      const CKevaScript& kevaOp = kevaOps[0].second;
 
       if (!kevaOp.isNamespaceRegistration() && !kevaOp.isAnyUpdate()) {
         continue;
       }
 
-      const valtype nameSpace = kevaOp.getOpNamespace();
+      const valtype& nameSpace = kevaOp.getOpNamespace();
       const std::string nameSpaceStr = EncodeBase58Check(nameSpace);
       const CBlockIndex* pindex;
       const int depth = tx.GetDepthInMainChain(pindex);
@@ -11,7 +11,10 @@
 #include <vector>
 
 #include <consensus/validation.h>
+#include <keva/common.h>
+#include <keva/main.h>
 #include <rpc/server.h>
+#include <script/keva.h>
 #include <test/test_bitcoin.h>
 #include <validation.h>
 #include <wallet/coincontrol.h>
@@ -603,6 +606,33 @@ BOOST_AUTO_TEST_CASE(LoadReceiveRequests)
     BOOST_CHECK_EQUAL(values[1], "val_rr1");
 }
 
+BOOST_AUTO_TEST_CASE(GetAmountsReceived)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+    LOCK(pwalletMain->cs_wallet);
+    BOOST_CHECK(pwalletMain->AddKey(key));
+
+    // A plain output and a keva output, both received by the wallet.
+    CMutableTransaction mtx;
+    mtx.SetKevacoin();
+    mtx.vout.push_back(CTxOut(5 * COIN, script));
+    mtx.vout.push_back(CTxOut(KEVA_LOCKED_AMOUNT, CKevaScript::buildKevaPut(script, ValtypeFromString("namespace"), ValtypeFromString("key"), ValtypeFromString("value"))));
+    const CWalletTx wtx(pwalletMain.get(), MakeTransactionRef(mtx));
+
+    std::list<COutputEntry> listReceived, listSent;
+    CAmount nFee;
+    std::string strSentAccount;
+    wtx.GetAmounts(listReceived, listSent, nFee, strSentAccount, ISMINE_ALL);
+    BOOST_CHECK(listSent.empty());
+    BOOST_REQUIRE_EQUAL(listReceived.size(), 2U);
+    BOOST_CHECK_EQUAL(listReceived.front().amount, 5 * COIN);
+    BOOST_CHECK(listReceived.front().kevaOp.empty());
+    BOOST_CHECK_EQUAL(listReceived.back().amount, 0);
+    BOOST_CHECK(!listReceived.back().kevaOp.empty());
+}
+
 class ListCoinsTestingSetup : public TestChain100Setup
 {
 public:
@@ -1327,8 +1327,7 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter, bool fE
             if (txin.prevout.n < prev.tx->vout.size())
             {
                 const CTxOut& prevout = prev.tx->vout[txin.prevout.n];
-                if (fExcludeKeva
-                    && CKevaScript::isKevaScript(prevout.scriptPubKey))
+                if (fExcludeKeva && prev.tx->GetKevaOp(txin.prevout.n))
                     return 0;
 
                 if (IsMine(prev.tx->vout[txin.prevout.n]) & filter)
@@ -1536,14 +1535,14 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
     {
         const CTxOut& txout = tx->vout[i];
         isminetype fIsMine = pwallet->IsMine(txout);
-        const CKevaScript kevaOp(txout.scriptPubKey);
+        const CKevaScript* kevaOp = tx->GetKevaOp(i);
         // Only need to handle txouts if AT LEAST one of these is true:
         //   1) they debit from us (sent)
         //   2) the output is to us (received)
         if (nDebit > 0)
         {
             // Don't report 'change' txouts
-            if (pwallet->IsChange(txout) && !kevaOp.isKevaOp())
+            if (pwallet->IsChange(txout) && !kevaOp)
                 continue;
         }
         else if (!(fIsMine & filter))
@@ -1562,11 +1561,11 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
         COutputEntry output = {address, "", txout.nValue, (int)i};
 
         // If we have a keva script, set the "keva" parameter.
-        if (kevaOp.isKevaOp()) {
-            if (kevaOp.isAnyUpdate()) {
-                output.kevaOp = "update: " + EncodeBase58Check(kevaOp.getOpNamespace());
+        if (kevaOp) {
+            if (kevaOp->isAnyUpdate()) {
+                output.kevaOp = "update: " + EncodeBase58Check(kevaOp->getOpNamespace());
             } else {
-                output.kevaOp = "new: " + EncodeBase58Check(kevaOp.getOpNamespace());
+                output.kevaOp = "new: " + EncodeBase58Check(kevaOp->getOpNamespace());
             }
             output.amount = 0;
         }
@@ -1578,7 +1577,7 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
 
         // If we are receiving the output, add it as a "received" entry
         if ((fIsMine & filter)
-            && (!kevaOp.isKevaOp() || !(nDebit > 0)))
+            && (!kevaOp || !(nDebit > 0)))
             listReceived.push_back(output);
     }
 
@@ -2275,10 +2274,10 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
                 bool fSpendableIn = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO);
                 bool fSolvableIn = (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO;
 
-                CKevaScript kevaOp(pcoin->tx->vout[i].scriptPubKey);
-                if (kevaOp.isKevaOp()) {
+                const CKevaScript* kevaOp = pcoin->tx->GetKevaOp(i);
+                if (kevaOp) {
                     if (kevaNamespace) {
-                        if (*kevaNamespace == EncodeBase58Check(kevaOp.getOpNamespace())) {
+                        if (*kevaNamespace == EncodeBase58Check(kevaOp->getOpNamespace())) {
                             vCoins.push_back(COutput(pcoin, i, nDepth, fSpendableIn, fSolvableIn, safeTx));
                             return;
                         }
@@ -3177,19 +3176,10 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CCon
                     return false;
                 }
             } else {
-                CKevaScript kevaOp;
-                auto _tx = wtx.tx;
-                if (_tx->IsKevacoin()) {
-                    for (const auto& txOut : _tx->vout) {
-                        const CKevaScript curKevaOp(txOut.scriptPubKey);
-                        if (!curKevaOp.isKevaOp()) {
-                            continue;
-                        }
-                        assert(!kevaOp.isKevaOp());
-                        kevaOp = curKevaOp;
-                    }
-                    assert(kevaOp.isKevaOp());
-                    mempool.addKevaUnchecked(wtx.GetHash(), kevaOp);
+                const CKevaTxOps& kevaOps = wtx.tx->GetKevaOps();
+                if (wtx.tx->IsKevacoin()) {
+                    assert(kevaOps.size() == 1);
+                    mempool.addKevaUnchecked(wtx.GetHash(), kevaOps[0].second);
                 }
                 wtx.RelayWalletTransaction(connman);
             }
@@ -36,9 +36,9 @@ public:
     virtual bool NotifyTransaction(const CTransaction &transaction);
 
     virtual bool NotifyKeva(const CTransactionRef &ptx, const CBlockIndex &pindex, unsigned int type,
-                            const std::string& nameSpace,
-                            const std::string& key = std::string(),
-                            const std::string& value = std::string());
+                            const valtype& nameSpace,
+                            const valtype& key = valtype(),
+                            const valtype& value = valtype());
 
 protected:
     void *psocket;
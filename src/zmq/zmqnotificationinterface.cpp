@@ -191,7 +191,17 @@ void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CB
     }
 }
 
-void CZMQNotificationInterface::KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace)
+bool CZMQNotificationInterface::WantsKevaNotifications() const
+{
+    for (const CZMQAbstractNotifier* notifier : notifiers) {
+        if (notifier->GetType() == "pubkeva") {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CZMQNotificationInterface::KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
@@ -205,7 +215,7 @@ void CZMQNotificationInterface::KevaNamespaceCreated(const CTransactionRef &ptx,
     }
 }
 
-void CZMQNotificationInterface::KevaUpdated(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key, const std::string& value)
+void CZMQNotificationInterface::KevaUpdated(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key, const valtype& value)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
@@ -219,7 +229,7 @@ void CZMQNotificationInterface::KevaUpdated(const CTransactionRef &ptx, const CB
     }
 }
 
-void CZMQNotificationInterface::KevaDeleted(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key)
+void CZMQNotificationInterface::KevaDeleted(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
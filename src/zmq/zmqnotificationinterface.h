@@ -35,9 +35,10 @@ protected:
     /**
      * Keva related interface.
      */
-    void KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace) override;
-    void KevaUpdated(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key, const std::string& value) override;
-    void KevaDeleted(const CTransactionRef &ptx, const CBlockIndex &pindex, const std::string& nameSpace, const std::string& key) override;
+    bool WantsKevaNotifications() const override;
+    void KevaNamespaceCreated(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace) override;
+    void KevaUpdated(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key, const valtype& value) override;
+    void KevaDeleted(const CTransactionRef &ptx, const CBlockIndex &pindex, const valtype& nameSpace, const valtype& key) override;
 
 private:
     CZMQNotificationInterface();
@@ -3,8 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <univalue.h>
+#include <base58.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <keva/common.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
@@ -198,7 +200,7 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
 
-bool CZMQPublishKevaNotifier::NotifyKeva(const CTransactionRef &ptx, const CBlockIndex &pindex, unsigned int type, const std::string& nameSpace, const std::string& key, const std::string& value)
+bool CZMQPublishKevaNotifier::NotifyKeva(const CTransactionRef &ptx, const CBlockIndex &pindex, unsigned int type, const valtype& nameSpace, const valtype& key, const valtype& value)
 {
     uint256 hash = ptx->GetHash();
     int height = pindex.nHeight;
@@ -220,14 +222,14 @@ bool CZMQPublishKevaNotifier::NotifyKeva(const CTransactionRef &ptx, const CBloc
         entry.pushKV("type", "unknown");
     }
 
-    entry.pushKV("namespace", nameSpace);
+    entry.pushKV("namespace", EncodeBase58Check(nameSpace));
 
     if (key.size() > 0) {
-        entry.pushKV("key", key);
+        entry.pushKV("key", ValtypeToString(key));
     }
 
     if (value.size() > 0) {
-        entry.pushKV("value", value);
+        entry.pushKV("value", ValtypeToString(value));
     }
 
     std::string data = entry.write(0, 0);
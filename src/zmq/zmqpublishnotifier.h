@@ -60,9 +60,9 @@ class CZMQPublishKevaNotifier : public CZMQAbstractPublishNotifier
 {
 public:
     bool NotifyKeva(const CTransactionRef &ptx, const CBlockIndex &pindex, unsigned int type,
-                    const std::string& nameSpace,
-                    const std::string& key = std::string(),
-                    const std::string& value = std::string()) override;
+                    const valtype& nameSpace,
+                    const valtype& key = valtype(),
+                    const valtype& value = valtype()) override;
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -51,6 +51,8 @@ class MiningTest(BitcoinTestFramework):
         assert_equal(mining_info['difficulty'], Decimal('1.999969720836845'))
         assert_equal(mining_info['networkhashps'], Decimal('0.003333333333333334'))
         assert_equal(mining_info['pooledtx'], 0)
+        assert_equal(mining_info['powmemory']['largepages'], True)
+        assert_equal(set(mining_info['powmemory'].keys()), {'largepages', 'cn_scratchpads', 'randomx_cache', 'randomx_dataset'})
 
         # Mine a block to leave initial block download
         node.generate(1)
@@ -36,7 +36,7 @@ from test_framework.util import (
 class BlockchainTest(BitcoinTestFramework):
     def set_test_params(self):
         self.num_nodes = 1
-        self.extra_args = [['-stopatheight=207', '-prune=1']]
+        self.extra_args = [['-stopatheight=207', '-prune=1', '-coinstatsindex']]
 
     def run_test(self):
         self._test_getblockchaininfo()
@@ -145,6 +145,16 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized_2']), 64)
 
+        self.log.info("Test that gettxoutsetinfo() with the muhash hash type agrees")
+        res_mu = node.gettxoutsetinfo("muhash")
+        assert_equal(res_mu['total_amount'], res['total_amount'])
+        assert_equal(res_mu['height'], res['height'])
+        assert_equal(res_mu['txouts'], res['txouts'])
+        assert_equal(res_mu['bogosize'], res['bogosize'])
+        assert_equal(res_mu['bestblock'], res['bestblock'])
+        assert_equal(len(res_mu['muhash']), 64)
+        assert 'transactions' not in res_mu
+
         self.log.info("Test that gettxoutsetinfo() works for blockchain with just the genesis block")
         b1hash = node.getblockhash(1)
         node.invalidateblock(b1hash)
@@ -157,6 +167,9 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res2['bogosize'], 0),
         assert_equal(res2['bestblock'], node.getblockhash(0))
         assert_equal(len(res2['hash_serialized_2']), 64)
+        res2_mu = node.gettxoutsetinfo("muhash")
+        assert_equal(res2_mu['txouts'], 0)
+        assert res2_mu['muhash'] != res_mu['muhash']
 
         self.log.info("Test that gettxoutsetinfo() returns the same result after invalidate/reconsider block")
         node.reconsiderblock(b1hash)
@@ -169,6 +182,19 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res['bogosize'], res3['bogosize'])
         assert_equal(res['bestblock'], res3['bestblock'])
         assert_equal(res['hash_serialized_2'], res3['hash_serialized_2'])
+        assert_equal(node.gettxoutsetinfo("muhash")['muhash'], res_mu['muhash'])
+
+        self.log.info("Test that gettxoutsetinfo() returns the statistics at past heights")
+        # The blocks were reconnected above, with -coinstatsindex.
+        res4 = node.gettxoutsetinfo("muhash", 200)
+        assert_equal(res4['muhash'], res_mu['muhash'])
+        assert_equal(res4['total_amount'], res['total_amount'])
+        res5 = node.gettxoutsetinfo("muhash", 100)
+        assert_equal(res5['height'], 100)
+        assert_equal(res5['bestblock'], node.getblockhash(100))
+        assert_equal(res5['txouts'], 100)
+        assert_raises_rpc_error(-8, "Block height out of range", node.gettxoutsetinfo, "muhash", 201)
+        assert_raises_rpc_error(-8, "Past heights are only supported", node.gettxoutsetinfo, "hash_serialized_2", 100)
 
     def _test_getblockheader(self):
         node = self.nodes[0]